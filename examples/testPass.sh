@@ -41,5 +41,5 @@ cat work.c.LLVM.txt
 
 # build the executable
 gcc -I$FLIPIT_PATH/include -o main.o -c main.c
-gcc -o test final.o main.o -L$FLIPIT_PATH/lib/ -lcorrupt
+gcc -o test final.o main.o -L$FLIPIT_PATH/lib/ -lcorrupt -lm -lpthread
 ./test
@@ -1,3 +1,5 @@
+import os
+
 """Name of the database file on disk to visualize, or if it does not exist
    create it and populate with injection information
 """
@@ -23,6 +25,16 @@ LLVM_log_path = "../llvm"
 """
 LLVM_log_type = "Binary"
 
+"""Native loader of the database built by setup.sh, or None to always
+    load it from Python.
+
+    Notes
+    ----
+    only used for "Binary" logs; the Python loader is used if the program
+    does not exist
+"""
+native_ingest = os.path.join(os.environ.get("FLIPIT_PATH", ".."), "bin", "flipit-ingest")
+
 """Path to where the output files of the run(s) are stored. Each output file
     should a seperate fault injection run of the application.
 
@@ -42,6 +54,16 @@ trial_path = "../trials"
 """
 trial_prefix = "foo"
 
+"""Begining of the binary event log file names, or None to read injections
+    from the banners in the run output files.
+
+    Notes
+    -----
+    assumes trial # was run with --eventLog <event_log_prefix>_# so that its
+    logs are <event_log_prefix>_#_<rank> in trial_path
+"""
+event_log_prefix = None
+
 """Path to source code. 
 
     Notes
@@ -80,3 +102,4 @@ detectMessage = "Foo Check"
 bitMessage = "Bit position"
 siteMessage = "/*********************************Start**************************************/"
 siteEndMessage = "/*********************************End**************************************/"
+customMessage = "Custom log:"
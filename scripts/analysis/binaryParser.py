@@ -1,41 +1,120 @@
-import struct
-
-NEW_FILE_MASK = 0x8000
-currSize = 0
-def unpack(binary, fmt, size = None):
-    """Reads a value from a binary file 'binary'.
-    Parameters
-    ----------
-    binary : open binary file
-        open binary file to read from
-    fmt : single character
-        format code for the data type to read from the binary file
-    size : int
-        used when reading strings from the binary file as the size of the
-        string that should be read
+import os, ctypes
+
+"""Fault site logs (*.LLVM.bin) are read with the FlipIt site log reader,
+    lib/libFlipItSites.so (src/sites/siteLog.h), which maps the indexed logs
+    written by the pass and also decodes the older stream logs (versions 1 and
+    2). Set FLIPIT_SITELOG_LIB to use a library elsewhere.
+"""
+SITELOG_NONE = 0xFFFFFFFF
+SITELOG_GLOBAL = 0x1
+
+class SiteLogHeader(ctypes.Structure):
+    _fields_ = [("magic", ctypes.c_char * 4), ("version", ctypes.c_uint32),
+                ("module", ctypes.c_uint64), ("numSites", ctypes.c_uint32),
+                ("numFunctions", ctypes.c_uint32), ("numLocations", ctypes.c_uint32),
+                ("source", ctypes.c_uint32), ("flags", ctypes.c_uint32),
+                ("firstSite", ctypes.c_uint32), ("sites", ctypes.c_uint64),
+                ("functions", ctypes.c_uint64), ("locations", ctypes.c_uint64),
+                ("strings", ctypes.c_uint64), ("stringBytes", ctypes.c_uint64)]
+
+class SiteInfo(ctypes.Structure):
+    _fields_ = [("site", ctypes.c_uint32), ("function", ctypes.c_char_p),
+                ("opcode", ctypes.c_char_p), ("file", ctypes.c_char_p),
+                ("line", ctypes.c_uint32), ("column", ctypes.c_uint32),
+                ("inlinedAt", ctypes.c_uint32), ("type", ctypes.c_uint8),
+                ("info", ctypes.c_uint8), ("lanes", ctypes.c_uint16)]
+
+_siteLib = None
+def siteLogLibrary():
+    """Loads the site log reader the first time it is needed."""
+    global _siteLib
+    if _siteLib == None:
+        path = os.environ.get("FLIPIT_SITELOG_LIB",
+                              os.path.join(os.environ.get("FLIPIT_PATH", "."), "lib", "libFlipItSites.so"))
+        lib = ctypes.CDLL(path)
+        lib.flipit_sitelogOpen.restype = ctypes.c_void_p
+        lib.flipit_sitelogOpen.argtypes = [ctypes.c_char_p]
+        lib.flipit_sitelogClose.argtypes = [ctypes.c_void_p]
+        lib.flipit_sitelogHeader.restype = ctypes.POINTER(SiteLogHeader)
+        lib.flipit_sitelogHeader.argtypes = [ctypes.c_void_p]
+        lib.flipit_sitelogSource.restype = ctypes.c_char_p
+        lib.flipit_sitelogSource.argtypes = [ctypes.c_void_p]
+        lib.flipit_sitelogSite.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(SiteInfo)]
+        lib.flipit_sitelogLocation.restype = ctypes.c_uint32
+        lib.flipit_sitelogLocation.argtypes = [ctypes.c_void_p, ctypes.c_uint32,
+            ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_uint32), ctypes.POINTER(ctypes.c_uint32)]
+        lib.flipit_sitelogFunction.restype = ctypes.c_char_p
+        lib.flipit_sitelogFunction.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)]
+        _siteLib = lib
+    return _siteLib
+
+def _str(b):
+    return b.decode("utf-8", "replace") if b != None else ""
+
+class SiteLog:
+    """A fault site log. Sites are looked up by their index in the log
+    (firstSite to firstSite + numSites - 1) in constant time.
+
+    e.g. log = SiteLog("foo.c.LLVM.bin")
+         for s in log:
+             print (s["site"], s["file"], s["line"])
     """
-
-    global currSize
-    value = None
-
-    if fmt == 'B':
-        #print len(binary)
-        #print "reading byte[", currSize, "] = ", binary[currSize]
-        #tmplue = struct.unpack(fmt, binary[currSize])[0]
-        value = struct.unpack(fmt, bytes([binary[currSize]]))[0]
-        #value = struct.unpack(fmt, binary[currSize])[0]
-        currSize += 1
-    elif fmt == 'H':
-        value = struct.unpack(fmt, binary[currSize:currSize+2])[0]
-        currSize += 2
-    elif fmt == 'L':
-        value = struct.unpack(fmt, binary[currSize:currSize+8])[0]
-        currSize += 8
-    elif fmt == 's':
-        value = binary[currSize:currSize + size].decode("utf-8")
-        currSize += size
-
-    return value
+    def __init__(self, filename):
+        self.lib = siteLogLibrary()
+        self.log = self.lib.flipit_sitelogOpen(filename.encode())
+        if not self.log:
+            raise IOError("Not a FlipIt site log: " + filename)
+        self.header = self.lib.flipit_sitelogHeader(self.log).contents
+        self.firstSite = self.header.firstSite
+        self.numSites = self.header.numSites
+        self.version = self.header.version
+        self.source = _str(self.lib.flipit_sitelogSource(self.log))
+        # version 1 logs have global indexes and no module hash
+        self.module = None if self.header.flags & SITELOG_GLOBAL else self.header.module
+
+    def close(self):
+        if self.log:
+            self.lib.flipit_sitelogClose(self.log)
+            self.log = None
+
+    def __del__(self):
+        self.close()
+
+    def __len__(self):
+        return self.numSites
+
+    def __iter__(self):
+        for i in range(self.firstSite, self.firstSite + self.numSites):
+            yield self.site(i)
+
+    def site(self, i):
+        """Returns site i as a dictionary, or None if it is not in this log."""
+        info = SiteInfo()
+        if not self.lib.flipit_sitelogSite(self.log, i, ctypes.byref(info)):
+            return None
+        return {"site": info.site, "function": _str(info.function), "opcode": _str(info.opcode),
+                "file": _str(info.file), "line": info.line, "column": info.column,
+                "inlinedAt": self.inlinedAt(info.inlinedAt), "type": info.type,
+                "info": info.info, "lanes": info.lanes}
+
+    def inlinedAt(self, location):
+        """The (file, line, column) call sites a site was inlined into, innermost first."""
+        chain = []
+        f = ctypes.c_char_p()
+        line = ctypes.c_uint32()
+        column = ctypes.c_uint32()
+        while location != SITELOG_NONE:
+            location = self.lib.flipit_sitelogLocation(self.log, location, ctypes.byref(f),
+                                                       ctypes.byref(line), ctypes.byref(column))
+            chain.append((_str(f.value), line.value, column.value))
+        return chain
+
+    def functions(self):
+        """The (name, first site) of each function of the log."""
+        first = ctypes.c_uint32()
+        for i in range(self.header.numFunctions):
+            name = self.lib.flipit_sitelogFunction(self.log, i, ctypes.byref(first))
+            yield _str(name), first.value
 
 
 class INJ_TYPE:
@@ -150,7 +229,7 @@ def info2Str(info, opstr):
     """
 
     if info == INJ_INFO_TYPE.RESULT:
-        if opstr == "Store":
+        if opstr.lower() == "store":
             return "Value"
         else:
             return "Result"
@@ -195,9 +274,10 @@ def opcode2Str(opcode):
         return INST_STR[0]
 
 
-def parseBinaryLogFile(c, filename, outfile = None):
+def parseBinaryLogFile(c, filename, outfile = None, base = 0):
     """Reads FLipIt LLVM log file and adds fault injection site
-    information into the database.
+    information into the database. Returns the module hash (None for
+    version 1 files) and the number of sites in the file.
     Parameters
     ----------
     c : object
@@ -208,10 +288,11 @@ def parseBinaryLogFile(c, filename, outfile = None):
         if value is not 'None' then this function will write an ASCII
         version of the log file to disk with the name 'filename' but
         use the extension .txt
+    base : int
+        index of the first site of this module in the linked binary;
+        logs since version 2 number their sites from 0
     """
 
-    global currSize
-    currSize = 0
     if outfile != None:
         name = outfile
         if name == "":
@@ -220,68 +301,40 @@ def parseBinaryLogFile(c, filename, outfile = None):
                 name = name[0:-3] + "txt"
             
         outfile = open(name, "w")
-    with open(filename, "rb") as f:
-        logfile = f.read()
-        #print logfile
-        fileVersion =  unpack(logfile, 'B')
-        nameSize = unpack(logfile, 'H')
-        srcFile = unpack(logfile, 's', nameSize)
-        siteIdx = 0
-        funcName = ""
-
+    log = SiteLog(filename)
+    if log.module == None:
+        base = 0 # indexes are already global
 
+    if outfile != None:
+        outfile.write("File Version #: "+ str(log.version))
+        outfile.write("\nFile Name: " + log.source)
+        if log.module != None:
+            outfile.write("\nModule Hash: %016x" % log.module)
+    funcName = None
+    for s in log:
+        if s["function"] != funcName:
+            funcName = s["function"]
+            if outfile != None:
+                outfile.write("\n\nFunction Name: " + funcName)
+                outfile.write("\n------------------------------------------------------------------------------")
+        comment = info2Str(s["info"], s["opcode"])
+        if s["lanes"] != 0:
+            comment += " (Vector " + str(s["lanes"]) + ")"
+        srcFile = s["file"] if s["file"] != "" else "__NF"
+        msg = "\n#" + str(base + s["site"]) + "\t" + s["opcode"] + "\t" + comment\
+            + "\t" + type2Str(s["type"]) + "\t" + srcFile + ":" + str(s["line"])
+        if s["column"] != 0:
+            msg += ":" + str(s["column"])
+        for f, line, column in s["inlinedAt"]:
+            msg += "\n\tinlined at " + f + ":" + str(line) + ":" + str(column)
+        if c != None:
+            c.execute("INSERT INTO sites VALUES (?,?,?,?,?,?,?)", (base + s["site"], type2Str(s["type"]), comment, srcFile, funcName, s["line"], s["opcode"]))
         if outfile != None:
-            outfile.write("File Version #: "+ str(fileVersion))
-            outfile.write("\nFile Name: " + str(srcFile))
-
-        # loop over all functions and fault locations
-        while currSize < len(logfile): # for rest of file
-            #print "GET OPCODE"
-            opcode = unpack(logfile, 'B') #read function header
-            if opcode != 255: 
-                # opcode(1 byte), Types/Info(1 byte [3,5 bits]), Location (2+ bytes)
-                info_type = unpack(logfile, 'B')
-                ty = info_type >> 5
-                info = info_type & 0x1F
-                lineNum = unpack(logfile, 'H')
-                comment = info2Str(info, opcode2Str(opcode))
-                #print "opcode= ", opcode, " info= ", info, " ty= ", ty, " lineNum= ", lineNum
-                msg = "\n#" + str(siteIdx) + "\t" + opcode2Str(opcode) + "\t" + info2Str(info, opcode2Str(opcode))\
-                    + "\t" + type2Str(ty)
-                
-                # if the MSB bit in lineNum is set then lineNum is the size of
-                # a new filename string and we must read a new lineNum
-                #print "AND=", lineNum & NEW_FILE_MASK
-                if lineNum & NEW_FILE_MASK != 0:
-                    size = lineNum & 0x7FFF
-                    lineNum = unpack(logfile, 'H', 2)
-                    srcFile = unpack(logfile, 's', size)
-                    #print "size=", size, " new file: ", srcFile, ":", lineNum #unpack(logfile, 's', size & 0x7F)
-                #else:
-                #    print "old file: ", srcFile, ":", lineNum
-                msg += "\t" + srcFile + ":" + str(lineNum)
-                if c != None:                
-                    #print msg
-                    c.execute("INSERT INTO sites VALUES (?,?,?,?,?,?,?)", (siteIdx, type2Str(ty), comment, srcFile, funcName, lineNum, opcode))
-                if outfile != None:
-                    outfile.write(msg)
-                siteIdx += 1
-            else: # start of function
-                size = unpack(logfile, 'B')
-                funcName = unpack(logfile, 's', size)
-                if outfile != None:
-                    #funcName = unpack(logfile, 's', size)
-                    outfile.write("\n\nFunction Name: " + funcName)
-                    outfile.write("\n------------------------------------------------------------------------------")
-                #print funcName
-                siteIdx = unpack(logfile, 'L')
-                #print "Fault Site Idx: ", siteIdx
-            #print currSize
+            outfile.write(msg)
+    moduleHash, numSites = log.module, len(log)
+    log.close()
 
     if outfile != None:
         outfile.write("\n")
         outfile.close()
-
-#parseBinaryLogFile("work.c.LLVM.bin", "OUT.c.LLVM.txt")
-#parseBinaryLogFile("/home/aperson40/research/compilerSDC/HPCCG-1.0/ddot.cpp.LLVM.bin", "DD.c.LLVM.txt")
-
+    return moduleHash, numSites
@@ -0,0 +1,247 @@
+#!/usr/bin/python
+#####################################################################
+#
+# This file is licensed under the University of Illinois/NCSA Open
+# Source License. See LICENSE.TXT for details.
+#
+#####################################################################
+
+#####################################################################
+#
+# Name: campaign.py
+#
+# Description: Runs a fault injection campaign on the local cores.
+#       Each trial runs the application with its own trial number and
+#       binary event log under per-trial CPU and wall-clock limits,
+#       is classified as benign, sdc, detected, failed, signal, or
+#       timeout, and is written to the analysis database (trials,
+#       injections, signals, detections, propagations, and outcomes
+#       tables) as soon as it finishes. The run output of trial # is
+#       kept in <output dir>/<trial_prefix>_# as readTrials() expects.
+#
+#       The application arguments may use {trial}, {events}, and
+#       {output}; if {trial} or {events} is not used, "--trial {trial}"
+#       and "--eventLog {events}" are appended for FLIPIT_Init.
+#
+#       e.g. campaign.py -n 1000 --timeout 60 -- ./app -nF 1 -f 0
+#            campaign.py --plan plan.txt --compare "./cmp.sh {output}" -- ./app
+#
+#####################################################################
+
+from __future__ import print_function
+import os, sys, time, signal, shlex, sqlite3, argparse, subprocess, multiprocessing
+from analysis_config import *
+from database import createTables, createIndexes, readLLVM, readInjection, readPropagation
+from eventParser import *
+
+# outcomes of the comparator command, by its exit code
+COMPARE_OUTCOMES = {0: "benign", 1: "sdc", 2: "detected"}
+
+def parseArgs():
+    parser = argparse.ArgumentParser(usage="campaign.py [options] -- binary [args ...]")
+    parser.add_argument("-n", "--numTrials", type=int, default=int(numTrials),
+                        help="number of trials to run (default numTrials)")
+    parser.add_argument("--first", type=int, default=0, help="number of the first trial")
+    parser.add_argument("--plan", help="file with one trial per line: trial [extra args ...]")
+    parser.add_argument("-j", "--jobs", type=int, default=multiprocessing.cpu_count(),
+                        help="trials to run at once (default all cores)")
+    parser.add_argument("--timeout", type=float, default=0,
+                        help="wall-clock seconds per trial, 0 for no limit")
+    parser.add_argument("--cpu", type=int, default=0,
+                        help="CPU seconds per trial, 0 for no limit")
+    parser.add_argument("--compare",
+                        help="command judging the output of a trial; exits 0 benign, 1 sdc, 2 detected. "
+                             "It runs under --timeout too")
+    parser.add_argument("--llvm", default=LLVM_log_path,
+                        help="path to the LLVM log files (default LLVM_log_path)")
+    parser.add_argument("-o", "--output", default=trial_path,
+                        help="directory for the run output files (default trial_path)")
+    parser.add_argument("--db", default=database, help="database to add the trials to")
+    parser.add_argument("command", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+    if len(args.command) > 0 and args.command[0] == "--":
+        args.command = args.command[1:]
+    if len(args.command) == 0:
+        parser.print_usage()
+        sys.exit(1)
+    return args
+
+def readPlan(args):
+    """Returns the (trial, extra arguments) pairs to run."""
+    if args.plan == None:
+        return [(t, []) for t in range(args.first, args.first + args.numTrials)]
+    plan = []
+    for l in open(args.plan).readlines():
+        split = shlex.split(l, comments=True)
+        if len(split) > 0:
+            plan.append((int(split[0]), split[1:]))
+    return plan
+
+def trialCommand(args, trial, extra):
+    """Expands the argument template of the application for a trial."""
+    output = os.path.join(args.output, trial_prefix + "_" + str(trial))
+    events = os.path.join(args.output, "events_" + str(trial))
+    fields = {"trial": trial, "events": events, "output": output}
+    command = [a.format(**fields) for a in args.command]
+    template = " ".join(args.command)
+    if "{trial}" not in template:
+        command += ["--trial", str(trial)]
+    if "{events}" not in template:
+        command += ["--eventLog", events]
+    return command + extra, output, events
+
+def limitTrial(cpu):
+    """Runs in the child before exec: own process group so a timeout kills
+    the whole trial, and the CPU limit raises SIGXCPU."""
+    os.setsid()
+    if cpu > 0:
+        import resource
+        resource.setrlimit(resource.RLIMIT_CPU, (cpu, cpu + 1))
+
+def initDatabase(args):
+    exists = os.path.isfile(args.db)
+    conn = sqlite3.connect(args.db)
+    c = conn.cursor()
+    if not exists:
+        createTables(c)
+        createIndexes(c)
+        if os.path.isdir(args.llvm):
+            readLLVM(c, args.llvm)
+    c.execute("CREATE TABLE IF NOT EXISTS outcomes (trial int, outcome text, exitCode int, signal int, wall double, cpu double)")
+    conn.commit()
+    return conn, c
+
+def startCompare(args, trial, output):
+    """Starts the comparator of a trial in its own process group, so that
+    it can be killed at its limit like a trial."""
+    command = args.compare.format(trial=trial, output=output)
+    if "{output}" not in args.compare:
+        command += " " + output
+    return subprocess.Popen(command, shell=True, preexec_fn=os.setsid)
+
+def compareOutcome(status, timedOut):
+    """Returns the outcome of a trial from the status of its comparator."""
+    if timedOut:
+        return "timeout"
+    if os.WIFSIGNALED(status):
+        return "failed"
+    return COMPARE_OUTCOMES.get(os.WEXITSTATUS(status), "failed")
+
+def classify(args, status, timedOut, cpu):
+    """Returns (outcome, exit code, signal number) of a finished trial. A
+    trial that exits normally is "benign" until its comparator says else."""
+    if os.WIFSIGNALED(status):
+        sig = os.WTERMSIG(status)
+        if timedOut: # killed here, not by the application
+            return "timeout", -1, 0
+        # SIGXCPU at the soft CPU limit, SIGKILL at the hard one
+        if sig == signal.SIGXCPU or (sig == signal.SIGKILL and args.cpu > 0 and cpu >= args.cpu):
+            return "timeout", -1, sig
+        return "signal", -1, sig
+    code = os.WEXITSTATUS(status)
+    if code != 0:
+        return "failed", code, 0
+    return "benign", code, 0
+
+def recordTrial(c, trial, output, events, outcome, code, sig, wall, cpu):
+    """Streams a finished trial into the database in the layout readTrials() uses."""
+    c.execute("SELECT COUNT(*) FROM sites")
+    haveSites = c.fetchone()[0] > 0
+    numInj = 0
+    detected = outcome == "detected"
+    for e in readEventLogs(events):
+        if e["kind"] == EVENT_KIND.DETECTION:
+            detected = True
+            c.execute("INSERT INTO detections VALUES (?,?,?)", (trial, detectionLatency(e), e["detector"]))
+        if e["kind"] == EVENT_KIND.MESSAGE:
+            readPropagation(c, trial, e)
+        if e["kind"] != EVENT_KIND.INJECTION:
+            continue
+        numInj += 1
+        arithFP = e["type"] in (EVENT_TYPE.FLOAT32, EVENT_TYPE.FLOAT64)
+        if haveSites:
+            readInjection(c, trial, e["site"], e["rank"], e["prob"], e["bit"], e["dynInsts"], arithFP)
+        else:
+            c.execute("INSERT INTO injections VALUES (?,?,?,?,?,?,?)",
+                      (trial, e["site"], e["rank"], e["prob"], e["bit"], e["dynInsts"], 'NULL'))
+
+    crashed = outcome in ("signal", "timeout")
+    c.execute("SELECT COUNT(*) FROM detections WHERE trial = ?", (trial,))
+    logged = c.fetchone()[0] > 0
+    if not detected and os.path.exists(output):
+        detected = detectMessage in open(output).read()
+    if detected and not logged:
+        c.execute("INSERT INTO detections VALUES (?,?,?)", (trial, -1, "---"))
+    if sig != 0:
+        c.execute("INSERT INTO signals VALUES (?,?)", (trial, sig))
+    c.execute("INSERT INTO trials VALUES (?,?,?,?,?,?)",
+              (trial, numInj, crashed, detected, output, sig != 0))
+    c.execute("INSERT INTO outcomes VALUES (?,?,?,?,?,?)", (trial, outcome, code, sig, wall, cpu))
+
+def runCampaign(args, plan, conn, c):
+    # pid -> [trial, output, events, start, deadline, timedOut, process, finished]; comparators
+    # run in the same table, with finished the (exit code, wall, cpu) of their trial, else None
+    running = {}
+    pending = list(reversed(plan))
+    counts = {}
+    while len(pending) > 0 or len(running) > 0:
+        while len(pending) > 0 and len(running) < args.jobs:
+            trial, extra = pending.pop()
+            command, output, events = trialCommand(args, trial, extra)
+            out = open(output, "w")
+            p = subprocess.Popen(command, stdout=out, stderr=subprocess.STDOUT,
+                                 preexec_fn=lambda: limitTrial(args.cpu))
+            out.close()
+            start = time.time()
+            deadline = start + args.timeout if args.timeout > 0 else None
+            running[p.pid] = [trial, output, events, start, deadline, False, p, None]
+
+        pid, status, usage = os.wait4(-1, os.WNOHANG)
+        if pid == 0:
+            now = time.time()
+            for pid in running:
+                r = running[pid]
+                if r[4] != None and now > r[4] and not r[5]:
+                    r[5] = True
+                    try:
+                        os.killpg(pid, signal.SIGKILL)
+                    except OSError:
+                        pass
+            time.sleep(0.01)
+            continue
+        if pid not in running:
+            continue
+
+        trial, output, events, start, deadline, timedOut, p, finished = running.pop(pid)
+        p.returncode = status # reaped here, keep subprocess from waiting on it
+        if finished != None:
+            code, wall, cpu = finished
+            outcome, sig = compareOutcome(status, timedOut), 0
+        else:
+            wall = time.time() - start
+            cpu = usage.ru_utime + usage.ru_stime
+            outcome, code, sig = classify(args, status, timedOut, cpu)
+            if outcome == "benign" and args.compare != None:
+                # judged by the comparator; the trial is recorded when it exits
+                p = startCompare(args, trial, output)
+                now = time.time()
+                deadline = now + args.timeout if args.timeout > 0 else None
+                running[p.pid] = [trial, output, events, now, deadline, False, p, (code, wall, cpu)]
+                continue
+        recordTrial(c, trial, output, events, outcome, code, sig, wall, cpu)
+        conn.commit()
+        counts[outcome] = counts.get(outcome, 0) + 1
+        print ("\ttrial", trial, outcome, "%.2fs" % wall)
+    return counts
+
+if __name__ == "__main__":
+    args = parseArgs()
+    plan = readPlan(args)
+    if not os.path.isdir(args.output):
+        os.makedirs(args.output)
+    conn, c = initDatabase(args)
+    print ("Running", len(plan), "trials on", args.jobs, "cores:")
+    counts = runCampaign(args, plan, conn, c)
+    for outcome in sorted(counts):
+        print (outcome + ":", counts[outcome])
+    conn.close()
@@ -1,6 +1,8 @@
-import sqlite3, os, sys
+from __future__ import print_function
+import sqlite3, os, sys, subprocess
 from analysis_config import *
 from binaryParser import *
+from eventParser import *
 
 
 
@@ -42,11 +44,16 @@ def init(db, LLVMPath, trialPath, customFuncs = None):
         createTables(c)
         if customFuncs[0] != None:
             customFuncs[0](c)
-        readLLVM(c, LLVMPath)
-        if customFuncs != None and len(customFuncs) == 2:
-            readTrials(c, trialPath, customFuncs[1])
+        customParser = customFuncs[1] if len(customFuncs) == 2 else None
+        if useNativeIngest():
+            conn.commit()
+            nativeIngest(db, LLVMPath, trialPath)
+            if customParser != None:
+                readCustom(c, trialPath, customParser)
         else:
-            readTrials(c, trialPath)
+            createIndexes(c)
+            readLLVM(c, LLVMPath)
+            readTrials(c, trialPath, customParser)
     
         c.execute("SELECT name FROM sqlite_master WHERE type='table';")
     conn.commit()
@@ -64,8 +71,65 @@ def createTables(c):
     c.execute("CREATE TABLE injections (trial int, site int, rank int, prob double, bit int, cycle int, notes text)")
     c.execute("CREATE TABLE signals (trial int, num int)")
     c.execute("CREATE TABLE detections (trial int, latency int, detector text)")
+    c.execute("CREATE TABLE propagations (trial int, message int, source int, dest int, latency int)")
     #c.execute("CREATE TABLE ()")
 
+def createIndexes(c):
+    """Indexes the columns the sites are looked up by and the tables are
+    joined on. flipit-ingest creates the same indexes after loading.
+    """
+    c.execute("CREATE INDEX IF NOT EXISTS sites_site ON sites (site)")
+    c.execute("CREATE INDEX IF NOT EXISTS sites_function ON sites (function)")
+    c.execute("CREATE INDEX IF NOT EXISTS trials_trial ON trials (trial)")
+    c.execute("CREATE INDEX IF NOT EXISTS injections_site ON injections (site)")
+    c.execute("CREATE INDEX IF NOT EXISTS injections_trial ON injections (trial)")
+    c.execute("CREATE INDEX IF NOT EXISTS signals_trial ON signals (trial)")
+    c.execute("CREATE INDEX IF NOT EXISTS detections_trial ON detections (trial)")
+    c.execute("CREATE INDEX IF NOT EXISTS propagations_trial ON propagations (trial)")
+
+def useNativeIngest():
+    return native_ingest != None and LLVM_log_type == "Binary" and os.path.isfile(native_ingest)
+
+def nativeIngest(db, LLVMPath, filePrefix):
+    """Loads the sites and trials with flipit-ingest, which reads the logs
+    and trial outputs on all cores and inserts the same rows as readLLVM()
+    and readTrials() in one transaction.
+    """
+    print ("\n\nLoading LLVM log files and trials with", native_ingest)
+    cmd = [native_ingest, "-d", db, "-l", LLVMPath, "-t", filePrefix, "-n", str(int(numTrials)),
+           "--detect", detectMessage, "--assert", assertMessage, "--bus", busError, "--seg", segError]
+    if event_log_prefix != None:
+        cmd += ["-e", os.path.join(os.path.dirname(filePrefix), event_log_prefix)]
+    if subprocess.call(cmd) != 0:
+        print ("flipit-ingest failed")
+        sys.exit(1)
+
+def readCustom(c, filePrefix, customParser):
+    """Passes the lines of the trial outputs to the user's parser, as
+    readTrials() does, after flipit-ingest loaded the trials.
+    """
+    for trial in range(0, int(numTrials)):
+        path = filePrefix + "_" + str(trial)
+        if not os.path.exists(path):
+            path += ".txt"
+            if not os.path.exists(path):
+                continue
+        inBanner = False
+        inCustom = False
+        for l in open(path):
+            if siteMessage in l:
+                inBanner = True
+                inCustom = False
+                continue
+            if inBanner and siteEndMessage not in l:
+                # the runtime's lines, then the custom logger's after its marker
+                if inCustom and l != "\n":
+                    customParser(c, l, trial)
+                inCustom = inCustom or l.rstrip("\n") == customMessage
+                continue
+            inBanner = False
+            customParser(c, l, trial)
+
 
 def readLLVM(c, LLVMPath):
     """Searches through the directory structure and collect
@@ -78,18 +142,32 @@ def readLLVM(c, LLVMPath):
     LLVMPath : str
         Path to where the LLVM log files (*.LLVM.bin) generated by FlipIt exist.
     """
-    print "\n\nReading LLVM log files:"
+    print ("\n\nReading LLVM log files:")
     end = "LLVM.bin"
     if LLVM_log_type == "ASCII":
         end = "LLVM.txt"
+    logs = []
     for path, subdirs, files in os.walk(LLVMPath):
         for name in files:
             if str(name).endswith(end):
-                print "\t", name
                 if LLVM_log_type == "Binary":
-                    parseBinaryLogFile(c, os.path.join(path, name))
+                    logs.append(os.path.join(path, name))
                 else:
+                    print ("\t", name)
                     parseInjLog(c, path, name)
+
+    # The runtime numbers the sites of the linked modules in order of
+    # their module hash, so give each module the same base here.
+    modules = []
+    for log in logs:
+        moduleHash, numSites = parseBinaryLogFile(None, log)
+        modules.append((moduleHash if moduleHash != None else -1, log, numSites))
+    base = 0
+    for moduleHash, log, numSites in sorted(modules):
+        print ("\t", os.path.basename(log))
+        parseBinaryLogFile(c, log, base=base)
+        if moduleHash != -1:
+            base += numSites
     
 
 def parseInjLog(c, path,  file):
@@ -122,14 +200,21 @@ def parseInjLog(c, path,  file):
             line = split[-1]
             srcLine = 0
         
-            # compiled with -g and we know the src line number
+            # compiled with -g and we know the src line number (file:line[:column])
             if ":" in line:
                 split = line.split(":")
-                srcLine = int(split[-1])
+                srcLine = int(split[1])
                 file = split[0]
             c.execute("INSERT INTO sites VALUES (?,?,?,?,?,?,?)", (site, type, comment, file, funcName, srcLine, "Unknown"))
 
 
+def readPropagation(c, trial, e):
+    """Records the first corrupted message a rank sent, from an event
+    log of a run with --msgLog.
+    """
+    c.execute("INSERT INTO propagations VALUES (?,?,?,?,?)",
+              (trial, e["site"], e["rank"], int(e["prob"]), detectionLatency(e)))
+
 def readTrials(c, filePrefix, customParser = None):
     """Parses an output file of a fault injection trial for injections,
     detections, and system level events such as raised signals. 
@@ -145,7 +230,7 @@ def readTrials(c, filePrefix, customParser = None):
         function the user defines to allow for custom parsing of
         run output file
     """
-    print "\n\nReading trials with file prefix:  ", filePrefix
+    print ("\n\nReading trials with file prefix:  ", filePrefix)
     for trial in range(0, int(numTrials)):
 
         # determine if trial exists
@@ -155,19 +240,38 @@ def readTrials(c, filePrefix, customParser = None):
             path += ".txt"
             if not os.path.exists(path):
                 continue
-        print "\t", path
+        print ("\t", path)
         
         # grab information about the injection(s)
         t = open(path).readlines()
         llvmInj = injCount = crashed = detected = signal = arithFP = 0
        
         c.execute("INSERT INTO trials(trial,path) VALUES (?,?)", (trial, path))
+
+        # injections from the binary event logs take the place of the banners
+        events = False
+        if event_log_prefix != None:
+            logPrefix = os.path.join(os.path.dirname(filePrefix), event_log_prefix + "_" + str(trial))
+            for e in readEventLogs(logPrefix):
+                if e["kind"] == EVENT_KIND.DETECTION:
+                    detected = True
+                    c.execute("INSERT INTO detections VALUES (?,?,?)", (trial, detectionLatency(e), e["detector"]))
+                if e["kind"] == EVENT_KIND.MESSAGE:
+                    readPropagation(c, trial, e)
+                if e["kind"] != EVENT_KIND.INJECTION:
+                    continue
+                events = True
+                injCount += 1
+                arithFP = e["type"] in (EVENT_TYPE.FLOAT32, EVENT_TYPE.FLOAT64)
+                readInjection(c, trial, e["site"], e["rank"], e["prob"], e["bit"], e["dynInsts"], arithFP)
+
         # look at certain lines in output
         i = 0
         while i < len(t):
             l = t[i]
             if siteMessage in l:
-                injCount += 1
+                if not events:
+                    injCount += 1
                 inj = []
                 i += 1
                 l = t[i]
@@ -178,31 +282,22 @@ def readTrials(c, filePrefix, customParser = None):
                     l = t[i]
  
                 # grab info stored in  'inj'
-                arithFP = 0
-                if "IEEE" in " ".join(inj[0]):
-                    arithFP = 1
-                rank = int(inj[1][-1])
-                bit = int(inj[3][-1])
-                site = int(inj[4][-1])
-                prob = float(inj[5][-1])
-                c.execute("SELECT * FROM sites WHERE site=?", (site,))
-                result = c.fetchone()
-                if result == None:
-                    print "Unable to locate site #", site, " in database"
-                    sys.exit(1)
-                ty = result[1]
-                if "Arith" in ty:
-                    if arithFP == 1:
-                        ty = "Arith-FP"
-                    else:
-                        ty = "Arith-Fix"
-                    c.execute("UPDATE sites SET type = ? WHERE site=?", (ty,site))
-                llvmInj = int(inj[7][-1])
-                dynCycle = llvmInj
-                c.execute("INSERT INTO injections VALUES (?,?,?,?,?,?,?)", (trial, site, rank, prob, bit, dynCycle, 'NULL'))
-               
-                for j in range(8, len(inj)): 
-                    customParser(c, " ".join(inj[j]), trial)
+                if not events:
+                    arithFP = 0
+                    if "IEEE" in " ".join(inj[0]):
+                        arithFP = 1
+                    rank = int(inj[1][-1])
+                    bit = int(inj[3][-1])
+                    site = int(inj[4][-1])
+                    prob = float(inj[5][-1])
+                    llvmInj = int(inj[7][-1])
+                    readInjection(c, trial, site, rank, prob, bit, llvmInj, arithFP)
+
+                # the lines of the custom logger follow its marker
+                custom = [" ".join(w) for w in inj]
+                if customParser != None and customMessage + "\n" in custom:
+                    for l in custom[custom.index(customMessage + "\n") + 1:]:
+                        customParser(c, l, trial)
 
 
             if detectMessage in l:
@@ -235,9 +330,27 @@ def readTrials(c, filePrefix, customParser = None):
         c.execute("UPDATE trials SET detection=? WHERE trials.trial=?", (detected, trial))
         c.execute("UPDATE trials SET signal=? WHERE trials.trial=?", (signal, trial))
 
+def readInjection(c, trial, site, rank, prob, bit, dynCycle, arithFP):
+    """Adds an injection to the database and refines the type of an
+    arithmetic site to fixed or floating point.
+    """
+    c.execute("SELECT * FROM sites WHERE site=?", (site,))
+    result = c.fetchone()
+    if result == None:
+        print ("Unable to locate site #", site, " in database")
+        sys.exit(1)
+    ty = result[1]
+    if "Arith" in ty:
+        if arithFP:
+            ty = "Arith-FP"
+        else:
+            ty = "Arith-Fix"
+        c.execute("UPDATE sites SET type = ? WHERE site=?", (ty,site))
+    c.execute("INSERT INTO injections VALUES (?,?,?,?,?,?,?)", (trial, site, rank, prob, bit, dynCycle, 'NULL'))
+
 def finalize():
     """Cleans up fault injection visualization
     """
-    print "Finalizing fault injection visualization..."
+    print ("Finalizing fault injection visualization...")
     #conn.commit()
     #conn.close()
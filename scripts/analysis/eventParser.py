@@ -0,0 +1,92 @@
+import struct, glob, sys
+
+"""Binary injection event log written by the FlipIt runtime when run with
+    --eventLog <prefix>: one file <prefix>_<rank> per rank holding a 16 byte
+    header followed by fixed size records.
+"""
+EVENT_MAGIC = b"FIEV"
+EVENT_VERSION = 1
+EVENT_HEADER = "<4sIII" # magic, version, rank, record size
+EVENT_RECORD = "<QQQddIIIHBBQ"
+# aux is (lane << 32) | lanes for injections into vector sites; detections
+# hold the latency in dynamic instructions in aux, cycles in prob, ns in p,
+# and the detector number in bit; messages hold the message number in site,
+# the destination rank in prob (-1 for all ranks), and the latency as
+# detections do; injections into memory at rest hold --memRate or --memInsts
+# in prob, the offset into the registered bytes (0 to 1) in p, and the bit of
+# the aligned 64 bit word in bit
+EVENT_FIELDS = ("site", "dynInsts", "time", "prob", "p", "rank", "thread",
+                "injection", "bit", "kind", "type", "aux")
+
+class EVENT_KIND:
+    INJECTION = 0
+    DETECTION = 1
+    DETECTOR = 2 # the first 40 bytes of the record hold the detector's name
+    MESSAGE = 3 # the first corrupted message a rank sent (--msgLog)
+
+UNKNOWN_LATENCY = 2**64 - 1
+
+class EVENT_TYPE:
+    INT = 0
+    FLOAT32 = 1
+    FLOAT64 = 2
+    PTR = 3
+    MEMORY = 4 # a bit of a registered region (--memRate, --memInsts)
+
+def readEventLog(path):
+    """Reads the records of one event log file.
+    Parameters
+    ----------
+    path : str
+        path to the event log file of a rank
+
+    Return
+    ---------
+    list of dictionaries keyed by EVENT_FIELDS
+    """
+    f = open(path, "rb")
+    data = f.read()
+    f.close()
+
+    headerSize = struct.calcsize(EVENT_HEADER)
+    magic, version, rank, recordSize = struct.unpack(EVENT_HEADER, data[:headerSize])
+    if magic != EVENT_MAGIC or version != EVENT_VERSION:
+        print ("Not a FlipIt event log:", path)
+        sys.exit(1)
+
+    # a crashed run may leave a partial record at the end
+    events = []
+    fmtSize = struct.calcsize(EVENT_RECORD)
+    for pos in range(headerSize, len(data) - recordSize + 1, recordSize):
+        values = struct.unpack(EVENT_RECORD, data[pos:pos + fmtSize])
+        e = dict(zip(EVENT_FIELDS, values))
+        if e["kind"] == EVENT_KIND.DETECTOR:
+            e["name"] = data[pos:pos + 40].split(b"\0")[0].decode("utf-8", "replace")
+        events.append(e)
+    return events
+
+def readEventLogs(prefix):
+    """Reads and merges the event logs of all ranks, <prefix>_<rank>, in
+    the order the events happened.
+    """
+    events = []
+    for path in glob.glob(prefix + "_*"):
+        if path[len(prefix) + 1:].isdigit():
+            events += readEventLog(path)
+    events.sort(key=lambda e: e["time"])
+
+    # name the detector of each detection; name records have no time stamp
+    names = {}
+    for e in events:
+        if e["kind"] == EVENT_KIND.DETECTOR:
+            names[(e["rank"], e["bit"])] = e["name"]
+    for e in events:
+        if e["kind"] == EVENT_KIND.DETECTION:
+            e["detector"] = names.get((e["rank"], e["bit"]), "---")
+    return events
+
+def detectionLatency(e):
+    """Latency of a detection event in dynamic instructions, -1 if unknown."""
+    if e["aux"] == UNKNOWN_LATENCY:
+        return -1
+    return e["aux"]
@@ -1,7 +1,8 @@
 from matplotlib import pyplot as plot
 from database import init, finalize
 from visualize import initVis, visClassifications, visFunctions, visCrashes,\
-    visSignals, visDetections, visDetectedInjections, visDetectionLatency
+    visSignals, visDetections, visDetectedInjections, visDetectionLatency,\
+    visPropagationLatency
 from custom import customInit, customParser
 #import analysis_config 
 from analysis_config import *
@@ -27,6 +28,7 @@ def visualize (c, more_detail_funcs = None):
     visDetections(c, more_detail_funcs)
     visDetectedInjections(c)
     visDetectionLatency(c)
+    visPropagationLatency(c)
     plot.show()
     
     # add custom plotting function below
@@ -545,8 +545,9 @@ def visDetectionLatency(c):
     
     Notes
     ----------
-    Assumes the user modifed the latency value in the detections table. It can
-    be calucated by the
+    The latency is filled in from the event logs of detectors that call
+    'FLIPIT_Detected(detector)'; otherwise the user has to modify the latency
+    value in the detections table. It can be calucated by the
     'LLVM_dynamic_inst_of_detection - LLVM_dynamic_inst_of_injection'.
     The later can be obtained from the injection table for the trial, and the
     former can be obtained at detection time though the FlipIt API call
@@ -565,3 +566,32 @@ def visDetectionLatency(c):
     bins = np.arange(0,11)
     histo(values, bins, xlabel, ylabel, title, ticks)
 
+def visPropagationLatency(c):
+    """Visualizes how long corruption stays in the rank it was injected
+    in: a bar chart of the instructions executed after the injection
+    until the rank first sent a corrupted message.
+
+    Parameters
+    ----------
+    c : object
+        sqlite3 database handle that is open to a valid filled database
+
+    Notes
+    ----------
+    The propagations table is filled from the event logs of runs with
+    '--msgLog' that compare their messages with those of a golden run
+    made with '--writeMsgLog'. Ranks that received the corruption before
+    they sent it on have an unknown latency (-1).
+    """
+    c.execute("SELECT latency FROM propagations")
+
+    buckets = [-1, 0, 1, 2, 3, 4, 5, 10, 1e2, 1e3, 1e9, 1e13]
+    data = [ i[0] for i in c.fetchall()]
+    values, bins = np.histogram(data, buckets, normed=False)
+    xlabel = "# of instrumented LLVM instructions till a corrupted message"
+    ylabel = "Frequency"
+    title = "Propagation Latency"
+    ticks = ["-1", "0", "1", "2", "3", "4", "5->", "10->", "1e2->", "1e3->", "1e9->"]
+    bins = np.arange(0,11)
+    histo(values, bins, xlabel, ylabel, title, ticks)
+
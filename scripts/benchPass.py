@@ -0,0 +1,142 @@
+#!/usr/bin/python
+#####################################################################
+#
+# This file is licensed under the University of Illinois/NCSA Open
+# Source License. See LICENSE.TXT for details.
+#
+#####################################################################
+
+#####################################################################
+#
+# Name: benchPass.py
+#
+# Description: Compile-time benchmark of the FlipIt pass. Generates
+#       synthetic modules of 10^4 to 2*10^5 instructions (functions of
+#       long blocks of integer and floating point arithmetic, loops,
+#       and calls), instruments each with opt, and reports the time
+#       and peak memory of opt with and without the pass.
+#
+#       Every instruction is a site, and a guarded site adds about nine
+#       instructions and two blocks, so opt needs about 3 KiB more per
+#       instruction with the pass (3 GiB for 10^6 instructions on
+#       LLVM 14). Pass larger sizes with -s on a machine that has the
+#       memory.
+#
+#       e.g. benchPass.py
+#            benchPass.py -s 100000 1000000 --pass ./libFlipItPass.so
+#
+#####################################################################
+
+from __future__ import print_function
+import os, sys, time, argparse, resource, subprocess, tempfile
+
+def parseArgs():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-s", "--sizes", type=int, nargs="+",
+                        default=[10000, 100000, 200000],
+                        help="instructions per module (default 10^4 10^5 2*10^5)")
+    parser.add_argument("--block", type=int, default=1000,
+                        help="instructions per basic block (default 1000)")
+    parser.add_argument("--function", type=int, default=10000,
+                        help="instructions per function (default 10000)")
+    parser.add_argument("--pass", dest="passLib",
+                        default=os.path.join(os.environ.get("FLIPIT_PATH", "."), "lib", "libFlipItPass.so"),
+                        help="the pass library (default $FLIPIT_PATH/lib/libFlipItPass.so)")
+    parser.add_argument("--opt", default=os.path.join(os.environ.get("LLVM_BUILD_PATH", "/usr"), "bin", "opt"),
+                        help="opt to run (default $LLVM_BUILD_PATH/bin/opt)")
+    parser.add_argument("--dir", default=None, help="where to write the modules (default a temporary directory)")
+    return parser.parse_args()
+
+def writeModule(path, size, blockSize, functionSize):
+    """Writes a module of about size instructions. Every block is a
+    chain of integer and floating point arithmetic ending in a loop
+    back edge, so the pass sees PHI nodes, compares, and calls too.
+    Only syntax shared by all supported LLVM versions is used."""
+    f = open(path, "w")
+    f.write("declare double @sqrt(double)\n\n")
+    numFunctions = max(1, size // functionSize)
+    blocks = max(1, functionSize // blockSize)
+    for fn in range(numFunctions):
+        f.write("define double @f%d(i32 %%n, double %%x) {\nentry:\n  br label %%b0\n" % fn)
+        for b in range(blocks):
+            prev = "entry" if b == 0 else "b%d.exit" % (b - 1)
+            f.write("b%d:\n" % b)
+            f.write("  %%i%d = phi i32 [ 0, %%%s ], [ %%i%d.next, %%b%d ]\n" % (b, prev, b, b))
+            f.write("  %%d%d = phi double [ %%x, %%%s ], [ %%v%d.%d, %%b%d ]\n"
+                    % (b, prev, b, (blockSize - 6) // 2 - 1, b))
+            ival = "%%i%d" % b
+            dval = "%%d%d" % b
+            for k in range((blockSize - 6) // 2):
+                f.write("  %%u%d.%d = add i32 %s, %d\n" % (b, k, ival, k + 1))
+                f.write("  %%v%d.%d = fmul double %s, 1.000001e+00\n" % (b, k, dval))
+                ival = "%%u%d.%d" % (b, k)
+                dval = "%%v%d.%d" % (b, k)
+            f.write("  %%s%d = call double @sqrt(double %s)\n" % (b, dval))
+            f.write("  %%i%d.next = add i32 %%i%d, 1\n" % (b, b))
+            f.write("  %%c%d = icmp slt i32 %%i%d.next, %%n\n" % (b, b))
+            f.write("  br i1 %%c%d, label %%b%d, label %%b%d.exit\n" % (b, b, b))
+            f.write("b%d.exit:\n" % b)
+            if b + 1 < blocks:
+                f.write("  br label %%b%d\n" % (b + 1))
+            else:
+                f.write("  ret double %%s%d\n" % b)
+        f.write("}\n\n")
+    f.close()
+    return numFunctions * blocks * (blockSize // 2 * 2)
+
+def llvmMajor(opt):
+    out = subprocess.Popen([opt, "--version"], stdout=subprocess.PIPE).communicate()[0].decode()
+    for word in out.split():
+        if word[0].isdigit() and "." in word:
+            return int(word.split(".")[0])
+    return 3
+
+def runOpt(command):
+    """Runs command; returns (seconds, peak resident MiB) of the child."""
+    start = time.time()
+    pid = os.fork()
+    if pid == 0:
+        devnull = os.open(os.devnull, os.O_WRONLY)
+        os.dup2(devnull, 1)
+        os.execvp(command[0], command)
+    pid, status, usage = os.wait4(pid, 0)
+    if status != 0:
+        print ("Failed:", " ".join(command))
+        sys.exit(1)
+    # ru_maxrss is in KiB on Linux
+    return time.time() - start, usage.ru_maxrss / 1024.
+
+if __name__ == "__main__":
+    args = parseArgs()
+    directory = args.dir if args.dir != None else tempfile.mkdtemp(prefix="flipit_bench")
+    major = llvmMajor(args.opt)
+    # opt only searches the library path for names without a '/'
+    args.passLib = os.path.abspath(args.passLib)
+    instrument = [args.opt, "-load", args.passLib]
+    if major >= 9:
+        # the new pass manager plugin (opt 13 and later default to it)
+        instrument += ["-load-pass-plugin", args.passLib, "-passes=FlipIt"]
+    else:
+        instrument += ["-FlipIt"]
+    config = os.path.join(directory, "FlipIt.config")
+    open(config, "w").close()
+    instrument += ["-config", config, "-prob", "1e-8", "-guard", "1"]
+
+    print ("%12s %10s %10s %10s %10s %12s %12s" % ("insts", "parse (s)", "pass (s)", "MiB", "MiB pass",
+           "us/inst", "KiB/inst"))
+    for size in args.sizes:
+        module = os.path.join(directory, "bench%d.ll" % size)
+        insts = writeModule(module, size, args.block, args.function)
+        out = os.path.join(directory, "bench%d.bc" % size)
+        baseTime, baseMem = runOpt([args.opt, module, "-o", out])
+        passTime, passMem = runOpt(instrument + ["-srcFile", module, module, "-o", out])
+        print ("%12d %10.2f %10.2f %10.0f %10.0f %12.3f %12.3f" % (insts, baseTime, passTime - baseTime,
+               baseMem, passMem, 1e6 * (passTime - baseTime) / insts,
+               1024. * (passMem - baseMem) / insts))
+        os.remove(out)
+        os.remove(module)
+        if os.path.isfile(module + ".LLVM.bin"):
+            os.remove(module + ".LLVM.bin")
+    if args.dir == None:
+        os.remove(config)
+        os.rmdir(directory)
@@ -30,8 +30,13 @@ BUILD_TYPE = "Debug+Asserts"
 #    ptr - add code to inject into pointers (0 or 1)
 #    arith - add code to inject into mathematics (0 or 1)
 #    ctrl - add code to inject into control (0 or 1)
-#    stateFile - unique counter for fault site index;
-#                should differ based on application
+#    stateFile - no longer used; fault sites are numbered per module
+#                and made unique when the program is loaded
+#    guard - only call into the runtime when it is armed (0 or 1)
+#    countInsts - count unarmed sites inline so that
+#                 FLIPIT_GetExecutedInstructionCount() is exact (0 or 1);
+#                 without it the count stops when the runtime disarms and
+#                 detection latencies after the last injection are unknown
 #
 #####################################################
 config = "FlipIt.config"
@@ -43,6 +48,8 @@ ptr = 1
 arith = 1
 ctrl = 1
 stateFile = "FlipItState"
+guard = 1
+countInsts = 0
 
 ############# Library Parameters #####################
 #
@@ -69,3 +76,45 @@ verbose = True
 
 ############ Generate a histogram of fault site traversals #########
 histogram = False
+
+############ Job-wide injections over MPI ###########################
+#
+#    mpi - link libcorrupt_mpi.a, whose injection budget and target
+#          (--global, --globalInsts, --globalCounts, --globalTarget)
+#          are shared by all ranks of the job; takes precedence over
+#          histogram
+#
+#####################################################################
+mpi = False
+
+############ Cache of instrumented objects ##########################
+#
+#    cache - reuse an instrumented object (and its .LLVM.bin log) when
+#            the bitcode, pass options, FlipIt.config, and pass build
+#            are unchanged
+#    cacheDir - where the objects are kept; remove it (or run
+#               resetFaultIndex.sh) to start from an empty cache
+#
+#####################################################################
+cache = True
+cacheDir = os.path.join(os.path.expanduser("~"), ".FlipItCache")
+
+############ Single clang invocation per file #######################
+#
+#    plugin - run the pass inside clang (-fpass-plugin) instead of
+#             the clang, llvm-link, opt, and clang steps; needs a
+#             libFlipItPass.so built against LLVM 9 or later and does
+#             not use the cache
+#
+#####################################################################
+plugin = False
+
+############ Whole program instrumentation ##########################
+#
+#    lto - compile files to bitcode objects and instrument the linked
+#          program as one module: one <executable>.LLVM.bin for the
+#          executable, and the runtime is compiled with the program so
+#          its fast paths can be inlined
+#
+#####################################################################
+lto = False
@@ -58,7 +58,8 @@ flipitHeaders = {'Pass.h': "#include <llvm\/Pass.h>",\
         #'PrintModulePass.h': "#include <llvm\/Assembly\/PrintModulePass.h>",\
         'DebugInfo.h': "#include <llvm\/DebugInfo.h>",\
         'Instruction.h': "#include <llvm\/IR\/Instruction.h>",\
-        'TypeBuilder.h': "#include <llvm\/IR\/TypeBuilder.h>"}
+        'TypeBuilder.h': "#include <llvm\/IR\/TypeBuilder.h>",\
+        'MDBuilder.h': "#include <llvm\/IR\/MDBuilder.h>"}
 
 # replace header files in 'faults.h' with the correct headers for the version 
 #of LLVM at $LLVM_REPO_PATH
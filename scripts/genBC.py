@@ -57,3 +57,15 @@ outfile.close()
 
 os.system(LLVM_BUILD_PATH + "/bin/clang -emit-llvm -c -o " + FLIPIT_PATH + "/src/corrupt/corrupt.bc " + FLIPIT_PATH+"/src/corrupt/corrupt.ll")
 os.system("rm tmp.bc tmp.ll")
+
+# the whole runtime as optimized bitcode, linked into the program by the
+# lto mode of flipit-cc so the corrupt* fast paths can be inlined; the site
+# log reader is linked in as in libcorrupt.a
+os.system(LLVM_BUILD_PATH + "/bin/clang++ -emit-llvm -O2 -fPIC -fno-exceptions -fno-rtti -c -o siteLog.bc " \
+    + FLIPIT_PATH + "/src/sites/siteLog.cpp")
+for suffix, flags in [("", ""), ("_histo", " -DFLIPIT_HISTOGRAM")]:
+    os.system(LLVM_BUILD_PATH + "/bin/clang -emit-llvm -O2 -fPIC" + flags + " -c -o tmp.bc " \
+        + FLIPIT_PATH + "/src/corrupt/corrupt.c")
+    os.system(LLVM_BUILD_PATH + "/bin/llvm-link tmp.bc siteLog.bc -o " + FLIPIT_PATH \
+        + "/src/corrupt/corruptRuntime" + suffix + ".bc")
+os.system("rm tmp.bc siteLog.bc")
@@ -25,8 +25,13 @@ if [[ -e $FLIPIT_PATH/lib/libcorrupt.a ]]
 	rm $FLIPIT_PATH/lib/libcorrupt.a
 fi
 
+# Site log reader, used by the runtime (--siteLog) and by the analysis scripts.
+# It needs no C++ runtime, so C programs can link libcorrupt.a as before.
+g++ -O3 -fPIC -fno-exceptions -fno-rtti -c $FLIPIT_PATH/src/sites/siteLog.cpp
+g++ -shared -o libFlipItSites.so siteLog.o
+
 gcc -O3 -fPIC -c $FLIPIT_PATH/src/corrupt/corrupt.c
-ar -cvq libcorrupt.a corrupt.o
+ar -cvq libcorrupt.a corrupt.o siteLog.o
 if [[ -e corrupt.o ]]; then
 	rm corrupt.o
 fi
@@ -39,7 +44,20 @@ if [[ -e $FLIPIT_PATH/lib/libcorrupt_histo.a ]]
 fi
 
 gcc -O3 -fPIC -DFLIPIT_HISTOGRAM -c $FLIPIT_PATH/src/corrupt/corrupt.c -o corrupt_histogram.o
-ar -cvq libcorrupt_histo.a corrupt_histogram.o
+ar -cvq libcorrupt_histo.a corrupt_histogram.o siteLog.o
 if [[ -e corrupt_histogram.o ]]; then
 	rm corrupt_histogram.o
 fi
+
+# With job-wide injections over MPI (--global), if there is an MPI compiler
+if [[ -e $FLIPIT_PATH/lib/libcorrupt_mpi.a ]]
+ 	then
+	rm $FLIPIT_PATH/lib/libcorrupt_mpi.a
+fi
+
+if command -v mpicc > /dev/null; then
+	mpicc -O3 -fPIC -DFLIPIT_MPI -c $FLIPIT_PATH/src/corrupt/corrupt.c -o corrupt_mpi.o
+	ar -cvq libcorrupt_mpi.a corrupt_mpi.o siteLog.o
+	rm -f corrupt_mpi.o
+fi
+rm -f siteLog.o
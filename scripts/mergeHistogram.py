@@ -0,0 +1,85 @@
+#!/usr/bin/python
+#####################################################################
+#
+# This file is licensed under the University of Illinois/NCSA Open
+# Source License. See LICENSE.TXT for details.
+#
+#####################################################################
+
+#####################################################################
+#
+# Name: mergeHistogram.py
+#
+# Description: Sums the per-rank binary histograms of fault site
+#       traversals written by FLIPIT_Finalize(prefix) when linked
+#       against libcorrupt_histo.a. Reads prefix_0, prefix_1, ... and
+#       writes a single histogram in the same binary format, or as
+#       ASCII ("Location <site>: <count>") with -t.
+#
+#       e.g. mergeHistogram.py histo -o histo.bin
+#            mergeHistogram.py histo -t -o histo.txt
+#
+#####################################################################
+
+import sys
+import os
+import glob
+import struct
+import numpy as np
+
+MAGIC = b"FIHG"
+VERSION = 1
+HEADER = "<4sIIIQ" # magic, version, rank, reserved, numSites
+HEADER_SIZE = struct.calcsize(HEADER)
+
+def readHistogram(path):
+    """Returns the site counts stored in a binary histogram file."""
+    f = open(path, "rb")
+    magic, version, rank, reserved, numSites = struct.unpack(HEADER, f.read(HEADER_SIZE))
+    if magic != MAGIC or version != VERSION:
+        print ("Not a FlipIt histogram file:", path)
+        sys.exit(1)
+    counts = np.fromfile(f, dtype="<u8", count=numSites)
+    f.close()
+    return counts
+
+def writeHistogram(path, counts, text):
+    if text:
+        f = open(path, "w")
+        for i in range(len(counts)):
+            f.write("Location %d: %d\n" % (i, counts[i]))
+    else:
+        f = open(path, "wb")
+        f.write(struct.pack(HEADER, MAGIC, VERSION, 0, 0, len(counts)))
+        counts.astype("<u8").tofile(f)
+    f.close()
+
+#parse arguments
+if len(sys.argv) < 2:
+    print ("Usage: mergeHistogram.py prefix [-t] [-o outfile]")
+    sys.exit(1)
+
+prefix = sys.argv[1]
+text = "-t" in sys.argv
+outfile = prefix + (".txt" if text else ".bin")
+if "-o" in sys.argv:
+    idx = sys.argv.index("-o")
+    if idx+1 >= len(sys.argv):
+        print ("Unknown output file name.")
+        sys.exit(1)
+    outfile = sys.argv[idx + 1]
+
+files = [f for f in glob.glob(prefix + "_*") if f[len(prefix)+1:].isdigit()]
+if len(files) == 0:
+    print ("No histogram files found with prefix", prefix)
+    sys.exit(1)
+
+# ranks may have been linked with different site counts
+total = np.zeros(0, dtype=np.uint64)
+for f in files:
+    counts = readHistogram(f)
+    if len(counts) > len(total):
+        total = np.concatenate((total, np.zeros(len(counts) - len(total), dtype=np.uint64)))
+    total[:len(counts)] += counts
+
+writeHistogram(outfile, total, text)
@@ -11,12 +11,32 @@
 #
 # Name: resetFaultIndex.sh
 #
-# Description: Resets the fault site indexing- i.e., the next time 
-# FlipIt complies code it will start with fault index 0, 1, 2, ...
+# Description: Removes the old fault site index state file and the
+# default flipit-cc cache of instrumented objects. Fault sites are now
+# numbered per module and made unique when the program is loaded, so
+# indexing no longer needs to be reset between applications.
 #
 #####################################################################
 
-if [ [ -a ~/.FlipItState] ]
+if [ -e ~/.FlipItState ]
 	then
 	rm ~/.FlipItState
 fi
+
+# the cache of flipit-cc, from the config.py it reads: the one in the
+# current directory if there is one, else the one next to this script
+cacheDir=$(python3 -c '
+import os, sys
+sys.path.insert(0, sys.argv[1])
+if os.path.isfile("config.py"):
+    sys.path.insert(0, os.getcwd())
+from config import *
+if "cacheDir" not in globals():
+    cacheDir = os.path.join(os.path.expanduser("~"), ".FlipItCache")
+print (cacheDir)
+' "$(dirname "$0")")
+if [ -z "$cacheDir" ]
+	then
+	cacheDir=~/.FlipItCache
+fi
+rm -rf "$cacheDir"
@@ -33,8 +33,10 @@ Copying headers to include dir"
 cd $FLIPIT_PATH
 mkdir -p -v include/FlipIt/corrupt
 mkdir -p -v include/FlipIt/pass
+mkdir -p -v include/FlipIt/sites
 cp src/pass/faults.h include/FlipIt/pass/
 cp src/pass/Logger.h include/FlipIt/pass/
+cp src/sites/siteLog.h include/FlipIt/sites/
 
 echo "
 
@@ -82,6 +84,14 @@ if [[ -e libcorrupt.a ]]; then
 	if [[ -e libcorrupt_histo.a ]]; then
         cp libcorrupt_histo.a $FLIPIT_PATH/lib/
     fi
+	if [[ -e libcorrupt_mpi.a ]]; then
+        mv libcorrupt_mpi.a $FLIPIT_PATH/lib/
+    else
+        echo "WARNING: Unable to build libcorrupt_mpi.a (needs mpicc). Injections are per rank."
+    fi
+	if [[ -e libFlipItSites.so ]]; then
+        mv libFlipItSites.so $FLIPIT_PATH/lib/
+    fi
     
 	# copy the library to a location that is in the library path
 	if [ "$(whoami)" != "root" ]; then
@@ -91,21 +101,34 @@ if [[ -e libcorrupt.a ]]; then
 	else
 		cp libcorrupt.a /usr/local/lib
 		echo "You can link to the corruption library using:"
-		echo "    -lcorrupt"
+		echo "    -lcorrupt -lm -lpthread"
 	fi
 	rm libcorrupt.a
 
-	echo "    -L$FLIPIT_PATH/lib -lcorrupt"
+	echo "    -L$FLIPIT_PATH/lib -lcorrupt -lm -lpthread"
 else
 	echo "Error: Unable to make corruption library!"
 fi
 
 echo "
 
+Building the analysis database loader..."
+cd $FLIPIT_PATH/src/ingest
+make -f Makefile
+if [[ -e flipit-ingest ]]; then
+    mkdir -p $FLIPIT_PATH/bin
+    mv flipit-ingest $FLIPIT_PATH/bin/
+else
+    echo "WARNING: Unable to build flipit-ingest (needs the sqlite3 headers). The analysis scripts will load the database themselves."
+fi
+
+echo "
+
 Copying headers to include dir"
 cd $FLIPIT_PATH
 cp src/corrupt/*.h include/FlipIt/corrupt/
 cp src/corrupt/corrupt.bc include/FlipIt/corrupt/
+cp src/corrupt/corruptRuntime*.bc include/FlipIt/corrupt/
 echo "Done!"
 echo ""
 echo "setup.sh terminating..."
@@ -13,49 +13,630 @@
 /*                                                                                             */
 /***********************************************************************************************/
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* F_SETSIG and F_SETOWN_EX for the instruction counter */
+#endif
 #include "corrupt.h"
+#include "../sites/siteLog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
 
-#define FAULT_IDX_MASK 0x00FFFFFF
+#define FLIPIT_ANY 0xF /* byte or bit chosen at random */
+#define FLIPIT_CACHE_LINE 64
 
 static uint32_t FLIPIT_MaxInjections = 1;
 static uint32_t FLIPIT_State = 0;
 
+/* Non-zero only when an injection can occur (injector on, rank active, and injections
+   remaining). Exported so the compiler pass can test it inline before calling into the
+   runtime. */
+uint32_t FLIPIT_Armed = 0;
+/* times FLIPIT_Armed was cleared; sites of FLIPIT_InexactInsts modules go uncounted from then */
+static uint32_t FLIPIT_Disarms = 0;
 
-/*fault injection count*/
+
+/*fault injection count (shared by all threads)*/
 static uint32_t FLIPIT_InjectionCount = 0;
-static uint64_t FLIPIT_Attempts = 0;
 static uint64_t FLIPIT_InjCountdown = 0;
-static uint64_t FLIPIT_TotalInsts = 0;
+/* Exported so the compiler pass can count unarmed sites inline (-countInsts) */
+__thread uint64_t FLIPIT_TotalInsts = 0;
+/* defined by the modules whose guarded sites skip the count (-guard 1 -countInsts 0) */
+extern const uint32_t FLIPIT_InexactInsts __attribute__((weak));
 
 /*Fault Injection Statistics*/
-static uint64_t* FLIPIT_Histogram;
 static uint32_t FLIPIT_MAX_LOC = 20000;
+
+/* The compiler pass numbers the sites of each module from 0 and places {module hash, number of
+   sites, &base} in section flipit_sites. Before main the runtime orders the modules by hash and
+   sets each module's base to the sum of the sites before it, which gives dense site indexes
+   that do not depend on build or link order. The linker provides the bounds of the section;
+   they are NULL when no object has one. */
+typedef struct {
+    uint64_t module;
+    uint64_t numSites;
+    uint32_t* base;
+} flipit_site_table_t;
+extern const flipit_site_table_t __start_flipit_sites[] __attribute__((weak));
+extern const flipit_site_table_t __stop_flipit_sites[] __attribute__((weak));
+static uint64_t FLIPIT_LinkedSites = 0;
+static uint64_t FLIPIT_ProgramSites = 0;    /* of the pass, without the runtime's own modules */
+
+/* The runtime's own sites (MPI, memory at rest) are modules with hashes from
+   FLIPIT_RUNTIME_MODULE up, so they are numbered after all sites of the program and do not move
+   them. Their site logs are written by the runtime from a table of these. */
+#define FLIPIT_RUNTIME_MODULE (UINT64_MAX - 1)
+#define FLIPIT_MAX_RUNTIME_SITES 32
+
+typedef struct {
+    const char* function;
+    const char* part;       /* the "opcode" of the site log */
+    uint32_t kind;
+    uint8_t info;           /* INJ_INFO_TYPES: 0 result, else argument + 1 */
+} flipit_runtime_site_t;
+
+/* Site logs (*.LLVM.bin) added with --siteLog; the banner then names the function and source
+   location of each injection. base is the index of the log's first site in this binary. */
+#define FLIPIT_MAX_SITE_LOGS 256
+typedef struct {
+    flipit_sitelog_t* log;
+    uint32_t base;
+} flipit_site_log_t;
+static flipit_site_log_t FLIPIT_SiteLogs[FLIPIT_MAX_SITE_LOGS];
+static uint32_t FLIPIT_NumSiteLogs = 0;
+
+/* Binary histogram file <name>_<rank>: this header followed by numSites uint64_t counts.
+   scripts/mergeHistogram.py reduces the files of all ranks. */
+#define FLIPIT_HISTOGRAM_MAGIC "FIHG"
+#define FLIPIT_HISTOGRAM_VERSION 1
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t rank;
+    uint32_t reserved;
+    uint64_t numSites;
+} flipit_histogram_header_t;
 static char* FLIPIT_StateFile = NULL;
 
 static uint32_t FLIPIT_MAX_INJECT_LINES = 33554432;
+/* injection budget shared by all threads; only updated atomically */
 static uint32_t FLIPIT_REMAIN_INJECT_COUNT = 1;  
-static uint32_t FLIPIT_char_type_size = sizeof(char);
 
 /* MPI injections */
 static uint32_t FLIPIT_Rank = 0;                   
 static uint32_t FLIPIT_RankInject = 0;
 
-/* Selective Injections */
+/* Job-wide injections, set with --global, --globalInsts, --globalCounts and --globalTarget. The
+   injection budget is shared by all ranks, and with a target the injection is made at that
+   dynamic instruction of the job. Only libcorrupt_mpi.a (FLIPIT_MPI) implements them. */
+static uint8_t FLIPIT_GlobalRequested = 0;
+static uint64_t FLIPIT_GlobalInsts = UINT64_MAX;    /* job-wide count, 0 to only count */
+static uint64_t FLIPIT_GlobalTarget = UINT64_MAX;
+static char* FLIPIT_GlobalCounts = NULL;            /* instructions of each rank */
+
+/* Faults in MPI messages, set with --mpiProb and --mpiFaults. Only libcorrupt_mpi.a intercepts
+   the MPI calls. */
+#define FLIPIT_MPI_SEND 0x1     /* send buffers */
+#define FLIPIT_MPI_RECV 0x2     /* receive buffers */
+#define FLIPIT_MPI_COUNT 0x4
+#define FLIPIT_MPI_TAG 0x8
+#define FLIPIT_MPI_REDUCE 0x10  /* reduction results */
+#define FLIPIT_MPI_ALL 0x1F
+static double FLIPIT_MPIProb = 0.;
+static uint32_t FLIPIT_MPIFaults = 0;
+static char* FLIPIT_MPISiteLog = NULL;
+
+/* Message logs, set with --writeMsgLog and --msgLog (libcorrupt_mpi.a only) */
+static char* FLIPIT_MsgLog = NULL;
+static uint8_t FLIPIT_WriteMsgLog = 0;
+
+/* Faults in memory at rest, set with --memRate or --memInsts. A thread of the runtime flips a bit
+   of the regions registered with FLIPIT_RegisterRegion (and with --memHeap, of the large heap
+   blocks, see __wrap_malloc) at times drawn from a rate of upsets per GiB and second, or after
+   every --memInsts instructions counted by the CPU. The program is not instrumented for it. The
+   regions are a module of one site. */
+#define FLIPIT_MEM_MODULE FLIPIT_RUNTIME_MODULE
+#define FLIPIT_MAX_REGIONS 1024
+#define FLIPIT_MEM_SIGNAL (SIGRTMIN + 4)    /* instruction counter overflows */
+#define FLIPIT_MEM_MAX_WAIT 1.              /* seconds, then the wait is drawn again */
+
+typedef struct {
+    uint8_t* data;
+    uint64_t bytes;
+    uint32_t id;            /* in order of registration */
+    char label[28];
+} flipit_region_t;
+
+static double FLIPIT_MemRate = 0.;          /* upsets per GiB and second */
+static uint64_t FLIPIT_MemInsts = 0;        /* instructions between upsets */
+static uint64_t FLIPIT_MemHeap = 0;         /* smallest heap block registered, 0 for none */
+static char* FLIPIT_MemSiteLog = NULL;
+static flipit_region_t FLIPIT_Regions[FLIPIT_MAX_REGIONS];
+static uint32_t FLIPIT_NumRegions = 0;
+static uint32_t FLIPIT_NextRegion = 0;
+static uint64_t FLIPIT_RegionBytes = 0;
+static uint32_t FLIPIT_RegionLock = 0;
+static flipit_region_t FLIPIT_MemUpset;     /* region of the latest upset, for the banner */
+static uint64_t FLIPIT_MemUpsetOffset = 0;
+static pthread_t FLIPIT_MemThread;
+static sem_t FLIPIT_MemWake;                /* counter overflows, and the end of the run */
+static uint8_t FLIPIT_MemRunning = 0;
+static int FLIPIT_MemCounter = -1;
+static uint64_t* FLIPIT_MemInstsOf = NULL;  /* FLIPIT_TotalInsts of the thread calling Init */
+static uint32_t FLIPIT_MemInstsThread = 0;  /* and its id, for the latency of detections */
+
+static uint32_t FLIPIT_MemBase = 0;
+static const flipit_site_table_t FLIPIT_MemSiteTable
+    __attribute__((used, section("flipit_sites"), aligned(8))) =
+    { FLIPIT_MEM_MODULE, 1, &FLIPIT_MemBase };
+static const flipit_runtime_site_t FLIPIT_MemSites[] = {
+    { "memory", "at rest", 0, 0 },
+};
+
+#ifdef FLIPIT_MPI
+/* Every dynamic instruction of the job gets a number: those of rank 0 first, then those of rank
+   1, and so on, so the numbers are dense. Each rank numbers its own instructions from 0 and
+   knows where its numbers start from the instructions of each rank counted by a fault free run
+   (--globalInsts 0 --globalCounts). Only the rank whose numbers hold the target stays armed, and
+   MPI is only called to share the injection budget. */
+static uint8_t FLIPIT_Global = 0;
+static uint64_t FLIPIT_GlobalNext = 0;      /* the rank's next instruction */
+static uint64_t FLIPIT_GlobalLocal = UINT64_MAX;    /* the target among them, if it holds it */
+static MPI_Comm FLIPIT_GlobalComm = MPI_COMM_NULL;
+static MPI_Win FLIPIT_GlobalWin;            /* at rank 0: injections remaining */
+static uint64_t* FLIPIT_GlobalCounters = NULL;
+
+/* The MPI calls below are intercepted through the profiling interface (PMPI). Each part of a call
+   chosen by --mpiFaults is a fault site of probability --mpiProb. The sites are a module of their
+   own, numbered after the modules of the program, and are sampled, budgeted and logged like the
+   sites of the pass. Buffers are corrupted only when an injection is made: a received buffer in
+   place, within the count received, and a send buffer in a private copy that is sent instead, so
+   the caller's buffer, which may be read only, is never written. The runtime's own MPI calls use
+   PMPI directly. */
+#define FLIPIT_MPI_MODULE UINT64_MAX    /* the hash of the module: after all of the pass */
+#define FLIPIT_MPI_SEND_BUF 0
+#define FLIPIT_MPI_SEND_COUNT 1
+#define FLIPIT_MPI_SEND_TAG 2
+#define FLIPIT_MPI_ISEND_BUF 3
+#define FLIPIT_MPI_ISEND_COUNT 4
+#define FLIPIT_MPI_ISEND_TAG 5
+#define FLIPIT_MPI_RECV_BUF 6
+#define FLIPIT_MPI_RECV_COUNT 7
+#define FLIPIT_MPI_RECV_TAG 8
+#define FLIPIT_MPI_IRECV_BUF 9
+#define FLIPIT_MPI_IRECV_COUNT 10
+#define FLIPIT_MPI_IRECV_TAG 11
+#define FLIPIT_MPI_SENDRECV_SEND 12
+#define FLIPIT_MPI_SENDRECV_RECV 13
+#define FLIPIT_MPI_BCAST_BUF 14
+#define FLIPIT_MPI_REDUCE_RESULT 15
+#define FLIPIT_MPI_ALLREDUCE_RESULT 16
+#define FLIPIT_MPI_SENDRECV_SEND_COUNT 17   /* appended, so that the sites above keep their numbers */
+#define FLIPIT_MPI_SENDRECV_SEND_TAG 18
+#define FLIPIT_MPI_SENDRECV_RECV_COUNT 19
+#define FLIPIT_MPI_SENDRECV_RECV_TAG 20
+#define FLIPIT_MPI_NUM_SITES 21
+#define FLIPIT_MPI_PENDING 64   /* nonblocking requests tracked at once */
+
+static const flipit_runtime_site_t FLIPIT_MPISites[FLIPIT_MPI_NUM_SITES] = {
+    { "MPI_Send", "buffer", FLIPIT_MPI_SEND, 1 },
+    { "MPI_Send", "count", FLIPIT_MPI_COUNT, 2 },
+    { "MPI_Send", "tag", FLIPIT_MPI_TAG, 5 },
+    { "MPI_Isend", "buffer", FLIPIT_MPI_SEND, 1 },
+    { "MPI_Isend", "count", FLIPIT_MPI_COUNT, 2 },
+    { "MPI_Isend", "tag", FLIPIT_MPI_TAG, 5 },
+    { "MPI_Recv", "buffer", FLIPIT_MPI_RECV, 1 },
+    { "MPI_Recv", "count", FLIPIT_MPI_COUNT, 2 },
+    { "MPI_Recv", "tag", FLIPIT_MPI_TAG, 5 },
+    { "MPI_Irecv", "buffer", FLIPIT_MPI_RECV, 1 },
+    { "MPI_Irecv", "count", FLIPIT_MPI_COUNT, 2 },
+    { "MPI_Irecv", "tag", FLIPIT_MPI_TAG, 5 },
+    { "MPI_Sendrecv", "buffer", FLIPIT_MPI_SEND, 1 },
+    { "MPI_Sendrecv", "buffer", FLIPIT_MPI_RECV, 6 },
+    { "MPI_Bcast", "buffer", FLIPIT_MPI_RECV, 1 },
+    { "MPI_Reduce", "result", FLIPIT_MPI_REDUCE, 0 },
+    { "MPI_Allreduce", "result", FLIPIT_MPI_REDUCE, 0 },
+    { "MPI_Sendrecv", "count", FLIPIT_MPI_COUNT, 2 },
+    { "MPI_Sendrecv", "tag", FLIPIT_MPI_TAG, 5 },
+    { "MPI_Sendrecv", "count", FLIPIT_MPI_COUNT, 7 },
+    { "MPI_Sendrecv", "tag", FLIPIT_MPI_TAG, 10 },
+};
+
+static uint32_t FLIPIT_MPIBase = 0;
+static const flipit_site_table_t FLIPIT_MPISiteTable
+    __attribute__((used, section("flipit_sites"), aligned(8))) =
+    { FLIPIT_MPI_MODULE, FLIPIT_MPI_NUM_SITES, &FLIPIT_MPIBase };
+
+/* A nonblocking request whose corrupted copy of the send buffer is to be freed (copy is set) or
+   whose receive buffer may be corrupted (copy is NULL) when it completes */
+typedef struct {
+    MPI_Request request;
+    void* buf;
+    void* copy;
+    int count;              /* posted */
+    MPI_Datatype datatype;
+    uint32_t size;          /* of an element */
+    uint8_t type;           /* FLIPIT_EVENT_* */
+    uint32_t ticket;        /* of the MPI_Wait or MPI_Test call completing it, else 0 */
+    int index;              /* of its status in that call */
+} flipit_mpi_pending_t;
+
+static flipit_mpi_pending_t FLIPIT_MPIPending[FLIPIT_MPI_PENDING];
+static uint32_t FLIPIT_NumMPIPending = 0;
+static uint32_t FLIPIT_MPIPendingLock = 0;
+static uint32_t FLIPIT_MPITicket = 0;
+
+/* Propagation tracking. The golden run (--writeMsgLog prefix) writes a checksum of every message
+   a rank sends to <prefix>_<rank>; the faulty run (--msgLog prefix) compares its messages with
+   them and reports the first one of each rank that differs: when, and to which rank, corruption
+   left it. Messages are numbered in the order the rank sends them. Sends are checked rather than
+   receives, so the latency is counted by the rank the corruption escapes from, which is the rank
+   that injected unless the corruption reached it in an earlier message. */
+#define FLIPIT_MSG_MAGIC "FIMS"
+#define FLIPIT_MSG_VERSION 1
+#define FLIPIT_MSG_ALL -1       /* destination of broadcasts and allreduces */
+#define FLIPIT_MSG_LANES 8
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t rank;
+    uint32_t recordSize;
+} flipit_msg_header_t;
+
+typedef struct {
+    uint64_t message;
+    uint64_t bytes;         /* UINT64_MAX for messages the golden run did not send */
+    uint64_t sum[2];        /* 0 for datatypes with gaps */
+} flipit_msg_record_t;
+
+static FILE* FLIPIT_MsgFile = NULL;                 /* golden run */
+static flipit_msg_record_t* FLIPIT_MsgGolden = NULL; /* faulty run, indexed by message */
+static uint64_t FLIPIT_NumMsgGolden = 0;
+static uint64_t FLIPIT_NumMessages = 0;
+static uint32_t FLIPIT_MsgLock = 0;
+static uint32_t FLIPIT_MsgDiverged = 0;
+static uint64_t FLIPIT_TrialMessage = UINT64_MAX;   /* first corrupted message of the trial */
+static uint64_t FLIPIT_TrialMessageInsts = UINT64_MAX;
+static int32_t FLIPIT_TrialMessageDest = FLIPIT_MSG_ALL;
+#endif
+
+/* Selective Injections. Sites given with --faultyLoc or --faultyLocFile are collected as
+   [first, last] ranges, then turned into a bitmap over the site indexes so checking a site
+   is O(1) however many sites are selected. */
 static uint32_t* FLIPIT_FaultSites = NULL;
 static int32_t FLIPIT_NumFaultSites = -1;
+static uint32_t FLIPIT_NumSiteRanges = 0;
+static uint32_t FLIPIT_MaxSiteRanges = 0;
+static uint8_t FLIPIT_SelectSites = 0;
+static uint8_t* FLIPIT_SiteMap = NULL;
+static uint64_t FLIPIT_SiteMapSize = 0; /* in sites, up to 2^32 */
 
 
 static void (*FLIPIT_CustomLogger)(FILE*) = NULL;
-static void (*FLIPIT_CountdownCustomLogger)(FILE*) = NULL;
 static double (*FLIPIT_FaultProb)() = NULL;
+static uint8_t FLIPIT_CountdownActive = 0;
+static uint64_t FLIPIT_CountdownStart = 0;
+
+/* Persistent mode. FLIPIT_TrialBegin/FLIPIT_TrialEnd bracket one trial of a loop in a single
+   process; the runtime restores its budget, counters and random streams at the start of each
+   trial and appends one row per trial to an in-memory results table. */
+static uint32_t FLIPIT_RankInjectStart = 0;  /* RankInject as configured, not as used up */
+static uint8_t FLIPIT_InTrial = 0;
+static uint32_t FLIPIT_TrialSite = UINT32_MAX; /* first injection of the trial */
+static uint32_t FLIPIT_TrialBit = 0;
+static flipit_trial_result_t* FLIPIT_TrialResults = NULL;
+static uint32_t FLIPIT_NumTrialResults = 0;
+static uint32_t FLIPIT_MaxTrialResults = 0;
+static char* FLIPIT_TrialResultFile = NULL;
+
+/* Injection event log. Each injection is one fixed size record in a lock-free ring buffer;
+   producers reserve a slot with an atomic increment and publish it through the slot's
+   sequence number. Whichever thread finds the ring half full (or FLIPIT_Finalize, exit and
+   the crash handlers) appends the published records to <prefix>_<rank> with write(2).
+   scripts/analysis/eventParser.py reads the files. The stdout banner is optional. */
+#define FLIPIT_EVENT_MAGIC "FIEV"
+#define FLIPIT_EVENT_VERSION 1
+#define FLIPIT_EVENT_RING 1024 /* power of two */
+#define FLIPIT_EVENT_INJECTION 0
+#define FLIPIT_EVENT_DETECTION 1
+#define FLIPIT_EVENT_DETECTOR 2     /* names a detector, once per detector */
+#define FLIPIT_EVENT_MESSAGE 3      /* the first corrupted message a rank sent */
+#define FLIPIT_MAX_DETECTORS 64
+#define FLIPIT_DETECTOR_OVERFLOW FLIPIT_MAX_DETECTORS  /* the detectors past them: never named */
+#define FLIPIT_DETECTOR_NAME 40     /* bytes of site .. p in a FLIPIT_EVENT_DETECTOR record */
+
+#define FLIPIT_EVENT_INT 0
+#define FLIPIT_EVENT_FLOAT32 1
+#define FLIPIT_EVENT_FLOAT64 2
+#define FLIPIT_EVENT_PTR 3
+#define FLIPIT_EVENT_MEMORY 4
+static const char* FLIPIT_EventTypeNames[] = { "Integer Data", "32-bit IEEE Float Data",
+                                               "64-bit IEEE Float Data", "Converted Pointer",
+                                               "Memory at Rest" };
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t rank;
+    uint32_t recordSize;
+} flipit_event_header_t;
+
+typedef struct {
+    uint64_t site;
+    uint64_t dynInsts;      /* runtime calls made by the thread (FLIPIT_TotalInsts) */
+    uint64_t time;          /* ns since the epoch */
+    double prob;
+    double p;
+    uint32_t rank;
+    uint32_t thread;
+    uint32_t injection;     /* 1 for the rank's first injection */
+    uint16_t bit;
+    uint8_t kind;
+    uint8_t type;
+    uint64_t aux;           /* vector sites: lane << 32 | lanes, else 0 */
+} flipit_event_t;
+/* A FLIPIT_EVENT_DETECTION record has the site and number of the latest injection, the detector
+   in bit, the latency in dynamic instructions in aux (UINT64_MAX if unknown), in cycles in prob,
+   and in ns in p (-1 if there was no injection). A FLIPIT_EVENT_MESSAGE record has the number of
+   the message in site, its destination rank in prob (-1 for all ranks), the latest injection of
+   the rank, and its latency in aux and p as for detections. */
+
+/* the latest injection, for the latency of detections */
+typedef struct {
+    uint64_t dynInsts;
+    uint64_t cycles;
+    uint64_t time;
+    uint32_t site;
+    uint32_t injection;     /* 0 before the first injection */
+    uint32_t thread;
+    uint32_t disarms;       /* FLIPIT_Disarms after it, UINT32_MAX if it disarmed the runtime */
+} flipit_last_injection_t;
+
+static flipit_last_injection_t FLIPIT_LastInjection;
+static const char* FLIPIT_Detectors[FLIPIT_MAX_DETECTORS];
+static uint32_t FLIPIT_NumDetectors = 0;
+static uint32_t FLIPIT_DetectorLock = 0;
+static uint8_t FLIPIT_DetectorOverflow = 0;
+
+static flipit_event_t FLIPIT_Events[FLIPIT_EVENT_RING];
+static uint64_t FLIPIT_EventSeq[FLIPIT_EVENT_RING]; /* slot holds record n when seq is n+1 */
+static uint64_t FLIPIT_EventHead = 0;   /* next record to reserve */
+static uint64_t FLIPIT_EventTail = 0;   /* next record to write */
+static uint32_t FLIPIT_EventFlushing = 0;
+static uint8_t FLIPIT_EventFailed = 0;  /* a write failed: records are dropped, not written */
+static int FLIPIT_EventFd = -1;
+static char* FLIPIT_EventPrefix = NULL;
+static uint8_t FLIPIT_Banner = 1;
+
+static const int FLIPIT_CrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define FLIPIT_NUM_CRASH_SIGNALS (sizeof(FLIPIT_CrashSignals) / sizeof(int))
+static struct sigaction FLIPIT_OldActions[FLIPIT_NUM_CRASH_SIGNALS];
+static uint8_t FLIPIT_HandlersInstalled = 0;
+
+/* Fork server. The process runs the fault free prefix of the application once, counting
+   every site (sites must reach the runtime, so the server keeps the runtime armed). At each
+   dynamic instruction checkpoint it forks a snapshot process that waits for trials. A trial
+   (site, instance, bit) from --forkServer <file> is handed to the last snapshot taken before
+   the site's instance executes; the snapshot forks one child per trial, which injects at
+   exactly that instance and reports over a pipe. Snapshot processes write one line per trial
+   to the results file. Only the thread that calls FLIPIT_Init is followed, so this is meant
+   for single threaded, non-MPI runs. */
+#define FLIPIT_FORK_OFF 0
+#define FLIPIT_FORK_SERVER 1
+#define FLIPIT_FORK_TRIAL 2
+
+typedef struct {
+    uint32_t site;
+    int32_t bit;            /* bit position in the value, or -1 for any */
+    uint64_t instance;      /* 1 for the first execution of the site */
+    int32_t snapshot;       /* snapshot serving the trial, -1 until assigned */
+} flipit_fork_trial_t;
+
+typedef struct {
+    uint32_t injected;
+    uint32_t bit;
+    uint64_t dynInsts;
+} flipit_fork_report_t;
+
+static uint8_t FLIPIT_ForkRole = FLIPIT_FORK_OFF;
+static char* FLIPIT_ForkTrialFile = NULL;
+static char* FLIPIT_ForkResultFile = NULL;
+static uint32_t FLIPIT_ForkJobs = 1;
+static uint32_t FLIPIT_ForkTimeout = 0;     /* seconds, 0 for none */
+static flipit_fork_trial_t* FLIPIT_ForkTrials = NULL;
+static uint32_t FLIPIT_NumForkTrials = 0;
+static uint64_t* FLIPIT_Checkpoints = NULL; /* sorted; the first is always 0 */
+static uint32_t FLIPIT_NumCheckpoints = 0;
+static uint32_t FLIPIT_MaxCheckpoints = 0;
+static uint32_t FLIPIT_NextCheckpoint = 0;
+static uint64_t* FLIPIT_SiteInstances = NULL;
+static uint64_t FLIPIT_NumSiteInstances = 0;    /* covers every site of a trial */
+static int* FLIPIT_SnapshotFds = NULL;      /* write end of each snapshot's trial pipe */
+static pid_t* FLIPIT_SnapshotPids = NULL;
+static int FLIPIT_ForkResultFd = -1;
+static uint32_t FLIPIT_ForkTrial = 0;       /* trial of a trial process */
+static uint64_t FLIPIT_ForkSeen = 0;
+static int FLIPIT_ForkReportFd = -1;
+
+/* Geometric skip-ahead sampling. Instead of one draw per site, draw the amount of hazard
+   (-log(1-prob) per site) until the next injection once and subtract from it. For a fixed
+   probability the distance between injections is geometric, and mixed per-site
+   probabilities give the same distribution as one Bernoulli draw per site. */
+static uint32_t FLIPIT_Sampler = FLIPIT_SAMPLE_BERNOULLI;
+static uint8_t FLIPIT_DefaultFaultProb = 1;
+
+/* Per-thread runtime state. Created on a thread's first visit to the runtime and kept on a
+   list so FLIPIT_Finalize can merge it. Each thread's state is cache line aligned so hot
+   counters are never shared between cores. */
+typedef struct flipit_thread {
+    uint32_t id;
+    uint64_t attempts;
+    uint64_t rngCounter;    /* next Philox block of this thread's stream */
+    uint32_t rngBlock[4];
+    uint32_t rngUsed;       /* words of rngBlock already handed out */
+    double skipBudget;
+    double skipDraw;
+    double skipProb;
+    double skipHazard;
+    uint64_t* histogram;
+    struct flipit_thread* next;
+} flipit_thread_t;
+
+static __thread flipit_thread_t* FLIPIT_Thread = NULL;
+static flipit_thread_t* FLIPIT_Threads = NULL;
+static uint32_t FLIPIT_NumThreads = 0;
+
+/* Random numbers come from the counter-based generator Philox4x32-10 (Salmon et al., SC'11).
+   The key is (seed, trial) and the counter is (block, thread, rank), so every rank and
+   thread has its own stream and any draw can be recomputed from its key and block alone. */
+#define PHILOX_M0 0xD2511F53
+#define PHILOX_M1 0xCD9E8D57
+#define PHILOX_W0 0x9E3779B9
+#define PHILOX_W1 0xBB67AE85
+#define PHILOX_ROUNDS 10
+static uint64_t FLIPIT_Seed = 0;
+static uint64_t FLIPIT_Trial = 0;
+
+/* Golden output comparison. Registered output regions are written by the golden run to
+   <file>_<rank> as a checksum per FLIPIT_GOLDEN_BLOCK bytes followed by the data. The faulty run
+   checksums its regions block by block and reads back from the file only the blocks that differ,
+   so no second copy of the output is kept in memory. */
+#define FLIPIT_GOLDEN_MAGIC "FIGD"
+#define FLIPIT_GOLDEN_VERSION 1
+#define FLIPIT_GOLDEN_BLOCK 65536 /* bytes, a multiple of 8 */
+#define FLIPIT_MAX_OUTPUTS 32
+
+typedef struct {
+    char name[32];
+    void* data;
+    uint64_t count;
+    uint32_t type;
+    double tolerance;
+    flipit_output_result_t result;
+} flipit_output_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t rank;
+    uint32_t numOutputs;
+} flipit_golden_header_t;
+
+typedef struct {
+    char name[32];
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t count;
+    double tolerance;
+    uint64_t offset;        /* of the checksums, the data follows them */
+} flipit_golden_region_t;
+
+static const uint32_t FLIPIT_OutputSizes[] = {1, 4, 8, 4, 8};
+static flipit_output_t FLIPIT_Outputs[FLIPIT_MAX_OUTPUTS];
+static uint32_t FLIPIT_NumOutputs = 0;
+static char* FLIPIT_GoldenFile = NULL;
+static uint8_t FLIPIT_WriteGolden = 0;
+static uint8_t FLIPIT_OutputsChecked = 0;
 
 static void flipit_parseArgs(uint32_t argc, char** argv);
+static uint64_t flipit_linkedSites();
+static void flipit_numberSites() __attribute__((constructor));
+static int flipit_compareModules(const void* a, const void* b);
+static void flipit_addFaultSites(uint32_t first, uint32_t last);
+static void flipit_printSite(uint32_t fault_index);
+static void flipit_readFaultSiteFile(char* path);
+static void flipit_buildSiteMap();
+static uint8_t flipit_trigger(double prob, double* p);
+static void flipit_drawSkip(flipit_thread_t* t);
+static flipit_thread_t* flipit_thread();
+static flipit_thread_t* flipit_newThread();
+static void flipit_seedThread(flipit_thread_t* t);
+static void flipit_philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+static void flipit_streamBlock(uint64_t block, uint32_t thread, uint32_t rank, uint32_t out[4]);
+static uint32_t flipit_rand32(flipit_thread_t* t);
+static double flipit_uniformOf(flipit_thread_t* t);
+static double flipit_uniform();
+static uint32_t flipit_rand();
+static void flipit_updateArmed();
+static uint32_t flipit_claimInjection();
 static uint8_t flipit_shouldInjectNoCheck(); 
 static uint8_t flipit_checkActiveFaultSite(uint32_t fault_index);
-static void flipit_print_injectedErr(char* type, unsigned int bPos, int fault_index, double prob,
-                                     double p);
+static void flipit_logInjection(uint8_t type, uint32_t injection, unsigned int bPos,
+                                uint32_t fault_index, double prob, double p, uint32_t lane,
+                                uint32_t lanes);
+static flipit_event_t* flipit_reserveEvent(uint64_t* pos);
+static void flipit_publishEvent(uint64_t pos);
+static uint32_t flipit_detectorId(const char* detector);
+static uint64_t flipit_cycles();
+static void flipit_openEventLog();
+static void flipit_closeEventLog();
+static void flipit_flushEvents();
+static void flipit_writeEvents(const void* data, size_t size);
+static void flipit_crashHandler(int sig);
+static void flipit_addCheckpoint(uint64_t checkpoint);
+static void flipit_startForkServer();
+static void flipit_readForkTrials(char* path);
+static uint8_t flipit_forkSite(uint32_t fault_index, uint32_t* byte, uint32_t* bit);
+static void flipit_checkpoint();
+static void flipit_sendForkTrials(int32_t snapshot, uint8_t all);
+static void flipit_finishForkServer();
+static void flipit_serveSnapshot(int32_t snapshot, int fd);
+static void flipit_forkReport(uint32_t bit);
 static double flipit_countdown();
-static void flipit_countdownLogger(FILE*);
+static void flipit_lock(uint32_t* lock);
+static uint32_t flipit_logString(char* strings, uint32_t* bytes, const char* str);
+static void flipit_writeSiteLog(const char* path, uint64_t module, const char* source,
+                                const flipit_runtime_site_t* sites, uint32_t numSites);
+static void flipit_startMemoryFaults();
+static void flipit_stopMemoryFaults();
+static int flipit_openMemoryCounter();
+static void flipit_memorySignal(int sig);
+static void* flipit_memoryThread(void* arg);
+static void flipit_memoryUpset();
+static void flipit_removeRegion(void* data);
+#ifdef FLIPIT_MPI
+static double flipit_globalCountdown();
+static uint8_t flipit_readGlobalCounts(uint64_t* counts, int size);
+static uint8_t flipit_claimGlobal();
+static void flipit_finishGlobal();
+static void flipit_freeGlobal();
+static uint8_t flipit_mpiTrigger(uint32_t site, double* p);
+static int flipit_corruptMPIInt(uint32_t site, int value);
+static uint8_t flipit_mpiElement(MPI_Datatype type, uint32_t* size, uint8_t* eventType);
+static void* flipit_corruptMPIBuffer(uint32_t site, const void* buf, int count, MPI_Datatype type,
+                                     uint8_t copy);
+static void* flipit_corruptMPIElements(uint32_t site, const void* buf, int count, uint32_t size,
+                                       uint8_t eventType, uint8_t copy);
+static void flipit_addMPIPending(MPI_Request request, const void* buf, int count,
+                                 MPI_Datatype type, void* copy);
+static uint32_t flipit_markMPIPending(MPI_Request* requests, int count);
+static void flipit_completeMPIPending(uint32_t ticket, int completed, const int* indices,
+                                      MPI_Status* statuses);
+static void flipit_dropMPIPending(MPI_Request request);
+static void flipit_openMsgLog();
+static void flipit_closeMsgLog();
+static void flipit_messageSum(const uint8_t* data, uint64_t bytes, uint64_t sum[2]);
+static void flipit_checkMessage(const void* buf, int count, int valid, MPI_Datatype type, int dest,
+                                MPI_Comm comm);
+static int32_t flipit_worldRank(MPI_Comm comm, int rank);
+static void flipit_messageDiverged(uint64_t message, int dest, MPI_Comm comm);
+#endif
+static void flipit_parseMPIFaults(char* kinds);
+static void flipit_goldenName(char* filename, size_t len);
+static void flipit_checksum(const uint8_t* data, uint64_t bytes, uint64_t sum[2]);
+static int flipit_writeGolden();
+static int flipit_compareGolden();
+static uint64_t flipit_compareBlock(flipit_output_t* out, const uint8_t* golden, uint64_t first,
+                                    uint64_t count);
 
 /***********************************************************************************************/
 /* The functions below are the functions that should be called by a user of FlipIt             */
@@ -68,31 +649,79 @@ void FLIPIT_Init(uint32_t myRank, uint32_t argc, char** argv, uint64_t seed) {
     flipit_parseArgs(argc, argv);
 
     if (FLIPIT_Rank == 0)
-        printf("Fault injector seed: %llu\n", (unsigned long long)seed+myRank);
-    
-    infile = fopen(FLIPIT_StateFile, "r");
+        printf("Fault injector seed: %llu\n", (unsigned long long)seed);
     
-    if (infile) {
-        int ret = fscanf(infile, "%d", &amount);
-        if (amount > FLIPIT_MAX_LOC)
-            FLIPIT_MAX_LOC = amount;
-        fclose(infile);
+    /* size the histogram from the sites linked into the binary, or else the state file */
+    if (FLIPIT_ProgramSites > 0) {
+        FLIPIT_MAX_LOC = flipit_linkedSites();
+    }
+    else {
+        infile = fopen(FLIPIT_StateFile, "r");
+        
+        if (infile) {
+            int ret = fscanf(infile, "%d", &amount);
+            if (amount > FLIPIT_MAX_LOC)
+                FLIPIT_MAX_LOC = amount;
+            fclose(infile);
+        }
     }
-#ifdef FLIPIT_HISTOGRAM
-    FLIPIT_Histogram = (uint64_t*) calloc(FLIPIT_MAX_LOC, sizeof(uint64_t));
-#endif
 #ifdef FLIPIT_DEBUG
-    printf("Rank %d alloced an FLIPIT_Histogram of length: %d\n", FLIPIT_Rank, FLIPIT_MAX_LOC);
+    printf("Rank %d allocs FLIPIT_Histogram shards of length: %d\n", FLIPIT_Rank, FLIPIT_MAX_LOC);
 #endif
     FLIPIT_State = FLIPIT_ON;
-    srand(seed + myRank);
-    srand48(seed + myRank);
-    FLIPIT_SetFaultProbability(drand48);
+    FLIPIT_RankInjectStart = FLIPIT_RankInject;
+    flipit_updateArmed();
+    FLIPIT_Seed = seed;
+    FLIPIT_FaultProb = flipit_uniform;
+    FLIPIT_DefaultFaultProb = 1;
+    /* the calling thread's state (and histogram shard) is created or reseeded here */
+    if (FLIPIT_Thread == NULL)
+        FLIPIT_Thread = flipit_newThread();
+    else
+        flipit_seedThread(FLIPIT_Thread);
+
+    if (FLIPIT_EventPrefix != NULL)
+        flipit_openEventLog();
+    if (FLIPIT_ForkTrialFile != NULL && FLIPIT_ForkRole == FLIPIT_FORK_OFF)
+        flipit_startForkServer();
+
+    if (FLIPIT_GlobalRequested) {
+#ifdef FLIPIT_MPI
+        FLIPIT_SetGlobalComm(MPI_COMM_WORLD);
+#else
+        if (FLIPIT_Rank == 0)
+            fprintf(stderr, "FlipIt: job-wide injections need libcorrupt_mpi.a, injecting per rank\n");
+#endif
+    }
+    if (FLIPIT_MemSiteLog != NULL && FLIPIT_Rank == 0)
+        flipit_writeSiteLog(FLIPIT_MemSiteLog, FLIPIT_MEM_MODULE, "memory", FLIPIT_MemSites, 1);
+    if (FLIPIT_MemRate > 0. || FLIPIT_MemInsts > 0)
+        flipit_startMemoryFaults();
+#ifdef FLIPIT_MPI
+    if (FLIPIT_MPISiteLog != NULL && FLIPIT_Rank == 0)
+        flipit_writeSiteLog(FLIPIT_MPISiteLog, FLIPIT_MPI_MODULE, "MPI", FLIPIT_MPISites,
+                            FLIPIT_MPI_NUM_SITES);
+    if (FLIPIT_MsgLog != NULL)
+        flipit_openMsgLog();
+#else
+    if (FLIPIT_MPIFaults != 0 && FLIPIT_Rank == 0)
+        fprintf(stderr, "FlipIt: faults in MPI messages need libcorrupt_mpi.a\n");
+    if (FLIPIT_MsgLog != NULL && FLIPIT_Rank == 0)
+        fprintf(stderr, "FlipIt: message logs need libcorrupt_mpi.a\n");
+#endif
 }
 
 void FLIPIT_Finalize(char* fname) {
     int i;
     FILE* outfile;
+#ifdef FLIPIT_HISTOGRAM
+    flipit_thread_t* t;
+#endif
+    flipit_stopMemoryFaults();
+#ifdef FLIPIT_MPI
+    flipit_finishGlobal();
+    flipit_closeMsgLog();
+#endif
 #ifdef FLIPIT_HISTOGRAM
     if (fname != NULL) {
         char filename[500];
@@ -102,83 +731,548 @@ void FLIPIT_Finalize(char* fname) {
         sprintf(tmp, "%d", FLIPIT_Rank);
         strcat(filename, tmp);
 
-        outfile = fopen(filename, "w");
-        for (i = 0; i < FLIPIT_MAX_LOC; i++)
-            fprintf(outfile, "Location %i: %lu\n", i, FLIPIT_Histogram[i]);
-        fclose(outfile);
+        /* merge the shards of all threads into the calling thread's shard */
+        uint64_t* counts = flipit_thread()->histogram;
+        for (t = FLIPIT_Threads; t != NULL; t = t->next)
+            if (t->histogram != counts)
+                for (i = 0; i < FLIPIT_MAX_LOC; i++)
+                    counts[i] += t->histogram[i];
+
+        flipit_histogram_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, FLIPIT_HISTOGRAM_MAGIC, sizeof(header.magic));
+        header.version = FLIPIT_HISTOGRAM_VERSION;
+        header.rank = FLIPIT_Rank;
+        header.numSites = FLIPIT_MAX_LOC;
+
+        outfile = fopen(filename, "wb");
+        if (outfile != NULL) {
+            fwrite(&header, sizeof(header), 1, outfile);
+            fwrite(counts, sizeof(uint64_t), FLIPIT_MAX_LOC, outfile);
+            fclose(outfile);
+        }
+        else
+            fprintf(stderr, "FlipIt: unable to write histogram %s\n", filename);
     }
     
-    free(FLIPIT_Histogram);
+    for (t = FLIPIT_Threads; t != NULL; t = t->next) {
+        free(t->histogram);
+        t->histogram = NULL;
+    }
 #endif
-    if (FLIPIT_FaultSites != NULL)
-        free(FLIPIT_FaultSites);
+    if (FLIPIT_SiteMap != NULL)
+        free(FLIPIT_SiteMap);
+    FLIPIT_SiteMap = NULL;
+    FLIPIT_SiteMapSize = 0;
+
+    if (FLIPIT_GoldenFile != NULL && FLIPIT_NumOutputs > 0 && !FLIPIT_OutputsChecked)
+        FLIPIT_CheckOutputs();
+    if (FLIPIT_TrialResultFile != NULL)
+        FLIPIT_WriteTrialResults(FLIPIT_TrialResultFile);
+    flipit_closeEventLog();
 }
 
 void FLIPIT_SetInjector(int state) {
     if (state == FLIPIT_ON || state == FLIPIT_OFF)
         FLIPIT_State = state;
+    flipit_updateArmed();
 }
 
 
 void FLIPIT_SetRankInject(int state) {
     if (state == FLIPIT_ON || state == FLIPIT_OFF)
-        FLIPIT_RankInject = state;
+        FLIPIT_RankInject = FLIPIT_RankInjectStart = state;
+    flipit_updateArmed();
 }
 
 
 void FLIPIT_SetFaultProbability(double (prob)()) {
     FLIPIT_FaultProb = prob;
+    FLIPIT_DefaultFaultProb = 0;
+    FLIPIT_CountdownActive = 0;
+}
+
+/* Streams default to the order in which threads first enter the runtime; threaded codes
+   that need reproducible streams can pin them, e.g. to omp_get_thread_num(). */
+void FLIPIT_SetThreadId(uint32_t id) {
+    flipit_thread_t* t = flipit_thread();
+    t->id = id;
+    flipit_seedThread(t);
+}
+
+void FLIPIT_SetSampler(int sampler) {
+    if (sampler == FLIPIT_SAMPLE_BERNOULLI || sampler == FLIPIT_SAMPLE_GEOMETRIC)
+        FLIPIT_Sampler = sampler;
+    flipit_drawSkip(flipit_thread());
 }
 
 
+/* The custom logger writes into the injection banner, so it is only called while the
+   banner is printed. */
 void FLIPIT_SetCustomLogger(void (logger)(FILE*)) {
-    if (FLIPIT_InjCountdown != 0) {
-        FLIPIT_CountdownCustomLogger = logger;
-        FLIPIT_CustomLogger = flipit_countdownLogger;
-    }
-    else {
-        FLIPIT_CustomLogger = logger;
-    }
+    FLIPIT_CustomLogger = logger;
 }
 
 void FLIPIT_CountdownTimer(unsigned long numInstructions) {
-    FLIPIT_InjCountdown = numInstructions;
+    FLIPIT_InjCountdown = FLIPIT_CountdownStart = numInstructions;
     FLIPIT_SetFaultProbability(flipit_countdown);
-    
-    FLIPIT_CountdownCustomLogger = FLIPIT_CustomLogger;
-    FLIPIT_CustomLogger = flipit_countdownLogger;
+    FLIPIT_CountdownActive = 1;
+}
+
+/* Log injections as binary records to <prefix>_<rank>. Takes effect at FLIPIT_Init. */
+void FLIPIT_SetEventLog(char* prefix) {
+    if (FLIPIT_EventPrefix != NULL)
+        free(FLIPIT_EventPrefix);
+    FLIPIT_EventPrefix = NULL;
+    if (prefix != NULL) {
+        FLIPIT_EventPrefix = (char*) malloc(strlen(prefix) + 1);
+        strcpy(FLIPIT_EventPrefix, prefix);
+    }
+}
+
+/* Adds a fault site log, either of a module linked into this binary or of the whole program
+   (flipit-cc lto mode). Returns 0 if the log can not be read or does not belong to the binary. */
+int FLIPIT_AddSiteLog(char* path) {
+    const flipit_sitelog_header_t* header;
+    const flipit_site_table_t* m;
+    flipit_sitelog_t* log;
+
+    if (FLIPIT_NumSiteLogs == FLIPIT_MAX_SITE_LOGS)
+        return 0;
+    log = flipit_sitelogOpen(path);
+    if (log == NULL) {
+        fprintf(stderr, "FlipIt: unable to read fault site log %s\n", path);
+        return 0;
+    }
+    header = flipit_sitelogHeader(log);
+    FLIPIT_SiteLogs[FLIPIT_NumSiteLogs].log = log;
+    FLIPIT_SiteLogs[FLIPIT_NumSiteLogs].base = 0;
+    if (header->flags & FLIPIT_SITELOG_GLOBAL) {
+        FLIPIT_NumSiteLogs++;
+        return 1;
+    }
+    if (__start_flipit_sites != NULL && __stop_flipit_sites != NULL)
+        for (m = __start_flipit_sites; m != __stop_flipit_sites; m++)
+            if (m->module == header->module) {
+                FLIPIT_SiteLogs[FLIPIT_NumSiteLogs++].base = *m->base;
+                return 1;
+            }
+    fprintf(stderr, "FlipIt: fault site log %s is not of a module of this binary\n", path);
+    flipit_sitelogClose(log);
+    return 0;
+}
+
+void FLIPIT_SetBanner(int state) {
+    if (state == FLIPIT_ON || state == FLIPIT_OFF)
+        FLIPIT_Banner = state;
 }
 
+/* Count of the calling thread. Sites compiled with injection guards only reach the runtime
+   while armed; they are counted here only when compiled with -countInsts. Otherwise the count
+   stops when the runtime disarms, e.g. after the last injection, and is a lower bound. */
 unsigned long long FLIPIT_GetExecutedInstructionCount() {
     return FLIPIT_TotalInsts;
 }
 
 int FLIPIT_GetInjectionCount() {
-    return FLIPIT_InjectionCount;
+    return __atomic_load_n(&FLIPIT_InjectionCount, __ATOMIC_RELAXED);
 }
 
 void FLIPIT_SetMaxInjections(int n)
 {
-    if (n < 0)
+    uint32_t count = __atomic_load_n(&FLIPIT_InjectionCount, __ATOMIC_RELAXED);
+    if (n < 0) {
         printf("Warning: Attempting to set Max Injections to negative value %d. Defaulting to 1.\n", n);
         n  = 1;
+    }
 
     // set max number of injections for this rank;
     // then calculate the remaing number of injections if any
     FLIPIT_MaxInjections = n;
-    if (FLIPIT_MaxInjections > FLIPIT_InjectionCount)
-        FLIPIT_REMAIN_INJECT_COUNT = FLIPIT_MaxInjections - FLIPIT_InjectionCount;
+    if (FLIPIT_MaxInjections > count)
+        __atomic_store_n(&FLIPIT_REMAIN_INJECT_COUNT, FLIPIT_MaxInjections - count,
+                         __ATOMIC_RELEASE);
     else
-        FLIPIT_REMAIN_INJECT_COUNT = 0;
-
-    assert(FLIPIT_REMAIN_INJECT_COUNT >= 0
-        && "ERROR: NEGATIVE NUMBER OF REMAINING INJECTIONS!!!");  
+        __atomic_store_n(&FLIPIT_REMAIN_INJECT_COUNT, 0, __ATOMIC_RELEASE);
+    flipit_updateArmed();
 }
 
 int FLIPIT_GetMaxInjections()
 {
     return FLIPIT_MaxInjections;
 }
+
+/* Start trial number trial: the injection budget, the countdown timer and the calling thread's
+   instruction count start over, and every thread's random stream restarts as with --trial.
+   Call it outside of parallel regions. */
+void FLIPIT_TrialBegin(uint64_t trial) {
+    flipit_thread_t* t;
+
+    FLIPIT_Trial = trial;
+    for (t = __atomic_load_n(&FLIPIT_Threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+        t->attempts = 0;
+        flipit_seedThread(t);
+    }
+    FLIPIT_TotalInsts = 0;
+    if (FLIPIT_CountdownActive)
+        __atomic_store_n(&FLIPIT_InjCountdown, FLIPIT_CountdownStart, __ATOMIC_RELAXED);
+
+    FLIPIT_TrialSite = UINT32_MAX;
+    FLIPIT_TrialBit = 0;
+    FLIPIT_InTrial = 1;
+#ifdef FLIPIT_MPI
+    FLIPIT_TrialMessage = UINT64_MAX;
+    FLIPIT_TrialMessageInsts = UINT64_MAX;
+    FLIPIT_TrialMessageDest = FLIPIT_MSG_ALL;
+    __atomic_store_n(&FLIPIT_NumMessages, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&FLIPIT_MsgDiverged, 0, __ATOMIC_RELAXED);
+#endif
+    __atomic_store_n(&FLIPIT_LastInjection.injection, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&FLIPIT_InjectionCount, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&FLIPIT_RankInject, FLIPIT_RankInjectStart, __ATOMIC_RELAXED);
+    __atomic_store_n(&FLIPIT_REMAIN_INJECT_COUNT, FLIPIT_MaxInjections, __ATOMIC_RELEASE);
+    flipit_updateArmed();
+}
+
+/* End the current trial with outcome (FLIPIT_OUTCOME_* or an application defined value) and
+   record it. No faults are injected until the next FLIPIT_TrialBegin. Returns the number of
+   injections made in the trial. */
+int FLIPIT_TrialEnd(int outcome) {
+    flipit_trial_result_t* result;
+    uint32_t injections = __atomic_load_n(&FLIPIT_InjectionCount, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&FLIPIT_REMAIN_INJECT_COUNT, 0, __ATOMIC_RELEASE);
+    flipit_updateArmed();
+    if (!FLIPIT_InTrial)
+        return injections;
+    FLIPIT_InTrial = 0;
+
+    if (FLIPIT_NumTrialResults == FLIPIT_MaxTrialResults) {
+        FLIPIT_MaxTrialResults = FLIPIT_MaxTrialResults == 0 ? 1024 : 2 * FLIPIT_MaxTrialResults;
+        FLIPIT_TrialResults = (flipit_trial_result_t*) realloc(FLIPIT_TrialResults,
+                                    sizeof(flipit_trial_result_t) * FLIPIT_MaxTrialResults);
+    }
+    result = &FLIPIT_TrialResults[FLIPIT_NumTrialResults++];
+    result->trial = FLIPIT_Trial;
+    result->dynInsts = FLIPIT_TotalInsts;
+    result->injections = injections;
+    result->site = FLIPIT_TrialSite;
+    result->bit = FLIPIT_TrialBit;
+    result->outcome = outcome;
+#ifdef FLIPIT_MPI
+    result->message = FLIPIT_TrialMessage;
+    result->messageInsts = FLIPIT_TrialMessageInsts;
+    result->messageDest = FLIPIT_TrialMessageDest;
+#else
+    result->message = UINT64_MAX;
+    result->messageInsts = UINT64_MAX;
+    result->messageDest = -1;
+#endif
+    return injections;
+}
+
+/* The results of all trials ended so far; the table belongs to the runtime */
+int FLIPIT_GetTrialResults(const flipit_trial_result_t** results) {
+    *results = FLIPIT_TrialResults;
+    return FLIPIT_NumTrialResults;
+}
+
+void FLIPIT_WriteTrialResults(char* filename) {
+    uint32_t i;
+    FILE* outfile = fopen(filename, "w");
+    if (outfile == NULL) {
+        fprintf(stderr, "FlipIt: unable to write trial results %s\n", filename);
+        return;
+    }
+    fprintf(outfile, "# trial outcome injections site bit dynInsts message messageDest "
+                     "messageInsts\n");
+    for (i = 0; i < FLIPIT_NumTrialResults; i++) {
+        flipit_trial_result_t* r = &FLIPIT_TrialResults[i];
+        fprintf(outfile, "%llu %d %u %d %u %llu %lld %d %lld\n", (unsigned long long) r->trial,
+                r->outcome, r->injections, r->site == UINT32_MAX ? -1 : (int) r->site, r->bit,
+                (unsigned long long) r->dynInsts,
+                r->message == UINT64_MAX ? -1LL : (long long) r->message, r->messageDest,
+                r->messageInsts == UINT64_MAX ? -1LL : (long long) r->messageInsts);
+    }
+    fclose(outfile);
+}
+
+/* Dynamic instructions of thread t since the latest injection, or UINT64_MAX if unknown: there
+   was no injection yet, it was made by another thread (the counts are per thread), or the runtime
+   disarmed since and a module does not count its sites while disarmed. */
+static uint64_t flipit_injectionLatency(uint32_t injection, flipit_thread_t* t, uint64_t dynInsts) {
+    if (injection == 0 || FLIPIT_LastInjection.thread != t->id)
+        return UINT64_MAX;
+    if (&FLIPIT_InexactInsts != NULL && FLIPIT_LastInjection.disarms
+                                        != __atomic_load_n(&FLIPIT_Disarms, __ATOMIC_RELAXED))
+        return UINT64_MAX;
+    return dynInsts - FLIPIT_LastInjection.dynInsts;
+}
+
+/* Record that detector found an error. The detection is logged with its latency since the latest
+   injection; the latency in dynamic instructions is returned, or -1 if it is unknown (see
+   flipit_injectionLatency). */
+long long FLIPIT_Detected(const char* detector) {
+    uint64_t cycles = flipit_cycles();
+    uint64_t dynInsts = FLIPIT_TotalInsts;
+    flipit_thread_t* t = flipit_thread();
+    uint32_t injection = __atomic_load_n(&FLIPIT_LastInjection.injection, __ATOMIC_ACQUIRE);
+    uint32_t id = flipit_detectorId(detector);
+    const char* name = id != FLIPIT_DETECTOR_OVERFLOW ? FLIPIT_Detectors[id]
+                     : detector != NULL ? detector : "---";
+    uint64_t latency;
+    struct timespec now;
+    uint64_t time;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    latency = flipit_injectionLatency(injection, t, dynInsts);
+
+    if (FLIPIT_EventFd >= 0) {
+        uint64_t pos;
+        flipit_event_t* e = flipit_reserveEvent(&pos);
+        e->site = injection != 0 ? FLIPIT_LastInjection.site : UINT64_MAX;
+        e->dynInsts = dynInsts;
+        e->time = time;
+        e->prob = injection != 0 ? (double) (cycles - FLIPIT_LastInjection.cycles) : -1.;
+        e->p = injection != 0 ? (double) (time - FLIPIT_LastInjection.time) : -1.;
+        e->rank = FLIPIT_Rank;
+        e->thread = t->id;
+        e->injection = injection;
+        e->bit = id;
+        e->kind = FLIPIT_EVENT_DETECTION;
+        e->type = 0;
+        e->aux = latency;
+        flipit_publishEvent(pos);
+    }
+
+    if (FLIPIT_Banner) {
+        if (latency != UINT64_MAX)
+            printf("FlipIt: detected by %s %llu instructions after injection %u\n",
+                   name, (unsigned long long) latency, injection);
+        else
+            printf("FlipIt: detected by %s\n", name);
+    }
+    return latency == UINT64_MAX ? -1 : (long long) latency;
+}
+
+/* Register count elements at data as an output of the application, compared with the golden
+   run within tolerance (absolute, ignored for FLIPIT_OUTPUT_BYTES). Returns the output's number,
+   or -1 if there are too many outputs. */
+int FLIPIT_RegisterOutput(char* name, void* data, uint64_t count, int type, double tolerance) {
+    flipit_output_t* out;
+    if (FLIPIT_NumOutputs == FLIPIT_MAX_OUTPUTS || type < FLIPIT_OUTPUT_BYTES
+        || type > FLIPIT_OUTPUT_DOUBLE) {
+        fprintf(stderr, "FlipIt: unable to register output %s\n", name);
+        return -1;
+    }
+    out = &FLIPIT_Outputs[FLIPIT_NumOutputs];
+    memset(out, 0, sizeof(flipit_output_t));
+    strncpy(out->name, name, sizeof(out->name) - 1);
+    out->data = data;
+    out->count = count;
+    out->type = type;
+    out->tolerance = type == FLIPIT_OUTPUT_BYTES ? 0. : tolerance;
+    return FLIPIT_NumOutputs++;
+}
+
+/* Write the registered outputs to (write = FLIPIT_ON), or compare them with (FLIPIT_OFF), the
+   golden file <filename>_<rank> at FLIPIT_CheckOutputs or FLIPIT_Finalize. */
+void FLIPIT_SetGolden(char* filename, int write) {
+    FLIPIT_GoldenFile = filename;
+    FLIPIT_WriteGolden = write == FLIPIT_ON;
+}
+
+/* Write or compare the registered outputs now. Returns FLIPIT_OUTCOME_BENIGN or
+   FLIPIT_OUTCOME_SDC, or -1 if the golden file can't be used. */
+int FLIPIT_CheckOutputs() {
+    FLIPIT_OutputsChecked = 1;
+    if (FLIPIT_GoldenFile == NULL)
+        return -1;
+    return FLIPIT_WriteGolden ? flipit_writeGolden() : flipit_compareGolden();
+}
+
+int FLIPIT_GetOutputResult(int output, flipit_output_result_t* result) {
+    if (output < 0 || (uint32_t) output >= FLIPIT_NumOutputs)
+        return -1;
+    *result = FLIPIT_Outputs[output].result;
+    return 0;
+}
+
+/* Register bytes at data as memory the upsets of --memRate and --memInsts may hit, e.g. a
+   solver's arrays or a stack buffer. Registering data again replaces its region. Returns the
+   region's number, or -1 if there are too many regions. */
+int FLIPIT_RegisterRegion(void* data, uint64_t bytes, const char* label) {
+    flipit_region_t* r = NULL;
+    uint32_t i;
+    int id;
+
+    flipit_lock(&FLIPIT_RegionLock);
+    for (i = 0; i < FLIPIT_NumRegions && r == NULL; i++)
+        if (FLIPIT_Regions[i].data == data)
+            r = &FLIPIT_Regions[i];
+    if (r == NULL && FLIPIT_NumRegions < FLIPIT_MAX_REGIONS) {
+        r = &FLIPIT_Regions[FLIPIT_NumRegions++];
+        r->bytes = 0;
+    }
+    if (r == NULL) {
+        __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+        fprintf(stderr, "FlipIt: unable to register region %s\n", label != NULL ? label : "");
+        return -1;
+    }
+    FLIPIT_RegionBytes += bytes - r->bytes;
+    r->data = (uint8_t*) data;
+    r->bytes = bytes;
+    r->id = FLIPIT_NextRegion++;
+    strncpy(r->label, label != NULL ? label : "", sizeof(r->label) - 1);
+    r->label[sizeof(r->label) - 1] = '\0';
+    id = r->id;
+    __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+    /* the wait of --memRate is drawn again for the new bytes */
+    if (__atomic_load_n(&FLIPIT_MemRunning, __ATOMIC_ACQUIRE) && FLIPIT_MemCounter < 0)
+        sem_post(&FLIPIT_MemWake);
+    return id;
+}
+
+/* Stop upsets in the region registered at data, e.g. before it is freed or goes out of scope */
+void FLIPIT_UnregisterRegion(void* data) {
+    flipit_lock(&FLIPIT_RegionLock);
+    flipit_removeRegion(data);
+    __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+}
+
+/* Drop the region registered at data, with FLIPIT_RegionLock held */
+static void flipit_removeRegion(void* data) {
+    uint32_t i;
+
+    for (i = 0; i < FLIPIT_NumRegions; i++) {
+        if (FLIPIT_Regions[i].data != data)
+            continue;
+        FLIPIT_RegionBytes -= FLIPIT_Regions[i].bytes;
+        FLIPIT_Regions[i] = FLIPIT_Regions[--FLIPIT_NumRegions];
+        break;
+    }
+}
+
+#ifdef FLIPIT_MPI
+/* Share the injection budget (FLIPIT_SetMaxInjections) among the ranks of comm, and with
+   --globalCounts inject at one dynamic instruction of the job: --globalTarget, or else one drawn
+   uniformly. --globalInsts 0 only counts the instructions of each rank. Collective. FLIPIT_Init
+   calls it for MPI_COMM_WORLD when one of these options is given; call it after FLIPIT_Init for
+   another communicator. */
+void FLIPIT_SetGlobalComm(MPI_Comm comm) {
+    int rank, size, initialized;
+    uint64_t target = FLIPIT_GlobalTarget, total = 0, span[2] = {0, 0};
+    uint64_t* counts = NULL;
+    uint64_t* spans = NULL;
+    /* 0 to share the budget only, 1 to inject at the target, 2 to count */
+    uint8_t mode = FLIPIT_GlobalInsts == 0 && target == UINT64_MAX ? 2
+                   : FLIPIT_GlobalInsts != UINT64_MAX || target != UINT64_MAX
+                     || FLIPIT_GlobalCounts != NULL;
+    int i;
+
+    PMPI_Initialized(&initialized);
+    if (!initialized) {
+        fprintf(stderr, "FlipIt: MPI must be initialized for job-wide injections\n");
+        return;
+    }
+    flipit_freeGlobal();
+    PMPI_Comm_dup(comm, &FLIPIT_GlobalComm);
+    PMPI_Comm_rank(FLIPIT_GlobalComm, &rank);
+    PMPI_Comm_size(FLIPIT_GlobalComm, &size);
+    PMPI_Win_allocate(rank == 0 ? sizeof(uint64_t) : 0, sizeof(uint64_t), MPI_INFO_NULL,
+                      FLIPIT_GlobalComm, &FLIPIT_GlobalCounters, &FLIPIT_GlobalWin);
+
+    if (rank == 0) {
+        FLIPIT_GlobalCounters[0] = FLIPIT_MaxInjections;
+        if (mode == 1) {
+            counts = (uint64_t*) malloc(size * sizeof(uint64_t));
+            spans = (uint64_t*) malloc(2 * size * sizeof(uint64_t));
+            if (!flipit_readGlobalCounts(counts, size))
+                mode = 0;
+        }
+        if (mode == 1) {
+            for (i = 0; i < size; i++) {
+                spans[2*i] = total;
+                spans[2*i + 1] = counts[i];
+                total += counts[i];
+            }
+            if (FLIPIT_GlobalInsts != UINT64_MAX && FLIPIT_GlobalInsts != total)
+                fprintf(stderr, "FlipIt: --globalInsts %llu differs from the %llu instructions "
+                        "of %s, using those\n", (unsigned long long) FLIPIT_GlobalInsts,
+                        (unsigned long long) total, FLIPIT_GlobalCounts);
+            /* drawn from rank 0's seed and trial on a stream of its own */
+            if (target == UINT64_MAX && total > 0) {
+                uint32_t r[4];
+                flipit_streamBlock(0, 0xFFFF, UINT32_MAX, r);
+                target = (uint64_t) ((double) ((((uint64_t) r[0] << 32) | r[1]) >> 11)
+                                     * (1.0 / 9007199254740992.0) * total);
+            }
+            if (target >= total)
+                fprintf(stderr, "FlipIt: the job has no instruction %llu\n",
+                        (unsigned long long) target);
+        }
+        free(counts);
+    }
+    PMPI_Bcast(&mode, 1, MPI_UINT8_T, 0, FLIPIT_GlobalComm);
+    PMPI_Bcast(&target, 1, MPI_UINT64_T, 0, FLIPIT_GlobalComm);
+    if (mode == 1)
+        PMPI_Scatter(spans, 2, MPI_UINT64_T, span, 2, MPI_UINT64_T, 0, FLIPIT_GlobalComm);
+    free(spans);
+    PMPI_Win_lock_all(MPI_MODE_NOCHECK, FLIPIT_GlobalWin);
+
+    FLIPIT_GlobalTarget = target;
+    FLIPIT_GlobalNext = 0;
+    FLIPIT_GlobalLocal = UINT64_MAX;
+    FLIPIT_Global = 1;
+    if (mode != 0)
+        FLIPIT_SetFaultProbability(flipit_globalCountdown);
+    if (mode == 1) {
+        /* the other ranks cannot inject and stop calling into the runtime */
+        if (target >= span[0] && target - span[0] < span[1])
+            FLIPIT_GlobalLocal = target - span[0];
+        else
+            __atomic_store_n(&FLIPIT_RankInject, 0, __ATOMIC_RELAXED);
+        flipit_updateArmed();
+    }
+    if (rank == 0) {
+        if (mode == 0)
+            printf("FlipIt: %u injections shared by the job\n", FLIPIT_MaxInjections);
+        else if (mode == 2)
+            printf("FlipIt: counting the dynamic instructions of the job\n");
+        else
+            printf("FlipIt: injecting at dynamic instruction %llu of the job\n",
+                   (unsigned long long) target);
+    }
+}
+
+/* Reads the instructions of each rank from --globalCounts, as written by flipit_finishGlobal */
+static uint8_t flipit_readGlobalCounts(uint64_t* counts, int size) {
+    unsigned long long count;
+    unsigned int rank;
+    int n = 0;
+    FILE* infile;
+
+    if (FLIPIT_GlobalCounts == NULL) {
+        fprintf(stderr, "FlipIt: a job-wide target needs the instructions of each rank "
+                "(--globalCounts) of a run with --globalInsts 0\n");
+        return 0;
+    }
+    infile = fopen(FLIPIT_GlobalCounts, "r");
+    if (infile == NULL) {
+        fprintf(stderr, "FlipIt: unable to open %s\n", FLIPIT_GlobalCounts);
+        return 0;
+    }
+    while (fscanf(infile, "%u %llu", &rank, &count) == 2 && rank == (unsigned int) n && n < size)
+        counts[n++] = count;
+    fclose(infile);
+    if (n != size)
+        fprintf(stderr, "FlipIt: %s does not have the instructions of %d ranks\n",
+                FLIPIT_GlobalCounts, size);
+    return n == size;
+}
+#endif
+
 /***********************************************************************************************/
 /* User callable function for FORTRAN wrapper                                              */
 /***********************************************************************************************/
@@ -218,6 +1312,94 @@ int flipit_countdowntimer_ftn_(unsigned long* numInstructions) {
     return 0;
 }
 
+int flipit_setthreadid_ftn_(int* id) {
+    FLIPIT_SetThreadId(*id);
+    
+    return 0;
+}
+
+int flipit_setsampler_ftn_(int* sampler) {
+    FLIPIT_SetSampler(*sampler);
+    
+    return 0;
+}
+
+int flipit_seteventlog_ftn_(char** prefix) {
+    if (prefix != NULL)
+        FLIPIT_SetEventLog(*prefix);
+    else
+        FLIPIT_SetEventLog(NULL);
+
+    return 0;
+}
+
+int flipit_addsitelog_ftn_(char** path) {
+    if (path != NULL)
+        return FLIPIT_AddSiteLog(*path);
+
+    return 0;
+}
+
+int flipit_setbanner_ftn_(int* state) {
+    FLIPIT_SetBanner(*state);
+    
+    return 0;
+}
+
+int flipit_trialbegin_ftn_(unsigned long long* trial) {
+    FLIPIT_TrialBegin(*trial);
+    
+    return 0;
+}
+
+int flipit_trialend_ftn_(int* outcome) {
+    return FLIPIT_TrialEnd(*outcome);
+}
+
+int flipit_writetrialresults_ftn_(char** filename) {
+    if (filename != NULL)
+        FLIPIT_WriteTrialResults(*filename);
+    
+    return 0;
+}
+
+long long flipit_detected_ftn_(char** detector) {
+    return FLIPIT_Detected(detector != NULL ? *detector : NULL);
+}
+
+int flipit_registeroutput_ftn_(char** name, void* data, long long* count, int* type,
+                               double* tolerance) {
+    return FLIPIT_RegisterOutput(*name, data, *count, *type, *tolerance);
+}
+
+int flipit_setgolden_ftn_(char** filename, int* write) {
+    FLIPIT_SetGolden(*filename, *write);
+    
+    return 0;
+}
+
+int flipit_checkoutputs_ftn_() {
+    return FLIPIT_CheckOutputs();
+}
+
+int flipit_registerregion_ftn_(void* data, long long* bytes, char** label) {
+    return FLIPIT_RegisterRegion(data, *bytes, label != NULL ? *label : NULL);
+}
+
+int flipit_unregisterregion_ftn_(void* data) {
+    FLIPIT_UnregisterRegion(data);
+
+    return 0;
+}
+
+#ifdef FLIPIT_MPI
+int flipit_setglobalcomm_ftn_(MPI_Fint* comm) {
+    FLIPIT_SetGlobalComm(MPI_Comm_f2c(*comm));
+    
+    return 0;
+}
+#endif
+
 
 /***********************************************************************************************/
 /* The functions below this are used internally by FlipIt                                      */
@@ -241,11 +1423,81 @@ static void flipit_parseArgs(uint32_t argc, char** argv) {
         else if (strcmp("--numberFaultLoc", argv[i]) == 0 || strcmp("-nLOC", argv[i]) == 0)
             FLIPIT_NumFaultSites = atoi(argv[++i]);
         else if (strcmp("--faultyLoc", argv[i]) == 0 || strcmp("-fLOC", argv[i]) == 0) {
-            FLIPIT_FaultSites = (uint32_t*) malloc( sizeof(uint32_t) * FLIPIT_NumFaultSites);
+            FLIPIT_SelectSites = 1;
             for(j = 0; j < FLIPIT_NumFaultSites; j++) 
-                FLIPIT_FaultSites[j] = atoi(argv[i + j + 1]);
+                flipit_addFaultSites(strtoul(argv[i + j + 1], NULL, 10),
+                                     strtoul(argv[i + j + 1], NULL, 10));
             i += j;
         }
+        else if (strcmp("--faultyLocFile", argv[i]) == 0 || strcmp("-fLOCF", argv[i]) == 0) {
+            FLIPIT_SelectSites = 1;
+            flipit_readFaultSiteFile(argv[++i]);
+        }
+        else if (strcmp("--global", argv[i]) == 0 || strcmp("-gl", argv[i]) == 0)
+            FLIPIT_GlobalRequested = 1;
+        else if (strcmp("--globalInsts", argv[i]) == 0 || strcmp("-gI", argv[i]) == 0) {
+            FLIPIT_GlobalRequested = 1;
+            FLIPIT_GlobalInsts = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp("--globalTarget", argv[i]) == 0 || strcmp("-gT", argv[i]) == 0) {
+            FLIPIT_GlobalRequested = 1;
+            FLIPIT_GlobalTarget = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp("--globalCounts", argv[i]) == 0 || strcmp("-gC", argv[i]) == 0) {
+            FLIPIT_GlobalRequested = 1;
+            FLIPIT_GlobalCounts = argv[++i];
+        }
+        else if (strcmp("--mpiProb", argv[i]) == 0 || strcmp("-mP", argv[i]) == 0) {
+            FLIPIT_MPIProb = atof(argv[++i]);
+            if (FLIPIT_MPIFaults == 0)
+                FLIPIT_MPIFaults = FLIPIT_MPI_ALL;
+        }
+        else if (strcmp("--mpiFaults", argv[i]) == 0 || strcmp("-mF", argv[i]) == 0)
+            flipit_parseMPIFaults(argv[++i]);
+        else if (strcmp("--mpiSiteLog", argv[i]) == 0 || strcmp("-mSL", argv[i]) == 0)
+            FLIPIT_MPISiteLog = argv[++i];
+        else if (strcmp("--msgLog", argv[i]) == 0 || strcmp("-mL", argv[i]) == 0) {
+            FLIPIT_MsgLog = argv[++i];
+            FLIPIT_WriteMsgLog = 0;
+        }
+        else if (strcmp("--writeMsgLog", argv[i]) == 0 || strcmp("-wML", argv[i]) == 0) {
+            FLIPIT_MsgLog = argv[++i];
+            FLIPIT_WriteMsgLog = 1;
+        }
+        else if (strcmp("--memRate", argv[i]) == 0 || strcmp("-mR", argv[i]) == 0)
+            FLIPIT_MemRate = atof(argv[++i]);
+        else if (strcmp("--memInsts", argv[i]) == 0 || strcmp("-mI", argv[i]) == 0)
+            FLIPIT_MemInsts = strtoull(argv[++i], NULL, 10);
+        else if (strcmp("--memHeap", argv[i]) == 0 || strcmp("-mH", argv[i]) == 0)
+            FLIPIT_MemHeap = strtoull(argv[++i], NULL, 10);
+        else if (strcmp("--memSiteLog", argv[i]) == 0 || strcmp("-memSL", argv[i]) == 0)
+            FLIPIT_MemSiteLog = argv[++i];
+        else if (strcmp("--trial", argv[i]) == 0 || strcmp("-tr", argv[i]) == 0)
+            FLIPIT_Trial = strtoull(argv[++i], NULL, 10);
+        else if (strcmp("--geometric", argv[i]) == 0 || strcmp("-geo", argv[i]) == 0)
+            FLIPIT_Sampler = FLIPIT_SAMPLE_GEOMETRIC;
+        else if (strcmp("--eventLog", argv[i]) == 0 || strcmp("-eL", argv[i]) == 0)
+            FLIPIT_SetEventLog(argv[++i]);
+        else if (strcmp("--siteLog", argv[i]) == 0 || strcmp("-sL", argv[i]) == 0)
+            FLIPIT_AddSiteLog(argv[++i]);
+        else if (strcmp("--noBanner", argv[i]) == 0 || strcmp("-nB", argv[i]) == 0)
+            FLIPIT_Banner = FLIPIT_OFF;
+        else if (strcmp("--golden", argv[i]) == 0 || strcmp("-g", argv[i]) == 0)
+            FLIPIT_SetGolden(argv[++i], FLIPIT_OFF);
+        else if (strcmp("--writeGolden", argv[i]) == 0 || strcmp("-wG", argv[i]) == 0)
+            FLIPIT_SetGolden(argv[++i], FLIPIT_ON);
+        else if (strcmp("--trialResults", argv[i]) == 0 || strcmp("-tR", argv[i]) == 0)
+            FLIPIT_TrialResultFile = argv[++i];
+        else if (strcmp("--forkServer", argv[i]) == 0 || strcmp("-fS", argv[i]) == 0)
+            FLIPIT_ForkTrialFile = argv[++i];
+        else if (strcmp("--checkpoint", argv[i]) == 0 || strcmp("-cP", argv[i]) == 0)
+            flipit_addCheckpoint(strtoull(argv[++i], NULL, 10));
+        else if (strcmp("--forkResults", argv[i]) == 0 || strcmp("-fR", argv[i]) == 0)
+            FLIPIT_ForkResultFile = argv[++i];
+        else if (strcmp("--forkJobs", argv[i]) == 0 || strcmp("-fJ", argv[i]) == 0)
+            FLIPIT_ForkJobs = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+        else if (strcmp("--forkTimeout", argv[i]) == 0 || strcmp("-fT", argv[i]) == 0)
+            FLIPIT_ForkTimeout = atoi(argv[++i]);
         else if (strcmp("--stateFile", argv[i]) == 0 || strcmp("-sF", argv[i]) == 0) {
             int len = strlen(argv[i]) + 1;
             FLIPIT_StateFile = (char*) malloc(sizeof(char)*len);
@@ -269,252 +1521,2449 @@ static void flipit_parseArgs(uint32_t argc, char** argv) {
     {
         for (i=0; i<argc; i++)
             printf("Arg[%d] = %s\n", i, argv[i]);
-        if (FLIPIT_FaultSites == NULL)
+        if (!FLIPIT_SelectSites)
             printf("NULL\n");
         else
-            printf("Faulty sites(%d):\n", FLIPIT_NumFaultSites);
-        for (i = 0; i < FLIPIT_NumFaultSites; i++)
-            printf("%d\n", FLIPIT_FaultSites[i] );
+            printf("Faulty site ranges(%u):\n", FLIPIT_NumSiteRanges);
+        for (i = 0; i < FLIPIT_NumSiteRanges; i++)
+            printf("%u-%u\n", FLIPIT_FaultSites[2*i], FLIPIT_FaultSites[2*i + 1]);
         printf("Num faulty = %d\n", numFaulty);
     } 
 #endif
+    flipit_buildSiteMap();
 }
 
-static uint8_t flipit_shouldInjectNoCheck() {
-    FLIPIT_TotalInsts++;                                    //CS
-    if ((0 == FLIPIT_State)
-        || (0 == FLIPIT_RankInject)
-        || (0 == FLIPIT_REMAIN_INJECT_COUNT))  //CS
-        return 0;
-    FLIPIT_Attempts++;                                      //CS
-    return 1;   
+/* Comma separated kinds of MPI faults, e.g. "send,recv,count,tag,reduce" or "all" */
+static void flipit_parseMPIFaults(char* kinds) {
+    const char* names[] = { "send", "recv", "count", "tag", "reduce", "all" };
+    const uint32_t masks[] = { FLIPIT_MPI_SEND, FLIPIT_MPI_RECV, FLIPIT_MPI_COUNT, FLIPIT_MPI_TAG,
+                               FLIPIT_MPI_REDUCE, FLIPIT_MPI_ALL };
+    char* copy = strdup(kinds);
+    char* kind;
+    int j;
+
+    FLIPIT_MPIFaults = 0;
+    for (kind = strtok(copy, ","); kind != NULL; kind = strtok(NULL, ",")) {
+        for (j = 0; j < 6 && strcmp(kind, names[j]) != 0; j++) {}
+        if (j < 6)
+            FLIPIT_MPIFaults |= masks[j];
+        else if (FLIPIT_Rank == 0)
+            fprintf(stderr, "FlipIt: unknown kind of MPI fault %s\n", kind);
+    }
+    free(copy);
 }
 
+/* one past the largest site index of the instrumented objects in the binary */
+static uint64_t flipit_linkedSites() {
+    return FLIPIT_LinkedSites;
+}
 
-static uint8_t flipit_checkActiveFaultSite(uint32_t fault_index) {
-/*
-    FLIPIT_TotalInsts++;                                    //CS
-    if ((0 == FLIPIT_State) || (0 == FLIPIT_RankInject) || (0 == FLIPIT_REMAIN_INJECT_COUNT)) //CS
-        return 0;
+static int flipit_compareModules(const void* a, const void* b) {
+    const flipit_site_table_t* x = *(const flipit_site_table_t**) a;
+    const flipit_site_table_t* y = *(const flipit_site_table_t**) b;
+    if (x->module != y->module)
+        return x->module < y->module ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
 
-    uint32_t index = fault_index / FLIPIT_char_type_size;
-    uint8_t bit = fault_index % FLIPIT_char_type_size;
-    uint8_t inject = (FLIPIT_FaultSites[index] & (0x1 << (bit))) >> (bit);
-    FLIPIT_Attempts += inject;                              //CS
-    return inject;
-*/
-/*
-    int inject_once = FLIPIT_MaxInjections == 1;
-    int i;
-    int inject = flipit_shouldInjectNoCheck();
-    FLIPIT_TotalInsts++;
-    if (!inject)
-        return 0;
-*/
-    /* check fault index site */
-    int inject = 0;
-    int i = 0;
-    if (FLIPIT_FaultSites != NULL) {
-        for (i = 0; i < FLIPIT_NumFaultSites; i++)
-            if (FLIPIT_FaultSites[i] == fault_index) {
-                inject = 1;
-                break;
-            }
+static void flipit_numberSites() {
+    const flipit_site_table_t** modules;
+    uint64_t i, n, base = 0;
+
+    if (__start_flipit_sites == NULL || __stop_flipit_sites == NULL)
+        return;
+    n = __stop_flipit_sites - __start_flipit_sites;
+    modules = (const flipit_site_table_t**) malloc(n * sizeof(flipit_site_table_t*));
+    for (i = 0; i < n; i++)
+        modules[i] = &__start_flipit_sites[i];
+    qsort(modules, n, sizeof(flipit_site_table_t*), flipit_compareModules);
+    for (i = 0; i < n; i++) {
+        *modules[i]->base = (uint32_t) base;
+        base += modules[i]->numSites;
     }
-    else
-        inject = 1;
-    
-    //FLIPIT_Attempts += inject;
-    return inject;
-}
-
-static void flipit_print_injectedErr(char* type, unsigned int bPos, int fault_index, double prob,
-                                     double p) {
-    printf("\n/*********************************Start**************************************/\n"
-            "\nSuccessfully injected %s error!!\nRank: %d\n"
-            "Total # faults injected: %d\n" 
-            "Bit position is: %u\n"
-            "Index of the fault site: %d\n"
-            "Fault site probability: %e\n"
-            "Chosen random probability is: %e\n" 
-            "Attempts since last injection: %lu\n", type, FLIPIT_Rank, FLIPIT_InjectionCount,
-                                                    bPos, fault_index, 
-            prob, p, FLIPIT_Attempts);   
-    if (FLIPIT_CustomLogger != NULL)
-        FLIPIT_CustomLogger(stdout);
-    printf("\n/*********************************End**************************************/\n");
+    free(modules);
+    for (i = 0; i < n; i++)
+        if (__start_flipit_sites[i].module < FLIPIT_RUNTIME_MODULE)
+            FLIPIT_ProgramSites += __start_flipit_sites[i].numSites;
+    if (base > UINT32_MAX)
+        fprintf(stderr, "FlipIt: %llu fault sites do not fit 32 bit indexes\n",
+                (unsigned long long) base);
+    FLIPIT_LinkedSites = base;
 }
 
-static double flipit_countdown() {
-    return (double) --FLIPIT_InjCountdown;
+/* Prints where the site is in the source, and each call site it was inlined into */
+static void flipit_printSite(uint32_t fault_index) {
+    flipit_site_info_t info;
+    uint32_t i, loc;
+
+    if (fault_index == FLIPIT_MemBase) {
+        printf("Fault site: byte %llu of %llu of region %u (%s) at rest\n",
+               (unsigned long long) FLIPIT_MemUpsetOffset,
+               (unsigned long long) FLIPIT_MemUpset.bytes, FLIPIT_MemUpset.id,
+               FLIPIT_MemUpset.label);
+        return;
+    }
+#ifdef FLIPIT_MPI
+    if (fault_index - FLIPIT_MPIBase < FLIPIT_MPI_NUM_SITES) {
+        const flipit_runtime_site_t* site = &FLIPIT_MPISites[fault_index - FLIPIT_MPIBase];
+        printf("Fault site: %s in %s\n", site->part, site->function);
+        return;
+    }
+#endif
+
+    for (i = 0; i < FLIPIT_NumSiteLogs; i++) {
+        if (fault_index < FLIPIT_SiteLogs[i].base ||
+            !flipit_sitelogSite(FLIPIT_SiteLogs[i].log, fault_index - FLIPIT_SiteLogs[i].base, &info))
+            continue;
+        printf("Fault site: %s in %s at %s:%u:%u\n", info.opcode, info.function,
+               info.file[0] != '\0' ? info.file : "??", info.line, info.column);
+        for (loc = info.inlinedAt; loc != FLIPIT_SITELOG_NONE; ) {
+            const char* file;
+            uint32_t line, column;
+            loc = flipit_sitelogLocation(FLIPIT_SiteLogs[i].log, loc, &file, &line, &column);
+            printf("    inlined at %s:%u:%u\n", file, line, column);
+        }
+        return;
+    }
 }
 
-static void flipit_countdownLogger(FILE* outfile) {
-    if (FLIPIT_CountdownCustomLogger != NULL)
-        FLIPIT_CountdownCustomLogger(outfile);
-    FLIPIT_InjCountdown = FLIPIT_Attempts;
+static void flipit_addFaultSites(uint32_t first, uint32_t last) {
+    uint32_t tmp;
+    if (first > last) {
+        tmp = first; first = last; last = tmp;
+    }
+    if (FLIPIT_NumSiteRanges == FLIPIT_MaxSiteRanges) {
+        FLIPIT_MaxSiteRanges = FLIPIT_MaxSiteRanges == 0 ? 64 : 2 * FLIPIT_MaxSiteRanges;
+        FLIPIT_FaultSites = (uint32_t*) realloc(FLIPIT_FaultSites,
+                                    sizeof(uint32_t) * 2 * FLIPIT_MaxSiteRanges);
+    }
+    FLIPIT_FaultSites[2*FLIPIT_NumSiteRanges] = first;
+    FLIPIT_FaultSites[2*FLIPIT_NumSiteRanges + 1] = last;
+    FLIPIT_NumSiteRanges++;
 }
 
-/***********************************************************************************************/
-/* The functions below this are inserted by the compiler pass to flip a bit                    */
-/***********************************************************************************************/
+/* Reads whitespace separated site indexes or inclusive ranges (e.g. "7 12-40 100") */
+static void flipit_readFaultSiteFile(char* path) {
+    unsigned long first, last;
+    char token[64];
+    FILE* infile = fopen(path, "r");
 
-uint64_t corruptIntData_64bit(uint32_t parameter, double prob, uint64_t inst_data)
-{
+    if (infile == NULL) {
+        fprintf(stderr, "FlipIt: unable to open fault site file %s\n", path);
+        return;
+    }
+    while (fscanf(infile, "%63s", token) == 1) {
+        int n = sscanf(token, "%lu-%lu", &first, &last);
+        /* site indexes are 32 bits */
+        if (first > UINT32_MAX)
+            continue;
+        if (n == 2 && last > UINT32_MAX)
+            last = UINT32_MAX;
+        if (n == 1)
+            flipit_addFaultSites(first, first);
+        else if (n == 2)
+            flipit_addFaultSites(first, last);
+    }
+    fclose(infile);
+}
 
-#ifdef FLIPIT_HISTOGRAM
-    // extract fault_index, byte_val from parameter
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-    FLIPIT_Histogram[fault_index]++;
-#endif
+static void flipit_buildSiteMap() {
+    uint32_t i, site, maxSite = 0;
+
+    if (!FLIPIT_SelectSites)
+        return;
+    for (i = 0; i < FLIPIT_NumSiteRanges; i++)
+        if (FLIPIT_FaultSites[2*i + 1] > maxSite)
+            maxSite = FLIPIT_FaultSites[2*i + 1];
+
+    FLIPIT_SiteMapSize = FLIPIT_NumSiteRanges > 0 ? (uint64_t) maxSite + 1 : 0;
+    FLIPIT_SiteMap = (uint8_t*) calloc(FLIPIT_SiteMapSize / 8 + 1, sizeof(uint8_t));
+    for (i = 0; i < FLIPIT_NumSiteRanges; i++)
+        for (site = FLIPIT_FaultSites[2*i]; ; site++) {
+            FLIPIT_SiteMap[site >> 3] |= 1 << (site & 0x7);
+            if (site == FLIPIT_FaultSites[2*i + 1])
+                break; /* the range may end at UINT32_MAX */
+        }
 
-    // verify that it is the correct time to inject
-    if (0 == flipit_shouldInjectNoCheck()) return inst_data;
-    float p = FLIPIT_FaultProb();
-    if (p > prob) return inst_data;
-#ifndef FLIPIT_HISTOGRAM
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-#endif
-    if (0 == flipit_checkActiveFaultSite(fault_index)) return inst_data;
+    free(FLIPIT_FaultSites);
+    FLIPIT_FaultSites = NULL;
+    FLIPIT_NumSiteRanges = FLIPIT_MaxSiteRanges = 0;
+}
 
-    // determine which bit & byte should be flipped
-    char bit = ((parameter >> 24) & 0xF); 
-    char byte = ((parameter >> 28) & 0xF);
-    //printf("###Byte = %d, Bit = %d\n", byte, bit);            
+static void flipit_updateArmed() {
+    /* the fork server counts every site */
+    uint32_t armed = FLIPIT_ForkRole == FLIPIT_FORK_SERVER || ((0 != FLIPIT_State)
+                    && (0 != __atomic_load_n(&FLIPIT_RankInject, __ATOMIC_RELAXED))
+                    && (0 != __atomic_load_n(&FLIPIT_REMAIN_INJECT_COUNT, __ATOMIC_RELAXED)));
+    if (0 != __atomic_exchange_n(&FLIPIT_Armed, armed, __ATOMIC_RELAXED) && 0 == armed)
+        __atomic_add_fetch(&FLIPIT_Disarms, 1, __ATOMIC_RELAXED);
+}
 
-    if (bit == 0xF) bit = rand() % 8; //get correct bit
-    if (byte > 7) byte = rand() % (16 - byte); 
+static uint8_t flipit_shouldInjectNoCheck() {
+    FLIPIT_TotalInsts++;
+    if (0 == __atomic_load_n(&FLIPIT_Armed, __ATOMIC_RELAXED))
+        return 0;
+    flipit_thread()->attempts++;
+    return 1;   
+}
 
-    //printf("Byte = %d, Bit = %d\n", byte, bit);            
-    FLIPIT_InjectionCount++;
-    FLIPIT_REMAIN_INJECT_COUNT--;
-    if (FLIPIT_REMAIN_INJECT_COUNT == 0) FLIPIT_RankInject = 0; 
-    
-    flipit_print_injectedErr("Integer Data", byte*8 + bit, fault_index, prob, p);
-    FLIPIT_Attempts = 0;
-    return inst_data ^ ((uint64_t) 0x1L << (byte*8 + bit)); //TODO: correctly wrap for 32, 16, and 8 bit integers
+/* Take one injection from the budget shared by all threads. Returns the number of the
+   injection, or 0 if another thread used the last one. */
+static uint32_t flipit_claimInjection() {
+    uint32_t injection;
+    uint32_t remain = __atomic_load_n(&FLIPIT_REMAIN_INJECT_COUNT, __ATOMIC_RELAXED);
+    do {
+        if (remain == 0)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&FLIPIT_REMAIN_INJECT_COUNT, &remain, remain - 1, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+#ifdef FLIPIT_MPI
+    /* the job-wide budget has the last word */
+    if (FLIPIT_Global && !flipit_claimGlobal()) {
+        __atomic_store_n(&FLIPIT_RankInject, 0, __ATOMIC_RELAXED);
+        flipit_updateArmed();
+        return 0;
+    }
+#endif
+    injection = __atomic_add_fetch(&FLIPIT_InjectionCount, 1, __ATOMIC_RELAXED);
+    if (remain == 1) {
+        __atomic_store_n(&FLIPIT_RankInject, 0, __ATOMIC_RELAXED);
+        flipit_updateArmed();
+    }
+    return injection;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-float corruptFloatData_32bit(uint32_t parameter, double prob, float inst_data)
-{
+static flipit_thread_t* flipit_thread() {
+    if (FLIPIT_Thread == NULL)
+        FLIPIT_Thread = flipit_newThread();
+    return FLIPIT_Thread;
+}
 
+static flipit_thread_t* flipit_newThread() {
+    flipit_thread_t* t;
+    size_t size = (sizeof(flipit_thread_t) + FLIPIT_CACHE_LINE - 1)
+                    / FLIPIT_CACHE_LINE * FLIPIT_CACHE_LINE;
+    if (posix_memalign((void**) &t, FLIPIT_CACHE_LINE, size) != 0) {
+        fprintf(stderr, "FlipIt: unable to allocate thread state\n");
+        exit(1);
+    }
+    memset(t, 0, size);
+    t->id = __atomic_fetch_add(&FLIPIT_NumThreads, 1, __ATOMIC_RELAXED);
+    flipit_seedThread(t);
 #ifdef FLIPIT_HISTOGRAM
-    // extract fault_index, byte_val from parameter
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-    FLIPIT_Histogram[fault_index]++;
+    t->histogram = (uint64_t*) calloc(FLIPIT_MAX_LOC, sizeof(uint64_t));
 #endif
 
-    //TODO: add support for CHECK()
-    if (0 == flipit_shouldInjectNoCheck()) return inst_data;
-    float p = FLIPIT_FaultProb();
-    if (p > prob) return inst_data;
-#ifndef FLIPIT_HISTOGRAM
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-#endif
-    if (0 == flipit_checkActiveFaultSite(fault_index)) return inst_data;
+    /* publish on the list of threads */
+    t->next = __atomic_load_n(&FLIPIT_Threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&FLIPIT_Threads, &t->next, t, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    return t;
+}
 
+/* restart the thread's stream at block 0 */
+static void flipit_seedThread(flipit_thread_t* t) {
+    t->rngCounter = 0;
+    t->rngUsed = 4;
+    t->skipProb = -1.;
+    flipit_drawSkip(t);
+}
 
-    // determine which bit & byte should be flipped
-    char bit = ((parameter >> 24) & 0xF); 
-    char byte = ((parameter >> 28) & 0xF);
+static void flipit_philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t k0 = key[0], k1 = key[1];
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    int r;
+    for (r = 0; r < PHILOX_ROUNDS; r++) {
+        uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t) p1;
+        c3 = (uint32_t) p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
 
-    if (bit == 0xF)
-        bit = rand() % 8; 
-    else
-        bit = bit % 32;
-    if (byte > 7)
-        byte = rand() % 4; // random byte (we know the size)
-    else
-        byte = byte % 4; // wrap fixed byte to sizeof(float) 
-            
-    FLIPIT_InjectionCount++;
-    FLIPIT_REMAIN_INJECT_COUNT--;
-    if (FLIPIT_REMAIN_INJECT_COUNT == 0) FLIPIT_RankInject = 0; 
-    
-    flipit_print_injectedErr("32-bit IEEE Float Data", byte*8 + bit, fault_index, prob, p);
-    FLIPIT_Attempts = 0;
-    
-    int* ptr = (int* ) &inst_data;
-    int tmp  = (*ptr ^ (0x1 << (bit + byte * 8)));
-    float*pf = (float*)&tmp;
-    return *pf;
+/* Block of a stream. The key is the seed and the counter holds the trial, rank, thread and
+   block in words of their own, so no two (seed, trial, rank, thread) share a block as long as
+   trials are below 2^32, thread ids below 2^16 and a stream uses fewer than 2^48 blocks. */
+static void flipit_streamBlock(uint64_t block, uint32_t thread, uint32_t rank, uint32_t out[4]) {
+    uint32_t key[2], counter[4];
+    key[0] = (uint32_t) FLIPIT_Seed;
+    key[1] = (uint32_t) (FLIPIT_Seed >> 32);
+    counter[0] = (uint32_t) block;
+    counter[1] = (uint32_t) (block >> 32 & 0xFFFF) | thread << 16;
+    counter[2] = (uint32_t) FLIPIT_Trial;
+    counter[3] = rank;
+    flipit_philox(counter, key, out);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-double corruptFloatData_64bit(uint32_t parameter, double prob, double inst_data)
-{
+static uint32_t flipit_rand32(flipit_thread_t* t) {
+    if (t->rngUsed == 4) {
+        flipit_streamBlock(t->rngCounter, t->id, FLIPIT_Rank, t->rngBlock);
+        t->rngCounter++;
+        t->rngUsed = 0;
+    }
+    return t->rngBlock[t->rngUsed++];
+}
 
-#ifdef FLIPIT_HISTOGRAM
-    // extract fault_index, byte_val from parameter
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-    FLIPIT_Histogram[fault_index]++;
-#endif
+/* uniform double in [0, 1) with 53 random bits from t's stream */
+static double flipit_uniformOf(flipit_thread_t* t) {
+    uint64_t hi = flipit_rand32(t);
+    uint64_t lo = flipit_rand32(t);
+    return (double) (((hi << 32) | lo) >> 11) * (1.0 / 9007199254740992.0);
+}
 
-    //TODO: add support for CHECK()
-    if (0 == flipit_shouldInjectNoCheck()) return inst_data;
-    float p = FLIPIT_FaultProb();
-    if (p > prob) return inst_data;
-#ifndef FLIPIT_HISTOGRAM
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-#endif
-    if (0 == flipit_checkActiveFaultSite(fault_index)) return inst_data;
+static double flipit_uniform() {
+    return flipit_uniformOf(flipit_thread());
+}
 
-    // determine which bit & byte should be flipped
-    char bit = ((parameter >> 24) & 0xF); //TODO: VERIFY
-    char byte = ((parameter >> 28) & 0xF);
-
-    if (bit == 0xF)
-        bit = rand() % 8; //TODO VEIFY TODO wrap bit
-    if (byte > 7)
-        byte = rand() % 8;
-            
-    FLIPIT_InjectionCount++;
-    FLIPIT_REMAIN_INJECT_COUNT--;
-    if (FLIPIT_REMAIN_INJECT_COUNT == 0) FLIPIT_RankInject = 0; 
-    
-    flipit_print_injectedErr("64-bit IEEE Float Data", byte*8 + bit, fault_index, prob, p);
-    FLIPIT_Attempts = 0;
-    
-	long long* ptr = (long long* ) &inst_data;
-    long long tmp  = (*ptr ^ (0x1L << (byte*8 + bit)));
-    double *pf = (double*)&tmp;
-    return *pf;
+static uint32_t flipit_rand() {
+    return flipit_rand32(flipit_thread());
 }
 
-uint64_t corruptPtr2Int_64bit(uint32_t parameter, double prob, uint64_t inst_data)
-{
 
-#ifdef FLIPIT_HISTOGRAM
-    // extract fault_index, byte_val from parameter
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
-    FLIPIT_Histogram[fault_index]++;
-#endif
+static uint8_t flipit_checkActiveFaultSite(uint32_t fault_index) {
+    /* check fault index site */
+    if (!FLIPIT_SelectSites)
+        return 1;
+    if (fault_index >= FLIPIT_SiteMapSize)
+        return 0;
+    return (FLIPIT_SiteMap[fault_index >> 3] >> (fault_index & 0x7)) & 0x1;
+}
 
-    //TODO: add support for CHECK()
-    if (0 == flipit_shouldInjectNoCheck()) return inst_data;
-    float p = FLIPIT_FaultProb();
-    if (p > prob) return inst_data;
-#ifndef FLIPIT_HISTOGRAM
-    uint32_t fault_index = (uint32_t) (parameter & FAULT_IDX_MASK);
+/* Decide if an armed site with probability prob is faulty; p is the random value used */
+static uint8_t flipit_trigger(double prob, double* p) {
+    /* user supplied probabilities and the countdown timer are evaluated at every site */
+    if (FLIPIT_Sampler != FLIPIT_SAMPLE_GEOMETRIC || !FLIPIT_DefaultFaultProb) {
+        *p = FLIPIT_FaultProb();
+        return !(*p > prob);
+    }
+
+    /* hazard of the site, cached since most sites share the same probability */
+    flipit_thread_t* t = flipit_thread();
+    if (prob != t->skipProb) {
+        t->skipProb = prob;
+        t->skipHazard = prob >= 1. ? INFINITY : -log1p(-prob);
+    }
+    t->skipBudget -= t->skipHazard;
+    if (t->skipBudget >= 0.)
+        return 0;
+
+    *p = t->skipDraw;
+    flipit_drawSkip(t);
+    return 1;
+}
+
+static void flipit_drawSkip(flipit_thread_t* t) {
+    t->skipDraw = 1. - flipit_uniformOf(t); /* (0, 1] */
+    t->skipBudget = -log(t->skipDraw);
+}
+
+/* Record an injection in the event log and print the banner. database.py parses the
+   banner lines by position. lanes is 0 for scalar sites. */
+static void flipit_logInjection(uint8_t type, uint32_t injection, unsigned int bPos,
+                                uint32_t fault_index, double prob, double p, uint32_t lane,
+                                uint32_t lanes) {
+    flipit_thread_t* t = flipit_thread();
+    struct timespec now;
+    uint64_t time;
+
+    FLIPIT_LastInjection.cycles = flipit_cycles();
+    clock_gettime(CLOCK_REALTIME, &now);
+    time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    FLIPIT_LastInjection.dynInsts = FLIPIT_TotalInsts;
+    FLIPIT_LastInjection.time = time;
+    FLIPIT_LastInjection.site = fault_index;
+    /* upsets are counted in the instructions of the thread calling Init (flipit_memoryUpset) */
+    FLIPIT_LastInjection.thread = type == FLIPIT_EVENT_MEMORY ? FLIPIT_MemInstsThread : t->id;
+    /* the claim of the last injection has already disarmed */
+    FLIPIT_LastInjection.disarms = 0 == __atomic_load_n(&FLIPIT_Armed, __ATOMIC_RELAXED) ? UINT32_MAX
+                                 : __atomic_load_n(&FLIPIT_Disarms, __ATOMIC_RELAXED);
+    __atomic_store_n(&FLIPIT_LastInjection.injection, injection, __ATOMIC_RELEASE);
+
+    if (FLIPIT_EventFd >= 0) {
+        uint64_t pos;
+        flipit_event_t* e = flipit_reserveEvent(&pos);
+        e->site = fault_index;
+        e->dynInsts = FLIPIT_TotalInsts;
+        e->time = time;
+        e->prob = prob;
+        e->p = p;
+        e->rank = FLIPIT_Rank;
+        e->thread = t->id;
+        e->injection = injection;
+        e->bit = bPos;
+        e->kind = FLIPIT_EVENT_INJECTION;
+        e->type = type;
+        e->aux = lanes == 0 ? 0 : ((uint64_t) lane << 32) | lanes;
+        flipit_publishEvent(pos);
+    }
+
+    if (FLIPIT_Banner) {
+        printf("\n/*********************************Start**************************************/\n"
+                "\nSuccessfully injected %s error!!\nRank: %d\n"
+                "Total # faults injected: %u\n" 
+                "Bit position is: %u\n"
+                "Index of the fault site: %u\n"
+                "Fault site probability: %e\n"
+                "Chosen random probability is: %e\n" 
+                "Attempts since last injection: %lu\n"
+                "Random stream (seed trial rank thread block): %llu %llu %d %u %llu\n",
+                FLIPIT_EventTypeNames[type], FLIPIT_Rank, injection, bPos, fault_index, 
+                prob, p, t->attempts,
+                (unsigned long long) FLIPIT_Seed, (unsigned long long) FLIPIT_Trial, FLIPIT_Rank,
+                t->id, (unsigned long long) t->rngCounter);   
+        if (lanes != 0)
+            printf("Vector lane: %u of %u\n", lane, lanes);
+        flipit_printSite(fault_index);
+        /* the analysis scripts pass the lines after the marker to the user's parser */
+        if (FLIPIT_CustomLogger != NULL) {
+            printf("Custom log:\n");
+            FLIPIT_CustomLogger(stdout);
+        }
+        printf("\n/*********************************End**************************************/\n");
+    }
+
+    if (FLIPIT_ForkRole == FLIPIT_FORK_TRIAL)
+        flipit_forkReport(bPos);
+    if (FLIPIT_InTrial && injection == 1) {
+        FLIPIT_TrialSite = fault_index;
+        FLIPIT_TrialBit = bPos;
+    }
+
+    /* the countdown restarts with the distance to the injection just made */
+    if (FLIPIT_CountdownActive)
+        __atomic_store_n(&FLIPIT_InjCountdown, t->attempts, __ATOMIC_RELAXED);
+    t->attempts = 0;
+}
+
+/* Reserve the next record of the ring; fill it in and hand it to flipit_publishEvent */
+static flipit_event_t* flipit_reserveEvent(uint64_t* pos) {
+    *pos = __atomic_fetch_add(&FLIPIT_EventHead, 1, __ATOMIC_RELAXED);
+
+    /* ring full: write out the oldest records (or wait for the thread that is) */
+    while (*pos - __atomic_load_n(&FLIPIT_EventTail, __ATOMIC_ACQUIRE) >= FLIPIT_EVENT_RING)
+        flipit_flushEvents();
+    return &FLIPIT_Events[*pos & (FLIPIT_EVENT_RING - 1)];
+}
+
+static void flipit_publishEvent(uint64_t pos) {
+    __atomic_store_n(&FLIPIT_EventSeq[pos & (FLIPIT_EVENT_RING - 1)], pos + 1, __ATOMIC_RELEASE);
+
+    if (pos - __atomic_load_n(&FLIPIT_EventTail, __ATOMIC_RELAXED) >= FLIPIT_EVENT_RING / 2)
+        flipit_flushEvents();
+}
+
+/* The number of a detector, logging its name the first time it is seen */
+static uint32_t flipit_detectorId(const char* detector) {
+    uint32_t i, expected = 0;
+
+    if (detector == NULL)
+        detector = "---";
+    for (i = 0; i < __atomic_load_n(&FLIPIT_NumDetectors, __ATOMIC_ACQUIRE); i++)
+        if (FLIPIT_Detectors[i] == detector || strcmp(FLIPIT_Detectors[i], detector) == 0)
+            return i;
+
+    while (!__atomic_compare_exchange_n(&FLIPIT_DetectorLock, &expected, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        expected = 0;
+    for (i = 0; i < FLIPIT_NumDetectors; i++)
+        if (strcmp(FLIPIT_Detectors[i], detector) == 0)
+            break;
+    if (i == FLIPIT_NumDetectors && i < FLIPIT_MAX_DETECTORS) {
+        FLIPIT_Detectors[i] = strdup(detector);
+        __atomic_store_n(&FLIPIT_NumDetectors, i + 1, __ATOMIC_RELEASE);
+
+        if (FLIPIT_EventFd >= 0) {
+            uint64_t pos;
+            flipit_event_t* e = flipit_reserveEvent(&pos);
+            memset(e, 0, sizeof(flipit_event_t));
+            strncpy((char*) &e->site, detector, FLIPIT_DETECTOR_NAME - 1);
+            e->rank = FLIPIT_Rank;
+            e->thread = flipit_thread()->id;
+            e->bit = i;
+            e->kind = FLIPIT_EVENT_DETECTOR;
+            flipit_publishEvent(pos);
+        }
+    }
+    else if (i == FLIPIT_MAX_DETECTORS && !FLIPIT_DetectorOverflow) {
+        fprintf(stderr, "FlipIt: more than %d detectors, the detections of the others are "
+                "logged without a name\n", FLIPIT_MAX_DETECTORS);
+        FLIPIT_DetectorOverflow = 1;
+    }
+    __atomic_store_n(&FLIPIT_DetectorLock, 0, __ATOMIC_RELEASE);
+    return i < FLIPIT_MAX_DETECTORS ? i : FLIPIT_DETECTOR_OVERFLOW;
+}
+
+/* Time stamp counter where the target has one, else ns */
+static uint64_t flipit_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t cycles;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (cycles));
+    return cycles;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+static void flipit_openEventLog() {
+    char filename[500];
+    flipit_event_header_t header;
+    int i;
+
+    flipit_closeEventLog();
+    snprintf(filename, sizeof(filename), "%s_%u", FLIPIT_EventPrefix, FLIPIT_Rank);
+    FLIPIT_EventFd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (FLIPIT_EventFd < 0) {
+        fprintf(stderr, "FlipIt: unable to open event log %s\n", filename);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FLIPIT_EVENT_MAGIC, sizeof(header.magic));
+    header.version = FLIPIT_EVENT_VERSION;
+    header.rank = FLIPIT_Rank;
+    header.recordSize = sizeof(flipit_event_t);
+    FLIPIT_EventFailed = write(FLIPIT_EventFd, &header, sizeof(header)) != sizeof(header);
+    if (FLIPIT_EventFailed)
+        fprintf(stderr, "FlipIt: unable to write event log %s\n", filename);
+
+    /* records still in the ring are written on exit or when the program crashes */
+    if (!FLIPIT_HandlersInstalled) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = flipit_crashHandler;
+        sigemptyset(&action.sa_mask);
+        for (i = 0; i < FLIPIT_NUM_CRASH_SIGNALS; i++)
+            sigaction(FLIPIT_CrashSignals[i], &action, &FLIPIT_OldActions[i]);
+        atexit(flipit_flushEvents);
+        FLIPIT_HandlersInstalled = 1;
+    }
+}
+
+static void flipit_closeEventLog() {
+    int fd;
+    if (FLIPIT_EventFd < 0)
+        return;
+    flipit_flushEvents();
+    fd = FLIPIT_EventFd;
+    FLIPIT_EventFd = -1;
+    close(fd);
+}
+
+/* Write the published records at the tail of the ring. Only one thread writes at a time;
+   the others return and keep going. Once a write fails (e.g. the disk or the file size limit is
+   full), the log ends at the last whole record and later records are dropped, so that threads
+   waiting for room in the ring do not wait forever. Safe to call from a signal handler. */
+static void flipit_flushEvents() {
+    uint32_t idle = 0;
+    uint64_t tail, end;
+
+    if (FLIPIT_EventFd < 0)
+        return;
+    if (!__atomic_compare_exchange_n(&FLIPIT_EventFlushing, &idle, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+
+    tail = __atomic_load_n(&FLIPIT_EventTail, __ATOMIC_RELAXED);
+    for (;;) {
+        /* records [tail, end) are published and contiguous in the ring */
+        end = tail;
+        while (__atomic_load_n(&FLIPIT_EventSeq[end & (FLIPIT_EVENT_RING - 1)],
+                               __ATOMIC_ACQUIRE) == end + 1
+               && end - tail < FLIPIT_EVENT_RING
+               && (end == tail || (end & (FLIPIT_EVENT_RING - 1)) != 0))
+            end++;
+        if (end == tail)
+            break;
+
+        if (!FLIPIT_EventFailed)
+            flipit_writeEvents(&FLIPIT_Events[tail & (FLIPIT_EVENT_RING - 1)],
+                               (end - tail) * sizeof(flipit_event_t));
+        tail = end;
+        __atomic_store_n(&FLIPIT_EventTail, tail, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&FLIPIT_EventFlushing, 0, __ATOMIC_RELEASE);
+}
+
+static void flipit_writeEvents(const void* data, size_t size) {
+    static const char warning[] = "FlipIt: unable to write the event log, dropping its records\n";
+    size_t written = 0;
+    ssize_t n;
+    off_t end;
+
+    while (written < size) {
+        n = write(FLIPIT_EventFd, (const uint8_t*) data + written, size - written);
+        if (n > 0)
+            written += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else {
+            /* cut off a partly written record */
+            end = lseek(FLIPIT_EventFd, 0, SEEK_CUR);
+            if (end >= 0)
+                (void) !ftruncate(FLIPIT_EventFd, end - written % sizeof(flipit_event_t));
+            FLIPIT_EventFailed = 1;
+            (void) !write(STDERR_FILENO, warning, sizeof(warning) - 1);
+            return;
+        }
+    }
+}
+
+static void flipit_crashHandler(int sig) {
+    int i;
+    flipit_flushEvents();
+    for (i = 0; i < FLIPIT_NUM_CRASH_SIGNALS; i++)
+        if (FLIPIT_CrashSignals[i] == sig)
+            sigaction(sig, &FLIPIT_OldActions[i], NULL);
+    raise(sig);
+}
+
+/***********************************************************************************************/
+/* Fork server                                                                                 */
+/***********************************************************************************************/
+
+static void flipit_addCheckpoint(uint64_t checkpoint) {
+    uint32_t i;
+    if (FLIPIT_NumCheckpoints == FLIPIT_MaxCheckpoints) {
+        FLIPIT_MaxCheckpoints = FLIPIT_MaxCheckpoints == 0 ? 16 : 2 * FLIPIT_MaxCheckpoints;
+        FLIPIT_Checkpoints = (uint64_t*) realloc(FLIPIT_Checkpoints,
+                                                 sizeof(uint64_t) * FLIPIT_MaxCheckpoints);
+    }
+    /* insertion keeps them sorted */
+    for (i = FLIPIT_NumCheckpoints; i > 0 && FLIPIT_Checkpoints[i - 1] > checkpoint; i--)
+        FLIPIT_Checkpoints[i] = FLIPIT_Checkpoints[i - 1];
+    FLIPIT_Checkpoints[i] = checkpoint;
+    FLIPIT_NumCheckpoints++;
+}
+
+static void flipit_startForkServer() {
+    char header[] = "# trial site instance bit injected exit signal dynInsts snapshot\n";
+    char* resultFile = FLIPIT_ForkResultFile;
+    uint32_t i;
+
+    flipit_readForkTrials(FLIPIT_ForkTrialFile);
+    if (FLIPIT_NumForkTrials == 0) {
+        fprintf(stderr, "FlipIt: no trials in %s, fork server disabled\n", FLIPIT_ForkTrialFile);
+        return;
+    }
+    if (resultFile == NULL) {
+        resultFile = (char*) malloc(strlen(FLIPIT_ForkTrialFile) + strlen(".results") + 1);
+        strcpy(resultFile, FLIPIT_ForkTrialFile);
+        strcat(resultFile, ".results");
+    }
+    FLIPIT_ForkResultFd = open(resultFile, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (FLIPIT_ForkResultFd < 0) {
+        fprintf(stderr, "FlipIt: unable to open fork results %s\n", resultFile);
+        exit(1);
+    }
+    if (write(FLIPIT_ForkResultFd, header, strlen(header)) < 0)
+        fprintf(stderr, "FlipIt: unable to write fork results %s\n", resultFile);
+
+    /* the first snapshot is taken before the first site executes */
+    flipit_addCheckpoint(0);
+    for (i = 1; i < FLIPIT_NumCheckpoints; i++)
+        if (FLIPIT_Checkpoints[i] == FLIPIT_Checkpoints[i - 1]) {
+            memmove(&FLIPIT_Checkpoints[i], &FLIPIT_Checkpoints[i + 1],
+                    sizeof(uint64_t) * (FLIPIT_NumCheckpoints - i - 1));
+            FLIPIT_NumCheckpoints--;
+            i--;
+        }
+    FLIPIT_SnapshotFds = (int*) malloc(sizeof(int) * FLIPIT_NumCheckpoints);
+    FLIPIT_SnapshotPids = (pid_t*) malloc(sizeof(pid_t) * FLIPIT_NumCheckpoints);
+    /* count the instances of every site a trial injects into, also those above the histogram */
+    FLIPIT_NumSiteInstances = FLIPIT_MAX_LOC;
+    for (i = 0; i < FLIPIT_NumForkTrials; i++)
+        if (FLIPIT_ForkTrials[i].site >= FLIPIT_NumSiteInstances)
+            FLIPIT_NumSiteInstances = (uint64_t) FLIPIT_ForkTrials[i].site + 1;
+    FLIPIT_SiteInstances = (uint64_t*) calloc(FLIPIT_NumSiteInstances, sizeof(uint64_t));
+    if (FLIPIT_SiteInstances == NULL) {
+        fprintf(stderr, "FlipIt: unable to count the instances of %llu sites\n",
+                (unsigned long long) FLIPIT_NumSiteInstances);
+        exit(1);
+    }
+    FLIPIT_NextCheckpoint = 0;
+    FLIPIT_TotalInsts = 0;
+
+    FLIPIT_ForkRole = FLIPIT_FORK_SERVER;
+    flipit_updateArmed();
+    /* the prefix may end before the last checkpoint */
+    atexit(flipit_finishForkServer);
+}
+
+/* Reads one trial per line: "site instance bit", bit -1 for any bit */
+static void flipit_readForkTrials(char* path) {
+    unsigned long site;
+    unsigned long long instance;
+    int bit;
+    uint32_t maxTrials = 0;
+    char line[256];
+    FILE* infile = fopen(path, "r");
+
+    if (infile == NULL) {
+        fprintf(stderr, "FlipIt: unable to open fork server trials %s\n", path);
+        return;
+    }
+    while (fgets(line, sizeof(line), infile) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%lu %llu %d", &site, &instance, &bit) != 3)
+            continue;
+        if (FLIPIT_NumForkTrials == maxTrials) {
+            maxTrials = maxTrials == 0 ? 64 : 2 * maxTrials;
+            FLIPIT_ForkTrials = (flipit_fork_trial_t*) realloc(FLIPIT_ForkTrials,
+                                                sizeof(flipit_fork_trial_t) * maxTrials);
+        }
+        FLIPIT_ForkTrials[FLIPIT_NumForkTrials].site = site;
+        FLIPIT_ForkTrials[FLIPIT_NumForkTrials].instance = instance;
+        FLIPIT_ForkTrials[FLIPIT_NumForkTrials].bit = bit;
+        FLIPIT_ForkTrials[FLIPIT_NumForkTrials].snapshot = -1;
+        FLIPIT_NumForkTrials++;
+    }
+    fclose(infile);
+}
+
+/* Called for every site executed while forking. Returns 1 if a trial process has reached
+   the instance it injects into; byte and bit are then set from the trial. */
+static uint8_t flipit_forkSite(uint32_t fault_index, uint32_t* byte, uint32_t* bit) {
+    if (FLIPIT_ForkRole == FLIPIT_FORK_SERVER) {
+        while (FLIPIT_ForkRole == FLIPIT_FORK_SERVER
+               && FLIPIT_NextCheckpoint < FLIPIT_NumCheckpoints
+               && FLIPIT_TotalInsts >= FLIPIT_Checkpoints[FLIPIT_NextCheckpoint])
+            flipit_checkpoint(); /* may return in a trial process */
+
+        if (FLIPIT_ForkRole == FLIPIT_FORK_SERVER) {
+            FLIPIT_TotalInsts++;
+            if (fault_index < FLIPIT_NumSiteInstances)
+                FLIPIT_SiteInstances[fault_index]++;
+            return 0;
+        }
+    }
+
+    FLIPIT_TotalInsts++;
+    flipit_fork_trial_t* trial = &FLIPIT_ForkTrials[FLIPIT_ForkTrial];
+    if (fault_index != trial->site || ++FLIPIT_ForkSeen != trial->instance)
+        return 0;
+    if (trial->bit >= 0) {
+        *byte = trial->bit / 8;
+        *bit = trial->bit % 8;
+    }
+    return 1;
+}
+
+/* Take the next snapshot. The trials whose instance executed since the previous snapshot are
+   handed to it, and after the last checkpoint all others go to the new one. */
+static void flipit_checkpoint() {
+    int32_t snapshot = FLIPIT_NextCheckpoint++;
+    int fds[2];
+    pid_t pid;
+
+    if (snapshot > 0) {
+        flipit_sendForkTrials(snapshot - 1, 0);
+        close(FLIPIT_SnapshotFds[snapshot - 1]);
+        FLIPIT_SnapshotFds[snapshot - 1] = -1;
+    }
+
+    fflush(NULL); /* or buffered output is repeated by every child */
+    if (pipe(fds) != 0 || (pid = fork()) < 0) {
+        fprintf(stderr, "FlipIt: unable to fork snapshot %d\n", snapshot);
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[1]);
+        flipit_serveSnapshot(snapshot, fds[0]); /* returns only in trial processes */
+        return;
+    }
+    close(fds[0]);
+    FLIPIT_SnapshotFds[snapshot] = fds[1];
+    FLIPIT_SnapshotPids[snapshot] = pid;
+
+    /* nothing is left to learn from running further */
+    if (FLIPIT_NextCheckpoint == FLIPIT_NumCheckpoints) {
+        flipit_finishForkServer();
+        _exit(0);
+    }
+}
+
+static void flipit_sendForkTrials(int32_t snapshot, uint8_t all) {
+    uint32_t i;
+    for (i = 0; i < FLIPIT_NumForkTrials; i++) {
+        flipit_fork_trial_t* trial = &FLIPIT_ForkTrials[i];
+        if (trial->snapshot != -1)
+            continue;
+        if (!all && FLIPIT_SiteInstances[trial->site] < trial->instance)
+            continue;
+        trial->snapshot = snapshot;
+        if (write(FLIPIT_SnapshotFds[snapshot], &i, sizeof(i)) != sizeof(i))
+            fprintf(stderr, "FlipIt: unable to send trial %u to snapshot %d\n", i, snapshot);
+    }
+}
+
+/* Hand the remaining trials to the last snapshot and wait for all of them */
+static void flipit_finishForkServer() {
+    int32_t i, last = (int32_t) FLIPIT_NextCheckpoint - 1;
+    if (FLIPIT_ForkRole != FLIPIT_FORK_SERVER)
+        return;
+    FLIPIT_ForkRole = FLIPIT_FORK_OFF;
+    if (last < 0)
+        return;
+
+    flipit_sendForkTrials(last, 1);
+    close(FLIPIT_SnapshotFds[last]);
+    for (i = 0; i <= last; i++)
+        waitpid(FLIPIT_SnapshotPids[i], NULL, 0);
+}
+
+/* Snapshot process: collect the trials sent by the server, then run them, at most
+   FLIPIT_ForkJobs at a time. Returns in the trial processes only. */
+static void flipit_serveSnapshot(int32_t snapshot, int fd) {
+    uint32_t* trials = (uint32_t*) malloc(sizeof(uint32_t) * FLIPIT_NumForkTrials);
+    uint32_t numTrials = 0, next = 0, running = 0, i;
+    pid_t* pids = (pid_t*) malloc(sizeof(pid_t) * FLIPIT_ForkJobs);
+    int* reports = (int*) malloc(sizeof(int) * FLIPIT_ForkJobs);
+    uint32_t* slotTrial = (uint32_t*) malloc(sizeof(uint32_t) * FLIPIT_ForkJobs);
+
+    FLIPIT_ForkRole = FLIPIT_FORK_OFF;
+    for (i = 0; i < (uint32_t) snapshot; i++)
+        if (FLIPIT_SnapshotFds[i] >= 0)
+            close(FLIPIT_SnapshotFds[i]);
+    while (numTrials < FLIPIT_NumForkTrials
+           && read(fd, &trials[numTrials], sizeof(uint32_t)) == sizeof(uint32_t))
+        numTrials++;
+    close(fd);
+
+    for (i = 0; i < FLIPIT_ForkJobs; i++)
+        pids[i] = 0;
+    while (next < numTrials || running > 0) {
+        /* start trials in the free slots */
+        for (i = 0; i < FLIPIT_ForkJobs && next < numTrials; i++) {
+            int fds[2];
+            pid_t pid;
+            if (pids[i] != 0)
+                continue;
+            if (pipe(fds) != 0 || (pid = fork()) < 0) {
+                fprintf(stderr, "FlipIt: unable to fork trial %u\n", trials[next]);
+                _exit(1);
+            }
+            if (pid == 0) {
+                /* trial process: resume the application */
+                close(fds[0]);
+                FLIPIT_ForkReportFd = fds[1];
+                FLIPIT_ForkTrial = trials[next];
+                flipit_fork_trial_t* trial = &FLIPIT_ForkTrials[FLIPIT_ForkTrial];
+                FLIPIT_ForkSeen = FLIPIT_SiteInstances[trial->site];
+                FLIPIT_ForkRole = FLIPIT_FORK_TRIAL;
+                FLIPIT_Trial = FLIPIT_ForkTrial;
+                flipit_seedThread(flipit_thread());
+                FLIPIT_State = FLIPIT_ON;
+                FLIPIT_RankInject = 1;
+                __atomic_store_n(&FLIPIT_REMAIN_INJECT_COUNT, 1, __ATOMIC_RELAXED);
+                flipit_updateArmed();
+                if (FLIPIT_ForkTimeout > 0)
+                    alarm(FLIPIT_ForkTimeout);
+                /* each trial logs its events to <prefix>_<trial>_<rank> */
+                if (FLIPIT_EventFd >= 0) {
+                    char prefix[500];
+                    snprintf(prefix, sizeof(prefix), "%s_%u", FLIPIT_EventPrefix,
+                             FLIPIT_ForkTrial);
+                    FLIPIT_SetEventLog(prefix);
+                    flipit_openEventLog();
+                }
+                return;
+            }
+            close(fds[1]);
+            pids[i] = pid;
+            reports[i] = fds[0];
+            slotTrial[i] = trials[next++];
+            running++;
+        }
+
+        /* wait for one trial and record its outcome */
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        for (i = 0; i < FLIPIT_ForkJobs; i++) {
+            if (pids[i] != pid)
+                continue;
+            flipit_fork_report_t report;
+            flipit_fork_trial_t* trial = &FLIPIT_ForkTrials[slotTrial[i]];
+            char line[256];
+            int len;
+            memset(&report, 0, sizeof(report));
+            if (read(reports[i], &report, sizeof(report)) != sizeof(report))
+                report.injected = 0;
+            close(reports[i]);
+            len = snprintf(line, sizeof(line), "%u %u %llu %d %u %d %d %llu %d\n", slotTrial[i],
+                           trial->site, (unsigned long long) trial->instance,
+                           report.injected ? (int) report.bit : trial->bit, report.injected,
+                           WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+                           WIFSIGNALED(status) ? WTERMSIG(status) : 0,
+                           (unsigned long long) report.dynInsts, snapshot);
+            if (write(FLIPIT_ForkResultFd, line, len) != len)
+                fprintf(stderr, "FlipIt: unable to write result of trial %u\n", slotTrial[i]);
+            pids[i] = 0;
+            running--;
+        }
+    }
+    _exit(0);
+}
+
+/* Trial process: report the injection, then run the rest of the application fault free */
+static void flipit_forkReport(uint32_t bit) {
+    flipit_fork_report_t report;
+    report.injected = 1;
+    report.bit = bit;
+    report.dynInsts = FLIPIT_TotalInsts;
+    if (write(FLIPIT_ForkReportFd, &report, sizeof(report)) != sizeof(report))
+        fprintf(stderr, "FlipIt: unable to report trial %u\n", FLIPIT_ForkTrial);
+    close(FLIPIT_ForkReportFd);
+    FLIPIT_ForkReportFd = -1;
+
+    FLIPIT_ForkRole = FLIPIT_FORK_OFF;
+    __atomic_store_n(&FLIPIT_REMAIN_INJECT_COUNT, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&FLIPIT_RankInject, 0, __ATOMIC_RELAXED);
+    flipit_updateArmed();
+}
+
+static double flipit_countdown() {
+    return (double) __atomic_sub_fetch(&FLIPIT_InjCountdown, 1, __ATOMIC_RELAXED);
+}
+
+#ifdef FLIPIT_MPI
+/***********************************************************************************************/
+/* Job-wide injections                                                                         */
+/***********************************************************************************************/
+
+/* Fault probability of job-wide injections: the distance to the rank's target, as the
+   countdown. Past it (e.g. at a site left out by --faultyLoc) the rank can no longer inject. */
+static double flipit_globalCountdown() {
+    uint64_t n = __atomic_fetch_add(&FLIPIT_GlobalNext, 1, __ATOMIC_RELAXED);
+
+    if (n <= FLIPIT_GlobalLocal)
+        return (double) (FLIPIT_GlobalLocal - n);
+    if (n == FLIPIT_GlobalLocal + 1) {
+        __atomic_store_n(&FLIPIT_RankInject, 0, __ATOMIC_RELAXED);
+        flipit_updateArmed();
+    }
+    return INFINITY;
+}
+
+/* Take one injection from the job-wide budget */
+static uint8_t flipit_claimGlobal() {
+    int64_t one = -1, remain;
+
+    PMPI_Fetch_and_op(&one, &remain, MPI_INT64_T, 0, 0, MPI_SUM, FLIPIT_GlobalWin);
+    PMPI_Win_flush(0, FLIPIT_GlobalWin);
+    return remain > 0;
+}
+
+/* After --globalInsts 0, rank 0 reports the instructions of the job and writes those of each
+   rank to --globalCounts. Collective. */
+static void flipit_finishGlobal() {
+    uint64_t* counts = NULL;
+    uint64_t total = 0;
+    int rank, size, i;
+    FILE* outfile;
+
+    if (!FLIPIT_Global)
+        return;
+    if (FLIPIT_FaultProb != flipit_globalCountdown || FLIPIT_GlobalLocal != UINT64_MAX
+        || FLIPIT_GlobalTarget != UINT64_MAX) {
+        flipit_freeGlobal();
+        return;
+    }
+    PMPI_Comm_rank(FLIPIT_GlobalComm, &rank);
+    PMPI_Comm_size(FLIPIT_GlobalComm, &size);
+    if (rank == 0)
+        counts = (uint64_t*) malloc(size * sizeof(uint64_t));
+    PMPI_Gather(&FLIPIT_GlobalNext, 1, MPI_UINT64_T, counts, 1, MPI_UINT64_T, 0,
+                FLIPIT_GlobalComm);
+    if (rank == 0) {
+        for (i = 0; i < size; i++)
+            total += counts[i];
+        printf("FlipIt: dynamic instructions of the job: %llu\n", (unsigned long long) total);
+        outfile = FLIPIT_GlobalCounts != NULL ? fopen(FLIPIT_GlobalCounts, "w") : NULL;
+        if (outfile != NULL) {
+            for (i = 0; i < size; i++)
+                fprintf(outfile, "%d %llu\n", i, (unsigned long long) counts[i]);
+            fclose(outfile);
+        } else
+            fprintf(stderr, "FlipIt: unable to write the instructions of each rank to %s\n",
+                    FLIPIT_GlobalCounts != NULL ? FLIPIT_GlobalCounts : "(no --globalCounts)");
+        free(counts);
+    }
+    flipit_freeGlobal();
+}
+
+static void flipit_freeGlobal() {
+    int finalized;
+
+    if (!FLIPIT_Global)
+        return;
+    FLIPIT_Global = 0;
+    if (FLIPIT_FaultProb == flipit_globalCountdown) {
+        FLIPIT_FaultProb = flipit_uniform;
+        FLIPIT_DefaultFaultProb = 1;
+    }
+    PMPI_Finalized(&finalized);
+    if (finalized)
+        return;
+    PMPI_Win_unlock_all(FLIPIT_GlobalWin);
+    PMPI_Win_free(&FLIPIT_GlobalWin);
+    PMPI_Comm_free(&FLIPIT_GlobalComm);
+    FLIPIT_GlobalCounters = NULL;
+}
 #endif
-    if (0 == flipit_checkActiveFaultSite(fault_index)) return inst_data;
 
+/***********************************************************************************************/
+/* Golden output comparison                                                                    */
+/***********************************************************************************************/
+
+static void flipit_goldenName(char* filename, size_t len) {
+    snprintf(filename, len, "%s_%u", FLIPIT_GoldenFile, FLIPIT_Rank);
+}
+
+/* Two 64 bit sums over the words of a block; the second is weighted by position so that
+   swapped words are caught. Independent per word, so the loop vectorises. */
+static void flipit_checksum(const uint8_t* data, uint64_t bytes, uint64_t sum[2]) {
+    uint64_t a = 0, b = 0, w, i;
+    for (i = 0; i + 8 <= bytes; i += 8) {
+        memcpy(&w, data + i, 8);
+        a += w;
+        b += w * (2 * i + 1);
+    }
+    if (i < bytes) {
+        w = 0;
+        memcpy(&w, data + i, bytes - i);
+        a += w;
+        b += w * (2 * i + 1);
+    }
+    sum[0] = a;
+    sum[1] = b;
+}
+
+static int flipit_writeGolden() {
+    char filename[500];
+    flipit_golden_header_t header;
+    flipit_golden_region_t regions[FLIPIT_MAX_OUTPUTS];
+    uint64_t offset, block, pad = 0;
+    uint32_t i;
+    FILE* outfile;
+
+    flipit_goldenName(filename, sizeof(filename));
+    outfile = fopen(filename, "wb");
+    if (outfile == NULL) {
+        fprintf(stderr, "FlipIt: unable to write golden outputs %s\n", filename);
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FLIPIT_GOLDEN_MAGIC, sizeof(header.magic));
+    header.version = FLIPIT_GOLDEN_VERSION;
+    header.rank = FLIPIT_Rank;
+    header.numOutputs = FLIPIT_NumOutputs;
+
+    /* the data of each region starts 8 byte aligned after its checksums */
+    offset = sizeof(header) + FLIPIT_NumOutputs * sizeof(flipit_golden_region_t);
+    for (i = 0; i < FLIPIT_NumOutputs; i++) {
+        flipit_output_t* out = &FLIPIT_Outputs[i];
+        uint64_t bytes = out->count * FLIPIT_OutputSizes[out->type];
+        uint64_t blocks = (bytes + FLIPIT_GOLDEN_BLOCK - 1) / FLIPIT_GOLDEN_BLOCK;
+        memset(&regions[i], 0, sizeof(flipit_golden_region_t));
+        memcpy(regions[i].name, out->name, sizeof(regions[i].name));
+        regions[i].type = out->type;
+        regions[i].count = out->count;
+        regions[i].tolerance = out->tolerance;
+        regions[i].offset = offset;
+        offset += blocks * 2 * sizeof(uint64_t) + ((bytes + 7) & ~7ULL);
+    }
+    fwrite(&header, sizeof(header), 1, outfile);
+    fwrite(regions, sizeof(flipit_golden_region_t), FLIPIT_NumOutputs, outfile);
+
+    for (i = 0; i < FLIPIT_NumOutputs; i++) {
+        flipit_output_t* out = &FLIPIT_Outputs[i];
+        uint64_t bytes = out->count * FLIPIT_OutputSizes[out->type];
+        for (block = 0; block < bytes; block += FLIPIT_GOLDEN_BLOCK) {
+            uint64_t sum[2];
+            uint64_t len = bytes - block < FLIPIT_GOLDEN_BLOCK ? bytes - block
+                                                               : FLIPIT_GOLDEN_BLOCK;
+            flipit_checksum((uint8_t*) out->data + block, len, sum);
+            fwrite(sum, sizeof(uint64_t), 2, outfile);
+        }
+        fwrite(out->data, 1, bytes, outfile);
+        fwrite(&pad, 1, ((bytes + 7) & ~7ULL) - bytes, outfile);
+        memset(&out->result, 0, sizeof(flipit_output_result_t));
+    }
+    fclose(outfile);
+    return FLIPIT_OUTCOME_BENIGN;
+}
+
+static int flipit_compareGolden() {
+    char filename[500];
+    flipit_golden_header_t header;
+    flipit_golden_region_t region;
+    uint8_t* golden;
+    uint64_t* sums;
+    uint64_t differing = 0;
+    uint32_t i;
+    int fd;
+
+    flipit_goldenName(filename, sizeof(filename));
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+        || memcmp(header.magic, FLIPIT_GOLDEN_MAGIC, sizeof(header.magic)) != 0
+        || header.version != FLIPIT_GOLDEN_VERSION || header.numOutputs != FLIPIT_NumOutputs) {
+        fprintf(stderr, "FlipIt: %s is not a golden file of the registered outputs\n", filename);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    golden = (uint8_t*) malloc(FLIPIT_GOLDEN_BLOCK);
+    for (i = 0; i < FLIPIT_NumOutputs; i++) {
+        flipit_output_t* out = &FLIPIT_Outputs[i];
+        uint32_t size = FLIPIT_OutputSizes[out->type];
+        uint64_t bytes = out->count * size;
+        uint64_t blocks = (bytes + FLIPIT_GOLDEN_BLOCK - 1) / FLIPIT_GOLDEN_BLOCK;
+        uint64_t sumBytes = blocks * 2 * sizeof(uint64_t);
+        uint64_t block;
+
+        memset(&out->result, 0, sizeof(flipit_output_result_t));
+        if (pread(fd, &region, sizeof(region), sizeof(header) + i * sizeof(region))
+                != sizeof(region)
+            || region.type != out->type || region.count != out->count) {
+            fprintf(stderr, "FlipIt: golden output %u does not match output %s\n", i, out->name);
+            out->result.differing = out->count;
+            differing += out->count;
+            continue;
+        }
+
+        sums = (uint64_t*) calloc(2 * blocks + 2, sizeof(uint64_t));
+        if (pread(fd, sums, sumBytes, region.offset) != (ssize_t) sumBytes)
+            memset(sums, 0, sumBytes);
+
+        /* only blocks whose checksum differs are read back and compared element by element */
+        for (block = 0; block < blocks; block++) {
+            uint64_t sum[2];
+            uint64_t start = block * FLIPIT_GOLDEN_BLOCK;
+            uint64_t len = bytes - start < FLIPIT_GOLDEN_BLOCK ? bytes - start
+                                                               : FLIPIT_GOLDEN_BLOCK;
+            flipit_checksum((uint8_t*) out->data + start, len, sum);
+            if (sum[0] == sums[2 * block] && sum[1] == sums[2 * block + 1])
+                continue;
+            if (pread(fd, golden, len, region.offset + sumBytes + start) != (ssize_t) len) {
+                fprintf(stderr, "FlipIt: golden output %s is truncated\n", out->name);
+                out->result.differing += (bytes - start) / size;
+                break;
+            }
+            out->result.differing += flipit_compareBlock(out, golden, start / size, len / size);
+        }
+        free(sums);
+        differing += out->result.differing;
+
+        if (FLIPIT_Banner && out->result.differing > 0)
+            printf("FlipIt: output %s: %llu of %llu elements differ, first at %llu, max error %g "
+                   "at %llu\n", out->name, (unsigned long long) out->result.differing,
+                   (unsigned long long) out->count, (unsigned long long) out->result.first,
+                   out->result.maxError, (unsigned long long) out->result.worst);
+    }
+    free(golden);
+    close(fd);
+    return differing > 0 ? FLIPIT_OUTCOME_SDC : FLIPIT_OUTCOME_BENIGN;
+}
+
+/* Count the elements first .. first+count-1 of out that differ from golden by more than tol
+   (any difference for tol 0, NaN always differs). The counting loop has no early exit so it
+   vectorises; the pass for the location and size of the differences runs only if it finds any. */
+#define FLIPIT_DIFFERS(a, g) \
+    ((a) != (g) && (tol == 0. || !(fabs((double) (a) - (double) (g)) <= tol)))
+#define FLIPIT_COMPARE_BLOCK(T) {                                               \
+    const T* a = (const T*) out->data + first;                                \
+    const T* g = (const T*) golden;                                           \
+    for (i = 0; i < count; i++)                                               \
+        n += FLIPIT_DIFFERS(a[i], g[i]);                                      \
+    for (i = 0; n > 0 && i < count; i++) {                                    \
+        double err = fabs((double) a[i] - (double) g[i]);                     \
+        if (!FLIPIT_DIFFERS(a[i], g[i]))                                      \
+            continue;                                                         \
+        if (err != err)                                                       \
+            err = INFINITY;                                                   \
+        if (r->differing == 0 && found++ == 0)                                \
+            r->first = first + i;                                             \
+        if (err > r->maxError || (r->differing == 0 && found == 1)) {         \
+            r->maxError = err;                                                \
+            r->worst = first + i;                                             \
+        }                                                                     \
+    }                                                                         \
+}
+
+static uint64_t flipit_compareBlock(flipit_output_t* out, const uint8_t* golden, uint64_t first,
+                                    uint64_t count) {
+    flipit_output_result_t* r = &out->result;
+    double tol = out->tolerance;
+    uint64_t i, n = 0, found = 0;
+
+    switch (out->type) {
+    case FLIPIT_OUTPUT_BYTES:
+        FLIPIT_COMPARE_BLOCK(uint8_t)
+        break;
+    case FLIPIT_OUTPUT_INT32:
+        FLIPIT_COMPARE_BLOCK(int32_t)
+        break;
+    case FLIPIT_OUTPUT_INT64:
+        FLIPIT_COMPARE_BLOCK(int64_t)
+        break;
+    case FLIPIT_OUTPUT_FLOAT:
+        FLIPIT_COMPARE_BLOCK(float)
+        break;
+    case FLIPIT_OUTPUT_DOUBLE:
+        FLIPIT_COMPARE_BLOCK(double)
+        break;
+    }
+    return n;
+}
+
+/***********************************************************************************************/
+/* Runtime fault sites and faults in memory at rest                                            */
+/***********************************************************************************************/
+
+/* spin lock between the threads of a rank: the registered regions, and with MPI the pending
+   requests and the message log */
+static void flipit_lock(uint32_t* lock) {
+    uint32_t idle = 0;
+    while (!__atomic_compare_exchange_n(lock, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        idle = 0;
+}
+
+static uint32_t flipit_logString(char* strings, uint32_t* bytes, const char* str) {
+    uint32_t offset = *bytes;
+    strcpy(strings + offset, str);
+    *bytes += strlen(str) + 1;
+    return offset;
+}
+
+/* Write the site log of a module of the runtime (MPI, memory). Put it with the logs of the
+   program so the analysis scripts number the sites as the runtime does. */
+static void flipit_writeSiteLog(const char* path, uint64_t module, const char* source,
+                                const flipit_runtime_site_t* runtimeSites, uint32_t numSites) {
+    flipit_sitelog_header_t header;
+    flipit_sitelog_site_t sites[FLIPIT_MAX_RUNTIME_SITES];
+    flipit_sitelog_function_t functions[FLIPIT_MAX_RUNTIME_SITES];
+    char* strings;
+    uint32_t i, numFunctions = 0, bytes = 1;
+    uint64_t size = 1 + strlen(source) + 1;
+    FILE* outfile;
+
+    /* the string table holds at most the source and the names of every site */
+    for (i = 0; i < numSites; i++)
+        size += strlen(runtimeSites[i].function) + 1 + strlen(runtimeSites[i].part) + 1;
+    strings = (char*) malloc(size);
+    if (strings == NULL)
+        return;
+    strings[0] = '\0';
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FLIPIT_SITELOG_MAGIC, sizeof(header.magic));
+    header.version = FLIPIT_SITELOG_VERSION;
+    header.module = module;
+    header.source = flipit_logString(strings, &bytes, source);
+    for (i = 0; i < numSites; i++) {
+        const flipit_runtime_site_t* m = &runtimeSites[i];
+        if (i == 0 || strcmp(m->function, runtimeSites[i - 1].function) != 0) {
+            functions[numFunctions].name = flipit_logString(strings, &bytes, m->function);
+            functions[numFunctions].firstSite = i;
+            numFunctions++;
+        }
+        sites[i].function = numFunctions - 1;
+        sites[i].location = FLIPIT_SITELOG_NONE;
+        sites[i].opcode = flipit_logString(strings, &bytes, m->part);
+        sites[i].type = 2;  /* ARITHMETIC_FIX, made Arith-FP by injections into floating point */
+        sites[i].info = m->info;
+        sites[i].lanes = 0;
+    }
+    header.numSites = numSites;
+    header.numFunctions = numFunctions;
+    header.sites = sizeof(header);
+    header.functions = header.sites + numSites * sizeof(flipit_sitelog_site_t);
+    header.locations = header.functions + numFunctions * sizeof(flipit_sitelog_function_t);
+    header.strings = header.locations;
+    header.stringBytes = bytes;
+
+    outfile = fopen(path, "wb");
+    if (outfile == NULL) {
+        fprintf(stderr, "FlipIt: unable to write %s site log %s\n", source, path);
+        free(strings);
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, outfile);
+    fwrite(sites, sizeof(flipit_sitelog_site_t), numSites, outfile);
+    fwrite(functions, sizeof(flipit_sitelog_function_t), numFunctions, outfile);
+    fwrite(strings, 1, bytes, outfile);
+    fclose(outfile);
+    free(strings);
+}
+
+/* Start the thread making the upsets. With --memInsts the CPU counts the instructions of the
+   thread calling FLIPIT_Init and signals the runtime thread after every N of them; without a
+   counter (no PMU, e.g. in most virtual machines) only --memRate makes upsets. */
+static void flipit_startMemoryFaults() {
+    if (FLIPIT_ForkTrialFile != NULL) {
+        if (FLIPIT_Rank == 0)
+            fprintf(stderr, "FlipIt: faults in memory at rest are not made by the fork server\n");
+        return;
+    }
+    if (FLIPIT_MemRunning || sem_init(&FLIPIT_MemWake, 0, 0) != 0)
+        return;
+    FLIPIT_MemInstsOf = &FLIPIT_TotalInsts;
+    FLIPIT_MemInstsThread = flipit_thread()->id;
+    if (FLIPIT_MemInsts > 0) {
+        FLIPIT_MemCounter = flipit_openMemoryCounter();
+        if (FLIPIT_MemCounter < 0 && FLIPIT_Rank == 0)
+            fprintf(stderr, "FlipIt: no instruction counter for --memInsts (%s)%s\n",
+                    strerror(errno), FLIPIT_MemRate > 0. ? ", using --memRate" : "");
+        if (FLIPIT_MemCounter < 0 && FLIPIT_MemRate <= 0.) {
+            sem_destroy(&FLIPIT_MemWake);
+            return;
+        }
+    }
+
+    __atomic_store_n(&FLIPIT_MemRunning, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&FLIPIT_MemThread, NULL, flipit_memoryThread, NULL) != 0) {
+        fprintf(stderr, "FlipIt: unable to start the memory fault thread\n");
+        FLIPIT_MemRunning = 0;
+        if (FLIPIT_MemCounter >= 0)
+            close(FLIPIT_MemCounter);
+        FLIPIT_MemCounter = -1;
+        sem_destroy(&FLIPIT_MemWake);
+        return;
+    }
+#ifdef __linux__
+    if (FLIPIT_MemCounter >= 0)
+        ioctl(FLIPIT_MemCounter, PERF_EVENT_IOC_REFRESH, 1);
+#endif
+}
+
+static void flipit_stopMemoryFaults() {
+    if (!FLIPIT_MemRunning)
+        return;
+    if (FLIPIT_MemCounter >= 0) {
+        close(FLIPIT_MemCounter);
+        FLIPIT_MemCounter = -1;
+    }
+    __atomic_store_n(&FLIPIT_MemRunning, 0, __ATOMIC_RELEASE);
+    sem_post(&FLIPIT_MemWake);
+    pthread_join(FLIPIT_MemThread, NULL);
+    sem_destroy(&FLIPIT_MemWake);
+}
+
+/* A counter of the instructions the calling thread executes in user space. It stops after
+   --memInsts of them and sends FLIPIT_MEM_SIGNAL to the thread; PERF_EVENT_IOC_REFRESH
+   restarts it. Returns -1 with errno set if there is none. */
+static int flipit_openMemoryCounter() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    struct f_owner_ex owner;
+    struct sigaction action;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.sample_period = FLIPIT_MemInsts;
+    attr.wakeup_events = 1;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = flipit_memorySignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    owner.type = F_OWNER_TID;
+    owner.pid = syscall(SYS_gettid);
+    if (sigaction(FLIPIT_MEM_SIGNAL, &action, NULL) != 0 || fcntl(fd, F_SETFL, O_ASYNC) != 0
+        || fcntl(fd, F_SETSIG, FLIPIT_MEM_SIGNAL) != 0 || fcntl(fd, F_SETOWN_EX, &owner) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* the program's thread only wakes the runtime thread; the upset is made there */
+static void flipit_memorySignal(int sig) {
+    int saved = errno;
+    sem_post(&FLIPIT_MemWake);
+    errno = saved;
+}
+
+/* Wait for the counter, or for a time drawn from the rate of upsets of the registered bytes,
+   then make an upset. Waits are at most FLIPIT_MEM_MAX_WAIT, after which a new one is drawn: the
+   waits are memoryless, so this follows the regions as they are registered and freed. */
+static void* flipit_memoryThread(void* arg) {
+    struct timespec until;
+    double rate, wait;
+    int ret;
+
+    while (__atomic_load_n(&FLIPIT_MemRunning, __ATOMIC_ACQUIRE)) {
+        if (FLIPIT_MemCounter >= 0) {
+            if (sem_wait(&FLIPIT_MemWake) != 0 || !__atomic_load_n(&FLIPIT_MemRunning,
+                                                                 __ATOMIC_ACQUIRE))
+                continue;
+            flipit_memoryUpset();
+#ifdef __linux__
+            ioctl(FLIPIT_MemCounter, PERF_EVENT_IOC_REFRESH, 1);
+#endif
+            continue;
+        }
+
+        rate = FLIPIT_MemRate * __atomic_load_n(&FLIPIT_RegionBytes, __ATOMIC_RELAXED)
+                / (1024. * 1024. * 1024.);
+        wait = rate > 0. ? -log1p(-flipit_uniform()) / rate : INFINITY;
+        clock_gettime(CLOCK_REALTIME, &until);
+        wait = wait < FLIPIT_MEM_MAX_WAIT ? wait : FLIPIT_MEM_MAX_WAIT;
+        until.tv_sec += (time_t) wait;
+        until.tv_nsec += (long) ((wait - floor(wait)) * 1e9);
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        do {
+            ret = sem_timedwait(&FLIPIT_MemWake, &until);
+        } while (ret != 0 && errno == EINTR);
+        if (ret != 0 && wait < FLIPIT_MEM_MAX_WAIT
+            && __atomic_load_n(&FLIPIT_MemRunning, __ATOMIC_ACQUIRE))
+            flipit_memoryUpset();
+    }
+    return arg;
+}
+
+/* Flip one bit of the registered bytes, all bytes equally likely. The event's bit is the
+   position in the aligned 64 bit word, as for a double of the program. */
+static void flipit_memoryUpset() {
+    flipit_thread_t* t;
+    flipit_region_t* r;
+    uint64_t offset, at, total;
+    uint32_t i, bit, injection;
+    uint8_t* addr;
+
+    if (0 == __atomic_load_n(&FLIPIT_Armed, __ATOMIC_RELAXED)
+        || !flipit_checkActiveFaultSite(FLIPIT_MemBase))
+        return;
+
+    /* the upset is logged at the program's instruction count */
+    t = flipit_thread();
+    FLIPIT_TotalInsts = __atomic_load_n(FLIPIT_MemInstsOf, __ATOMIC_RELAXED);
+    flipit_lock(&FLIPIT_RegionLock);
+    total = FLIPIT_RegionBytes;
+    if (total == 0) {
+        __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    t->attempts++;
+    offset = ((uint64_t) flipit_rand32(t) << 32 | flipit_rand32(t)) % total;
+    bit = flipit_rand32(t) & 0x7;
+    for (i = 0, at = offset; at >= FLIPIT_Regions[i].bytes; i++)
+        at -= FLIPIT_Regions[i].bytes;
+    r = &FLIPIT_Regions[i];
+    injection = flipit_claimInjection();
+    if (injection == 0) {
+        __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    addr = r->data + at;
+    __atomic_fetch_xor(addr, (uint8_t) (1 << bit), __ATOMIC_RELAXED);
+    FLIPIT_MemUpset = *r;
+    FLIPIT_MemUpsetOffset = at;
+    /* unlocked before logging, which may allocate */
+    __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+
+    flipit_logInjection(FLIPIT_EVENT_MEMORY, injection, ((uintptr_t) addr & 0x7) * 8 + bit,
+                        FLIPIT_MemBase,
+                        FLIPIT_MemCounter >= 0 ? (double) FLIPIT_MemInsts : FLIPIT_MemRate,
+                        (double) offset / total, 0, 0);
+}
+
+/* Heap blocks of at least --memHeap bytes are registered as regions labeled "heap" when the
+   program is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free. The
+   __real_ functions are weak, so the runtime links without these options too. */
+extern void* __real_malloc(size_t size) __attribute__((weak));
+extern void* __real_calloc(size_t n, size_t size) __attribute__((weak));
+extern void* __real_realloc(void* ptr, size_t size) __attribute__((weak));
+extern void __real_free(void* ptr) __attribute__((weak));
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    if (ptr != NULL && FLIPIT_MemHeap > 0 && size >= FLIPIT_MemHeap)
+        FLIPIT_RegisterRegion(ptr, size, "heap");
+    return ptr;
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    void* ptr = __real_calloc(n, size);
+    if (ptr != NULL && FLIPIT_MemHeap > 0 && n * size >= FLIPIT_MemHeap)
+        FLIPIT_RegisterRegion(ptr, n * size, "heap");
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    void* moved;
+
+    if (ptr == NULL || __atomic_load_n(&FLIPIT_NumRegions, __ATOMIC_RELAXED) == 0)
+        moved = __real_realloc(ptr, size);
+    else {
+        /* no upset while the block moves; it stays registered if realloc fails */
+        flipit_lock(&FLIPIT_RegionLock);
+        moved = __real_realloc(ptr, size);
+        if (moved != NULL || size == 0)
+            flipit_removeRegion(ptr);
+        __atomic_store_n(&FLIPIT_RegionLock, 0, __ATOMIC_RELEASE);
+    }
+    if (moved != NULL && FLIPIT_MemHeap > 0 && size >= FLIPIT_MemHeap)
+        FLIPIT_RegisterRegion(moved, size, "heap");
+    return moved;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr != NULL && __atomic_load_n(&FLIPIT_NumRegions, __ATOMIC_RELAXED) != 0)
+        FLIPIT_UnregisterRegion(ptr);
+    __real_free(ptr);
+}
+
+/***********************************************************************************************/
+/* The functions below this are inserted by the compiler pass to flip a bit                    */
+/***********************************************************************************************/
+
+/* Flip one bit of the size byte value inst_data if the site is faulty. byte and bit are fixed
+   positions or FLIPIT_ANY; random positions are only drawn for an injection. All entry
+   points below inline this with their size and type known. */
+static inline uint64_t flipit_corrupt(uint32_t fault_index, double prob, uint64_t inst_data,
+                                      uint32_t size, uint8_t type, uint32_t byte, uint32_t bit)
+{
+#ifdef FLIPIT_HISTOGRAM
+    if (fault_index < FLIPIT_MAX_LOC)
+        flipit_thread()->histogram[fault_index]++;
+#endif
+
+    // verify that it is the correct time to inject
+    double p = 0.;
+    if (FLIPIT_ForkRole != FLIPIT_FORK_OFF) {
+        if (0 == flipit_forkSite(fault_index, &byte, &bit)) return inst_data;
+    }
+    else {
+        if (0 == flipit_shouldInjectNoCheck()) return inst_data;
+        if (0 == flipit_trigger(prob, &p)) return inst_data;
+        if (0 == flipit_checkActiveFaultSite(fault_index)) return inst_data;
+    }
 
     // determine which bit & byte should be flipped
-    char bit = ((parameter >> 24) & 0xF); //TODO: VERIFY
-    char byte = ((parameter >> 28) & 0xF);
-
-    if (bit == 0xF) bit = rand() % 8; //get correct bit
-    if (byte > 7) byte = rand() % 8; 
-            
-    FLIPIT_InjectionCount++;
-    FLIPIT_REMAIN_INJECT_COUNT--;
-    if (FLIPIT_REMAIN_INJECT_COUNT == 0) FLIPIT_RankInject = 0; 
-    
-    flipit_print_injectedErr("Converted Pointer", byte*8 + bit, fault_index, prob, p);
-    FLIPIT_Attempts = 0;
-    return inst_data ^ ((uint64_t) 0x1L << (byte*8 + bit)); 
+    if (bit == FLIPIT_ANY)
+        bit = flipit_rand() % 8;
+    else
+        bit = bit % 8;
+    if (byte == FLIPIT_ANY)
+        byte = flipit_rand() % size;
+    else
+        byte = byte % size;
+
+    uint32_t injection = flipit_claimInjection();
+    if (0 == injection) return inst_data;
+
+    flipit_logInjection(type, injection, byte*8 + bit, fault_index, prob, p, 0, 0);
+    return inst_data ^ ((uint64_t) 0x1 << (byte*8 + bit));
+}
+
+static inline uint32_t flipit_floatBits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float flipit_bitsFloat(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline uint64_t flipit_doubleBits(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+static inline double flipit_bitsDouble(uint64_t u) {
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+/* Generic entry points, kept for callers outside the pass. They take the full 32 bit site
+   index, like the specialised ones, and flip any byte and bit; the byte and bit are no longer
+   packed into the top of the index, which left only 24 bits for sites. */
+uint8_t corruptIntData_8bit(uint32_t site, double prob, uint8_t inst_data)
+{
+    return (uint8_t) flipit_corrupt(site, prob, inst_data, 1, FLIPIT_EVENT_INT, FLIPIT_ANY,
+                                    FLIPIT_ANY);
+}
+
+uint16_t corruptIntData_16bit(uint32_t site, double prob, uint16_t inst_data)
+{
+    return (uint16_t) flipit_corrupt(site, prob, inst_data, 2, FLIPIT_EVENT_INT, FLIPIT_ANY,
+                                     FLIPIT_ANY);
+}
+
+uint32_t corruptIntData_32bit(uint32_t site, double prob, uint32_t inst_data)
+{
+    return (uint32_t) flipit_corrupt(site, prob, inst_data, 4, FLIPIT_EVENT_INT, FLIPIT_ANY,
+                                     FLIPIT_ANY);
+}
+
+uint64_t corruptIntData_64bit(uint32_t site, double prob, uint64_t inst_data)
+{
+    return flipit_corrupt(site, prob, inst_data, 8, FLIPIT_EVENT_INT, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+float corruptFloatData_32bit(uint32_t site, double prob, float inst_data)
+{
+    return flipit_bitsFloat(flipit_corrupt(site, prob, flipit_floatBits(inst_data), 4,
+                                           FLIPIT_EVENT_FLOAT32, FLIPIT_ANY, FLIPIT_ANY));
+}
+
+double corruptFloatData_64bit(uint32_t site, double prob, double inst_data)
+{
+    return flipit_bitsDouble(flipit_corrupt(site, prob, flipit_doubleBits(inst_data), 8,
+                                            FLIPIT_EVENT_FLOAT64, FLIPIT_ANY, FLIPIT_ANY));
+}
+
+uint64_t corruptPtr2Int_64bit(uint32_t site, double prob, uint64_t inst_data)
+{
+    return flipit_corrupt(site, prob, inst_data, 8, FLIPIT_EVENT_PTR, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+/* Specialised entry points emitted by the pass when the byte and bit are both any (_rand)
+   or both fixed (_fixed). They take the plain site index and do no decoding. */
+uint8_t corruptIntData_8bit_rand(uint32_t site, double prob, uint8_t inst_data)
+{
+    return (uint8_t) flipit_corrupt(site, prob, inst_data,
+                                    1, FLIPIT_EVENT_INT, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+uint8_t corruptIntData_8bit_fixed(uint32_t site, double prob, uint8_t inst_data,
+                                  uint32_t byte, uint32_t bit)
+{
+    return (uint8_t) flipit_corrupt(site, prob, inst_data, 1, FLIPIT_EVENT_INT, byte, bit);
+}
+
+uint16_t corruptIntData_16bit_rand(uint32_t site, double prob, uint16_t inst_data)
+{
+    return (uint16_t) flipit_corrupt(site, prob, inst_data,
+                                     2, FLIPIT_EVENT_INT, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+uint16_t corruptIntData_16bit_fixed(uint32_t site, double prob, uint16_t inst_data,
+                                    uint32_t byte, uint32_t bit)
+{
+    return (uint16_t) flipit_corrupt(site, prob, inst_data, 2, FLIPIT_EVENT_INT, byte, bit);
+}
+
+uint32_t corruptIntData_32bit_rand(uint32_t site, double prob, uint32_t inst_data)
+{
+    return (uint32_t) flipit_corrupt(site, prob, inst_data,
+                                     4, FLIPIT_EVENT_INT, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+uint32_t corruptIntData_32bit_fixed(uint32_t site, double prob, uint32_t inst_data,
+                                    uint32_t byte, uint32_t bit)
+{
+    return (uint32_t) flipit_corrupt(site, prob, inst_data, 4, FLIPIT_EVENT_INT, byte, bit);
+}
+
+uint64_t corruptIntData_64bit_rand(uint32_t site, double prob, uint64_t inst_data)
+{
+    return flipit_corrupt(site, prob, inst_data, 8, FLIPIT_EVENT_INT, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+uint64_t corruptIntData_64bit_fixed(uint32_t site, double prob, uint64_t inst_data,
+                                    uint32_t byte, uint32_t bit)
+{
+    return flipit_corrupt(site, prob, inst_data, 8, FLIPIT_EVENT_INT, byte, bit);
+}
+
+float corruptFloatData_32bit_rand(uint32_t site, double prob, float inst_data)
+{
+    return flipit_bitsFloat(flipit_corrupt(site, prob, flipit_floatBits(inst_data), 4,
+                                           FLIPIT_EVENT_FLOAT32, FLIPIT_ANY, FLIPIT_ANY));
+}
+
+float corruptFloatData_32bit_fixed(uint32_t site, double prob, float inst_data,
+                                   uint32_t byte, uint32_t bit)
+{
+    return flipit_bitsFloat(flipit_corrupt(site, prob, flipit_floatBits(inst_data), 4,
+                                           FLIPIT_EVENT_FLOAT32, byte, bit));
+}
+
+double corruptFloatData_64bit_rand(uint32_t site, double prob, double inst_data)
+{
+    return flipit_bitsDouble(flipit_corrupt(site, prob, flipit_doubleBits(inst_data), 8,
+                                            FLIPIT_EVENT_FLOAT64, FLIPIT_ANY, FLIPIT_ANY));
+}
+
+double corruptFloatData_64bit_fixed(uint32_t site, double prob, double inst_data,
+                                    uint32_t byte, uint32_t bit)
+{
+    return flipit_bitsDouble(flipit_corrupt(site, prob, flipit_doubleBits(inst_data), 8,
+                                            FLIPIT_EVENT_FLOAT64, byte, bit));
+}
+
+uint64_t corruptPtr2Int_64bit_rand(uint32_t site, double prob, uint64_t inst_data)
+{
+    return flipit_corrupt(site, prob, inst_data, 8, FLIPIT_EVENT_PTR, FLIPIT_ANY, FLIPIT_ANY);
+}
+
+uint64_t corruptPtr2Int_64bit_fixed(uint32_t site, double prob, uint64_t inst_data,
+                                    uint32_t byte, uint32_t bit)
+{
+    return flipit_corrupt(site, prob, inst_data, 8, FLIPIT_EVENT_PTR, byte, bit);
+}
+
+/* Corrupt one bit of one lane of the vector at data; the lane is chosen at random and the
+   bit within the lane as for scalars (byte and bit fields of parameter). */
+void corruptVectorData(uint32_t site, double prob, void* data, uint32_t lanes,
+                       uint32_t laneBytes, uint32_t type, uint32_t byte, uint32_t bit)
+{
+    uint32_t fault_index = site;
+#ifdef FLIPIT_HISTOGRAM
+    if (fault_index < FLIPIT_MAX_LOC)
+        flipit_thread()->histogram[fault_index]++;
+#endif
+    double p = 0.;
+    if (FLIPIT_ForkRole != FLIPIT_FORK_OFF) {
+        if (0 == flipit_forkSite(fault_index, &byte, &bit)) return;
+    }
+    else {
+        if (0 == flipit_shouldInjectNoCheck()) return;
+        if (0 == flipit_trigger(prob, &p)) return;
+        if (0 == flipit_checkActiveFaultSite(fault_index)) return;
+    }
+
+    // determine which lane, bit & byte should be flipped
+    uint32_t lane = flipit_rand() % lanes;
+
+    if (bit == FLIPIT_ANY)
+        bit = flipit_rand() % 8;
+    else
+        bit = bit % 8;
+    if (byte == FLIPIT_ANY || byte > 7)
+        byte = flipit_rand() % laneBytes;
+    else
+        byte = byte % laneBytes;
+
+    uint32_t injection = flipit_claimInjection();
+    if (0 == injection) return;
+
+    flipit_logInjection(type, injection, byte*8 + bit, fault_index, prob, p, lane, lanes);
+    ((uint8_t*) data)[lane * laneBytes + byte] ^= (uint8_t) (0x1 << bit);
+}
+
+#ifdef FLIPIT_MPI
+/***********************************************************************************************/
+/* Faults in MPI messages (libcorrupt_mpi.a)                                                   */
+/***********************************************************************************************/
+
+static uint8_t flipit_mpiTrigger(uint32_t site, double* p) {
+    if (0 == (FLIPIT_MPIFaults & FLIPIT_MPISites[site].kind)) return 0;
+    if (FLIPIT_ForkRole != FLIPIT_FORK_OFF) return 0;
+    if (0 == flipit_shouldInjectNoCheck()) return 0;
+    if (0 == flipit_trigger(FLIPIT_MPIProb, p)) return 0;
+    return flipit_checkActiveFaultSite(FLIPIT_MPIBase + site);
+}
+
+/* counts and tags */
+static int flipit_corruptMPIInt(uint32_t site, int value) {
+    uint32_t injection, bit;
+    double p = 0.;
+
+    if (0 == flipit_mpiTrigger(site, &p)) return value;
+    bit = flipit_rand() % 32;
+    injection = flipit_claimInjection();
+    if (0 == injection) return value;
+
+    flipit_logInjection(FLIPIT_EVENT_INT, injection, bit, FLIPIT_MPIBase + site, FLIPIT_MPIProb,
+                        p, 0, 0);
+    return (int) ((uint32_t) value ^ ((uint32_t) 0x1 << bit));
+}
+
+/* Only types without gaps are corrupted, so that every byte of the buffer is data */
+static uint8_t flipit_mpiElement(MPI_Datatype type, uint32_t* size, uint8_t* eventType) {
+    MPI_Aint lb, extent;
+    int bytes;
+
+    if (PMPI_Type_size(type, &bytes) != MPI_SUCCESS
+        || PMPI_Type_get_extent(type, &lb, &extent) != MPI_SUCCESS || bytes <= 0
+        || extent != bytes)
+        return 0;
+    *size = bytes;
+    *eventType = type == MPI_DOUBLE ? FLIPIT_EVENT_FLOAT64
+               : type == MPI_FLOAT ? FLIPIT_EVENT_FLOAT32 : FLIPIT_EVENT_INT;
+    return 1;
+}
+
+/* Corrupt one of the count elements at buf if the site is faulty: in place, or in a private copy
+   of the buffer if copy is set. Returns the corrupted buffer, or NULL if no injection was made. A
+   copy is the caller's to free. */
+static void* flipit_corruptMPIBuffer(uint32_t site, const void* buf, int count, MPI_Datatype type,
+                                     uint8_t copy) {
+    uint32_t size;
+    uint8_t eventType;
+
+    if (0 == (FLIPIT_MPIFaults & FLIPIT_MPISites[site].kind)
+        || 0 == flipit_mpiElement(type, &size, &eventType))
+        return NULL;
+    return flipit_corruptMPIElements(site, buf, count, size, eventType, copy);
+}
+
+static void* flipit_corruptMPIElements(uint32_t site, const void* buf, int count, uint32_t size,
+                                       uint8_t eventType, uint8_t copy) {
+    uint32_t injection, lane, byte, bit;
+    uint8_t* target = (uint8_t*) buf;
+    double p = 0.;
+
+    if (buf == NULL || buf == MPI_IN_PLACE || count <= 0) return NULL;
+    if (0 == flipit_mpiTrigger(site, &p)) return NULL;
+    lane = flipit_rand() % count;
+    bit = flipit_rand() % 8;
+    byte = flipit_rand() % size;
+    if (copy) {
+        target = (uint8_t*) malloc((uint64_t) count * size);
+        if (target == NULL) return NULL;
+    }
+    injection = flipit_claimInjection();
+    if (0 == injection) {
+        if (copy) free(target);
+        return NULL;
+    }
+
+    flipit_logInjection(eventType, injection, byte*8 + bit, FLIPIT_MPIBase + site,
+                        FLIPIT_MPIProb, p, lane, count);
+    if (copy)
+        memcpy(target, buf, (uint64_t) count * size);
+    target[(uint64_t) lane * size + byte] ^= (uint8_t) (0x1 << bit);
+    return target;
+}
+
+static void flipit_addMPIPending(MPI_Request request, const void* buf, int count,
+                                 MPI_Datatype type, void* copy) {
+    flipit_mpi_pending_t* e;
+    uint32_t i;
+
+    flipit_lock(&FLIPIT_MPIPendingLock);
+    /* a request completed by a call not intercepted here (e.g. MPI_Waitsome in Fortran) leaves
+       its entry behind, and its handle may be reused */
+    for (i = 0; i < FLIPIT_NumMPIPending; i++)
+        if (FLIPIT_MPIPending[i].request == request) {
+            free(FLIPIT_MPIPending[i].copy);
+            FLIPIT_MPIPending[i] = FLIPIT_MPIPending[--FLIPIT_NumMPIPending];
+            break;
+        }
+    /* MPI_Isend checks for room before making a copy; one that still finds none (another thread
+       took the room) is left to leak, as MPI may still read it */
+    if (FLIPIT_NumMPIPending < FLIPIT_MPI_PENDING) {
+        e = &FLIPIT_MPIPending[FLIPIT_NumMPIPending];
+        e->request = request;
+        e->buf = (void*) buf;
+        e->copy = copy;
+        e->count = count;
+        e->datatype = type;
+        e->ticket = 0;
+        if (copy != NULL || flipit_mpiElement(type, &e->size, &e->type))
+            __atomic_store_n(&FLIPIT_NumMPIPending, FLIPIT_NumMPIPending + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&FLIPIT_MPIPendingLock, 0, __ATOMIC_RELEASE);
+}
+
+/* Mark the tracked requests among requests with a new ticket and the index of their status;
+   returns the ticket, or 0 if there are none */
+static uint32_t flipit_markMPIPending(MPI_Request* requests, int count) {
+    uint32_t i, ticket, marked = 0;
+    int j;
+
+    if (0 == __atomic_load_n(&FLIPIT_NumMPIPending, __ATOMIC_RELAXED))
+        return 0;
+    flipit_lock(&FLIPIT_MPIPendingLock);
+    if (++FLIPIT_MPITicket == 0)
+        ++FLIPIT_MPITicket;
+    ticket = FLIPIT_MPITicket;
+    for (i = 0; i < FLIPIT_NumMPIPending; i++)
+        for (j = 0; j < count; j++)
+            if (FLIPIT_MPIPending[i].request == requests[j]) {
+                FLIPIT_MPIPending[i].ticket = ticket;
+                FLIPIT_MPIPending[i].index = j;
+                marked = 1;
+                break;
+            }
+    __atomic_store_n(&FLIPIT_MPIPendingLock, 0, __ATOMIC_RELEASE);
+    return marked ? ticket : 0;
+}
+
+/* Free the send copies and corrupt the receive buffers of the requests marked with ticket that
+   the call completed. Without indices, completed is whether it completed all of them and their
+   statuses are at their index; else it completed the completed requests at indices (for
+   MPI_Waitany and MPI_Waitsome), whose statuses are in the same order. Receive buffers are
+   corrupted within the count received. */
+static void flipit_completeMPIPending(uint32_t ticket, int completed, const int* indices,
+                                      MPI_Status* statuses) {
+    flipit_mpi_pending_t* e;
+    MPI_Status* status;
+    uint32_t i;
+    int k, received;
+
+    if (ticket == 0)
+        return;
+    flipit_lock(&FLIPIT_MPIPendingLock);
+    for (i = 0; i < FLIPIT_NumMPIPending; i++) {
+        e = &FLIPIT_MPIPending[i];
+        if (e->ticket != ticket)
+            continue;
+        e->ticket = 0;
+        status = NULL;
+        if (indices == NULL && completed)
+            status = &statuses[e->index];
+        for (k = 0; indices != NULL && k < completed; k++)
+            if (indices[k] == e->index)
+                status = &statuses[k];
+        if (status == NULL)
+            continue;
+        if (e->copy != NULL)
+            free(e->copy);
+        else if (PMPI_Get_count(status, e->datatype, &received) == MPI_SUCCESS
+                 && received != MPI_UNDEFINED)
+            flipit_corruptMPIElements(FLIPIT_MPI_IRECV_BUF, e->buf,
+                                      received < e->count ? received : e->count, e->size,
+                                      e->type, 0);
+        *e = FLIPIT_MPIPending[FLIPIT_NumMPIPending - 1];
+        __atomic_store_n(&FLIPIT_NumMPIPending, FLIPIT_NumMPIPending - 1, __ATOMIC_RELAXED);
+        i--;
+    }
+    __atomic_store_n(&FLIPIT_MPIPendingLock, 0, __ATOMIC_RELEASE);
+}
+
+/* Stop tracking a request freed with MPI_Request_free: its completion is never seen. A send copy
+   may still be read by MPI, so it is left to leak. */
+static void flipit_dropMPIPending(MPI_Request request) {
+    uint32_t i;
+
+    if (0 == __atomic_load_n(&FLIPIT_NumMPIPending, __ATOMIC_RELAXED))
+        return;
+    flipit_lock(&FLIPIT_MPIPendingLock);
+    for (i = 0; i < FLIPIT_NumMPIPending; i++)
+        if (FLIPIT_MPIPending[i].request == request) {
+            FLIPIT_MPIPending[i] = FLIPIT_MPIPending[FLIPIT_NumMPIPending - 1];
+            __atomic_store_n(&FLIPIT_NumMPIPending, FLIPIT_NumMPIPending - 1, __ATOMIC_RELAXED);
+            break;
+        }
+    __atomic_store_n(&FLIPIT_MPIPendingLock, 0, __ATOMIC_RELEASE);
+}
+
+/* Open the message log of the rank: the golden run writes it, the faulty run reads it whole */
+static void flipit_openMsgLog() {
+    char filename[500];
+    flipit_msg_header_t header;
+    flipit_msg_record_t r;
+    FILE* file;
+
+    snprintf(filename, sizeof(filename), "%s_%u", FLIPIT_MsgLog, FLIPIT_Rank);
+    if (FLIPIT_WriteMsgLog) {
+        FLIPIT_MsgFile = fopen(filename, "wb");
+        if (FLIPIT_MsgFile == NULL) {
+            fprintf(stderr, "FlipIt: unable to write message log %s\n", filename);
+            FLIPIT_MsgLog = NULL;
+            return;
+        }
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, FLIPIT_MSG_MAGIC, sizeof(header.magic));
+        header.version = FLIPIT_MSG_VERSION;
+        header.rank = FLIPIT_Rank;
+        header.recordSize = sizeof(flipit_msg_record_t);
+        fwrite(&header, sizeof(header), 1, FLIPIT_MsgFile);
+        return;
+    }
+
+    file = fopen(filename, "rb");
+    if (file == NULL || fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, FLIPIT_MSG_MAGIC, sizeof(header.magic)) != 0
+        || header.version != FLIPIT_MSG_VERSION || header.recordSize != sizeof(r)) {
+        fprintf(stderr, "FlipIt: unable to read message log %s\n", filename);
+        if (file != NULL)
+            fclose(file);
+        FLIPIT_MsgLog = NULL;
+        return;
+    }
+    /* records of threads sending at once are out of order, and persistent mode golden runs
+       write each message once per trial */
+    while (fread(&r, sizeof(r), 1, file) == 1) {
+        if (r.message >= FLIPIT_NumMsgGolden) {
+            uint64_t n = FLIPIT_NumMsgGolden == 0 ? 1024 : FLIPIT_NumMsgGolden;
+            while (n <= r.message)
+                n *= 2;
+            FLIPIT_MsgGolden = (flipit_msg_record_t*) realloc(FLIPIT_MsgGolden,
+                                                              n * sizeof(flipit_msg_record_t));
+            memset(FLIPIT_MsgGolden + FLIPIT_NumMsgGolden, 0xFF,
+                   (n - FLIPIT_NumMsgGolden) * sizeof(flipit_msg_record_t));
+            FLIPIT_NumMsgGolden = n;
+        }
+        FLIPIT_MsgGolden[r.message] = r;
+    }
+    fclose(file);
 }
 
+static void flipit_closeMsgLog() {
+    if (FLIPIT_MsgFile != NULL)
+        fclose(FLIPIT_MsgFile);
+    FLIPIT_MsgFile = NULL;
+    free(FLIPIT_MsgGolden);
+    FLIPIT_MsgGolden = NULL;
+    FLIPIT_NumMsgGolden = 0;
+    FLIPIT_MsgLog = NULL;
+}
 
+/* Fletcher sums of the words of a message in FLIPIT_MSG_LANES independent lanes, so the loop
+   vectorises and runs at about memory bandwidth. The lanes are weighted by position when they
+   are combined, so that words swapped between lanes are caught as well. */
+static void flipit_messageSum(const uint8_t* data, uint64_t bytes, uint64_t sum[2]) {
+    uint64_t a[FLIPIT_MSG_LANES] = { 0 }, b[FLIPIT_MSG_LANES] = { 0 }, w[FLIPIT_MSG_LANES];
+    uint64_t x, i, blocks = bytes / sizeof(w);
+    uint32_t k;
+
+    for (i = 0; i < blocks; i++) {
+        memcpy(w, data + i * sizeof(w), sizeof(w));
+        for (k = 0; k < FLIPIT_MSG_LANES; k++) {
+            a[k] += w[k];
+            b[k] += a[k];
+        }
+    }
+    sum[0] = sum[1] = 0;
+    for (k = 0; k < FLIPIT_MSG_LANES; k++) {
+        sum[0] += a[k];
+        sum[1] += b[k] * (2 * k + 1);
+    }
+    /* the words after the last block, then the bytes after the last word */
+    for (i = blocks * sizeof(w); i < bytes; i += 8) {
+        x = 0;
+        memcpy(&x, data + i, bytes - i < 8 ? bytes - i : 8);
+        sum[0] += x;
+        sum[1] += sum[0];
+    }
+}
+
+/* Checksum a message of count elements the rank sends to dest of comm (FLIPIT_MSG_ALL for all
+   ranks), and write it to or compare it with the message log. Only the first valid elements are
+   read, in case the count was corrupted. */
+static void flipit_checkMessage(const void* buf, int count, int valid, MPI_Datatype type, int dest,
+                                MPI_Comm comm) {
+    flipit_msg_record_t r;
+    const flipit_msg_record_t* g;
+    uint32_t size;
+    uint8_t eventType;
+    int bytes;
+
+    if (FLIPIT_MsgLog == NULL || dest == MPI_PROC_NULL || dest == MPI_ROOT)
+        return;
+    /* a faulty run only reports the first corrupted message */
+    if (!FLIPIT_WriteMsgLog && __atomic_load_n(&FLIPIT_MsgDiverged, __ATOMIC_RELAXED))
+        return;
+    r.message = __atomic_fetch_add(&FLIPIT_NumMessages, 1, __ATOMIC_RELAXED);
+    r.bytes = 0;
+    r.sum[0] = r.sum[1] = 0;
+    if (count > 0 && flipit_mpiElement(type, &size, &eventType)) {
+        r.bytes = (uint64_t) count * size;
+        flipit_messageSum((const uint8_t*) buf, (uint64_t) (valid < count ? valid : count) * size,
+                          r.sum);
+    }
+    else if (count > 0 && PMPI_Type_size(type, &bytes) == MPI_SUCCESS)
+        r.bytes = (uint64_t) count * bytes;
+
+    if (FLIPIT_WriteMsgLog) {
+        flipit_lock(&FLIPIT_MsgLock);
+        fwrite(&r, sizeof(r), 1, FLIPIT_MsgFile);
+        __atomic_store_n(&FLIPIT_MsgLock, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    g = r.message < FLIPIT_NumMsgGolden ? &FLIPIT_MsgGolden[r.message] : NULL;
+    if (g == NULL || g->bytes != r.bytes || g->sum[0] != r.sum[0] || g->sum[1] != r.sum[1])
+        flipit_messageDiverged(r.message, dest, comm);
+}
+
+/* rank of comm (of its remote group for intercommunicators) in MPI_COMM_WORLD */
+static int32_t flipit_worldRank(MPI_Comm comm, int rank) {
+    MPI_Group group, world;
+    int inter = 0, worldRank = rank;
+
+    if (rank < 0 || comm == MPI_COMM_WORLD)
+        return rank;
+    PMPI_Comm_test_inter(comm, &inter);
+    if (inter)
+        PMPI_Comm_remote_group(comm, &group);
+    else
+        PMPI_Comm_group(comm, &group);
+    PMPI_Comm_group(MPI_COMM_WORLD, &world);
+    PMPI_Group_translate_ranks(group, 1, &rank, world, &worldRank);
+    PMPI_Group_free(&group);
+    PMPI_Group_free(&world);
+    return worldRank == MPI_UNDEFINED ? -1 : worldRank;
+}
+
+/* Report the first corrupted message of the rank, with its latency since the latest injection
+   as for FLIPIT_Detected. Without an injection on this thread the corruption came in a message. */
+static void flipit_messageDiverged(uint64_t message, int dest, MPI_Comm comm) {
+    uint64_t dynInsts = FLIPIT_TotalInsts;
+    flipit_thread_t* t = flipit_thread();
+    uint32_t injection = __atomic_load_n(&FLIPIT_LastInjection.injection, __ATOMIC_ACQUIRE);
+    uint64_t latency;
+    struct timespec now;
+    uint64_t time;
+    int32_t worldDest;
+    char to[32];
+
+    if (__atomic_exchange_n(&FLIPIT_MsgDiverged, 1, __ATOMIC_ACQ_REL))
+        return;
+    clock_gettime(CLOCK_REALTIME, &now);
+    time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    latency = flipit_injectionLatency(injection, t, dynInsts);
+    worldDest = flipit_worldRank(comm, dest);
+    FLIPIT_TrialMessage = message;
+    FLIPIT_TrialMessageInsts = latency;
+    FLIPIT_TrialMessageDest = worldDest;
+
+    if (FLIPIT_EventFd >= 0) {
+        uint64_t pos;
+        flipit_event_t* e = flipit_reserveEvent(&pos);
+        e->site = message;
+        e->dynInsts = dynInsts;
+        e->time = time;
+        e->prob = (double) worldDest;
+        e->p = injection != 0 ? (double) (time - FLIPIT_LastInjection.time) : -1.;
+        e->rank = FLIPIT_Rank;
+        e->thread = t->id;
+        e->injection = injection;
+        e->bit = 0;
+        e->kind = FLIPIT_EVENT_MESSAGE;
+        e->type = 0;
+        e->aux = latency;
+        flipit_publishEvent(pos);
+    }
+
+    if (FLIPIT_Banner) {
+        if (worldDest == FLIPIT_MSG_ALL)
+            snprintf(to, sizeof(to), "all ranks");
+        else
+            snprintf(to, sizeof(to), "rank %d", worldDest);
+        if (latency != UINT64_MAX)
+            printf("FlipIt: corrupted message %llu from rank %u to %s, %llu instructions after "
+                   "injection %u\n", (unsigned long long) message, FLIPIT_Rank, to,
+                   (unsigned long long) latency, injection);
+        else
+            printf("FlipIt: corrupted message %llu from rank %u to %s\n",
+                   (unsigned long long) message, FLIPIT_Rank, to);
+    }
+}
+
+int MPI_Send(const void* buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
+{
+    void* copy;
+    int ret, posted = count;
+
+    if (FLIPIT_MPIFaults == 0) {
+        flipit_checkMessage(buf, count, count, datatype, dest, comm);
+        return PMPI_Send(buf, count, datatype, dest, tag, comm);
+    }
+    copy = flipit_corruptMPIBuffer(FLIPIT_MPI_SEND_BUF, buf, count, datatype, 1);
+    if (copy != NULL)
+        buf = copy;
+    count = flipit_corruptMPIInt(FLIPIT_MPI_SEND_COUNT, count);
+    tag = flipit_corruptMPIInt(FLIPIT_MPI_SEND_TAG, tag);
+    flipit_checkMessage(buf, count, posted, datatype, dest, comm);
+    ret = PMPI_Send(buf, count, datatype, dest, tag, comm);
+    free(copy);
+    return ret;
+}
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm,
+              MPI_Request* request)
+{
+    void* copy = NULL;
+    int ret, posted = count;
+
+    if (FLIPIT_MPIFaults == 0) {
+        flipit_checkMessage(buf, count, count, datatype, dest, comm);
+        return PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+    }
+    /* the copy is freed when the request completes, so only while it can be tracked */
+    if (__atomic_load_n(&FLIPIT_NumMPIPending, __ATOMIC_RELAXED) < FLIPIT_MPI_PENDING)
+        copy = flipit_corruptMPIBuffer(FLIPIT_MPI_ISEND_BUF, buf, count, datatype, 1);
+    if (copy != NULL)
+        buf = copy;
+    count = flipit_corruptMPIInt(FLIPIT_MPI_ISEND_COUNT, count);
+    tag = flipit_corruptMPIInt(FLIPIT_MPI_ISEND_TAG, tag);
+    flipit_checkMessage(buf, count, posted, datatype, dest, comm);
+    ret = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+    if (copy != NULL) {
+        if (ret == MPI_SUCCESS)
+            flipit_addMPIPending(*request, buf, count, datatype, copy);
+        else
+            free(copy);
+    }
+    return ret;
+}
+
+int MPI_Recv(void* buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+             MPI_Status* status)
+{
+    MPI_Status local;
+    int ret, received, posted = count;
+
+    if (FLIPIT_MPIFaults == 0)
+        return PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+    if (status == MPI_STATUS_IGNORE)
+        status = &local;
+    count = flipit_corruptMPIInt(FLIPIT_MPI_RECV_COUNT, count);
+    tag = flipit_corruptMPIInt(FLIPIT_MPI_RECV_TAG, tag);
+    ret = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+    if (ret == MPI_SUCCESS && PMPI_Get_count(status, datatype, &received) == MPI_SUCCESS
+        && received != MPI_UNDEFINED)
+        flipit_corruptMPIBuffer(FLIPIT_MPI_RECV_BUF, buf, received < posted ? received : posted,
+                                datatype, 0);
+    return ret;
+}
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+              MPI_Request* request)
+{
+    int ret, posted = count;
+
+    if (FLIPIT_MPIFaults == 0)
+        return PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+    count = flipit_corruptMPIInt(FLIPIT_MPI_IRECV_COUNT, count);
+    tag = flipit_corruptMPIInt(FLIPIT_MPI_IRECV_TAG, tag);
+    ret = PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+    /* the buffer may be corrupted once MPI_Wait or MPI_Test completes the request */
+    if (ret == MPI_SUCCESS && (FLIPIT_MPIFaults & FLIPIT_MPI_RECV))
+        flipit_addMPIPending(*request, buf, posted, datatype, NULL);
+    return ret;
+}
+
+int MPI_Sendrecv(const void* sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag,
+                 void* recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag,
+                 MPI_Comm comm, MPI_Status* status)
+{
+    MPI_Status local;
+    void* copy;
+    int ret, received, sendposted = sendcount, recvposted = recvcount;
+
+    if (FLIPIT_MPIFaults == 0) {
+        flipit_checkMessage(sendbuf, sendcount, sendcount, sendtype, dest, comm);
+        return PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount,
+                             recvtype, source, recvtag, comm, status);
+    }
+    if (status == MPI_STATUS_IGNORE)
+        status = &local;
+    copy = flipit_corruptMPIBuffer(FLIPIT_MPI_SENDRECV_SEND, sendbuf, sendcount, sendtype, 1);
+    if (copy != NULL)
+        sendbuf = copy;
+    sendcount = flipit_corruptMPIInt(FLIPIT_MPI_SENDRECV_SEND_COUNT, sendcount);
+    sendtag = flipit_corruptMPIInt(FLIPIT_MPI_SENDRECV_SEND_TAG, sendtag);
+    recvcount = flipit_corruptMPIInt(FLIPIT_MPI_SENDRECV_RECV_COUNT, recvcount);
+    recvtag = flipit_corruptMPIInt(FLIPIT_MPI_SENDRECV_RECV_TAG, recvtag);
+    flipit_checkMessage(sendbuf, sendcount, sendposted, sendtype, dest, comm);
+    ret = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype,
+                        source, recvtag, comm, status);
+    free(copy);
+    if (ret == MPI_SUCCESS && PMPI_Get_count(status, recvtype, &received) == MPI_SUCCESS
+        && received != MPI_UNDEFINED)
+        flipit_corruptMPIBuffer(FLIPIT_MPI_SENDRECV_RECV, recvbuf,
+                                received < recvposted ? received : recvposted, recvtype, 0);
+    return ret;
+}
+
+int MPI_Bcast(void* buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm)
+{
+    int ret, rank;
+
+    if (FLIPIT_MsgLog != NULL) {
+        PMPI_Comm_rank(comm, &rank);
+        if (root == MPI_ROOT || rank == root)
+            flipit_checkMessage(buffer, count, count, datatype, FLIPIT_MSG_ALL, comm);
+    }
+    ret = PMPI_Bcast(buffer, count, datatype, root, comm);
+    if (FLIPIT_MPIFaults == 0 || ret != MPI_SUCCESS)
+        return ret;
+    PMPI_Comm_rank(comm, &rank);
+    if (rank != root)
+        flipit_corruptMPIBuffer(FLIPIT_MPI_BCAST_BUF, buffer, count, datatype, 0);
+    return ret;
+}
+
+int MPI_Reduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype datatype, MPI_Op op,
+               int root, MPI_Comm comm)
+{
+    int ret, rank;
+
+    flipit_checkMessage(sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf, count, count, datatype, root,
+                        comm);
+    ret = PMPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm);
+    if (FLIPIT_MPIFaults == 0 || ret != MPI_SUCCESS)
+        return ret;
+    PMPI_Comm_rank(comm, &rank);
+    if (rank == root)
+        flipit_corruptMPIBuffer(FLIPIT_MPI_REDUCE_RESULT, recvbuf, count, datatype, 0);
+    return ret;
+}
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype datatype,
+                  MPI_Op op, MPI_Comm comm)
+{
+    int ret;
+
+    flipit_checkMessage(sendbuf == MPI_IN_PLACE ? recvbuf : sendbuf, count, count, datatype,
+                        FLIPIT_MSG_ALL, comm);
+    ret = PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+    if (FLIPIT_MPIFaults != 0 && ret == MPI_SUCCESS)
+        flipit_corruptMPIBuffer(FLIPIT_MPI_ALLREDUCE_RESULT, recvbuf, count, datatype, 0);
+    return ret;
+}
+
+/* The wait and test calls need the statuses of tracked receives for their counts */
+int MPI_Wait(MPI_Request* request, MPI_Status* status)
+{
+    MPI_Status local;
+    uint32_t ticket = flipit_markMPIPending(request, 1);
+    int ret;
+
+    if (ticket != 0 && status == MPI_STATUS_IGNORE)
+        status = &local;
+    ret = PMPI_Wait(request, status);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS, NULL, status);
+    return ret;
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+    MPI_Status* local = NULL;
+    uint32_t ticket = flipit_markMPIPending(requests, count);
+    int ret;
+
+    if (ticket != 0 && statuses == MPI_STATUSES_IGNORE)
+        statuses = local = (MPI_Status*) malloc(sizeof(MPI_Status) * count);
+    ret = PMPI_Waitall(count, requests, statuses == NULL ? MPI_STATUSES_IGNORE : statuses);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && statuses != NULL, NULL, statuses);
+    free(local);
+    return ret;
+}
+
+int MPI_Waitany(int count, MPI_Request requests[], int* index, MPI_Status* status)
+{
+    MPI_Status local;
+    uint32_t ticket = flipit_markMPIPending(requests, count);
+    int ret;
+
+    if (ticket != 0 && status == MPI_STATUS_IGNORE)
+        status = &local;
+    ret = PMPI_Waitany(count, requests, index, status);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && *index != MPI_UNDEFINED, index,
+                              status);
+    return ret;
+}
+
+int MPI_Waitsome(int incount, MPI_Request requests[], int* outcount, int indices[],
+                 MPI_Status statuses[])
+{
+    MPI_Status* local = NULL;
+    uint32_t ticket = flipit_markMPIPending(requests, incount);
+    int ret;
+
+    if (ticket != 0 && statuses == MPI_STATUSES_IGNORE)
+        statuses = local = (MPI_Status*) malloc(sizeof(MPI_Status) * incount);
+    ret = PMPI_Waitsome(incount, requests, outcount, indices,
+                        statuses == NULL ? MPI_STATUSES_IGNORE : statuses);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && statuses != NULL
+                              && *outcount != MPI_UNDEFINED ? *outcount : 0, indices, statuses);
+    free(local);
+    return ret;
+}
+
+int MPI_Test(MPI_Request* request, int* flag, MPI_Status* status)
+{
+    MPI_Status local;
+    uint32_t ticket = flipit_markMPIPending(request, 1);
+    int ret;
+
+    if (ticket != 0 && status == MPI_STATUS_IGNORE)
+        status = &local;
+    ret = PMPI_Test(request, flag, status);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && *flag, NULL, status);
+    return ret;
+}
+
+int MPI_Testall(int count, MPI_Request requests[], int* flag, MPI_Status statuses[])
+{
+    MPI_Status* local = NULL;
+    uint32_t ticket = flipit_markMPIPending(requests, count);
+    int ret;
+
+    if (ticket != 0 && statuses == MPI_STATUSES_IGNORE)
+        statuses = local = (MPI_Status*) malloc(sizeof(MPI_Status) * count);
+    ret = PMPI_Testall(count, requests, flag, statuses == NULL ? MPI_STATUSES_IGNORE : statuses);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && *flag && statuses != NULL, NULL,
+                              statuses);
+    free(local);
+    return ret;
+}
+
+int MPI_Testany(int count, MPI_Request requests[], int* index, int* flag, MPI_Status* status)
+{
+    MPI_Status local;
+    uint32_t ticket = flipit_markMPIPending(requests, count);
+    int ret;
+
+    if (ticket != 0 && status == MPI_STATUS_IGNORE)
+        status = &local;
+    ret = PMPI_Testany(count, requests, index, flag, status);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && *flag && *index != MPI_UNDEFINED,
+                              index, status);
+    return ret;
+}
+
+int MPI_Testsome(int incount, MPI_Request requests[], int* outcount, int indices[],
+                 MPI_Status statuses[])
+{
+    MPI_Status* local = NULL;
+    uint32_t ticket = flipit_markMPIPending(requests, incount);
+    int ret;
+
+    if (ticket != 0 && statuses == MPI_STATUSES_IGNORE)
+        statuses = local = (MPI_Status*) malloc(sizeof(MPI_Status) * incount);
+    ret = PMPI_Testsome(incount, requests, outcount, indices,
+                        statuses == NULL ? MPI_STATUSES_IGNORE : statuses);
+    flipit_completeMPIPending(ticket, ret == MPI_SUCCESS && statuses != NULL
+                              && *outcount != MPI_UNDEFINED ? *outcount : 0, indices, statuses);
+    free(local);
+    return ret;
+}
+
+int MPI_Request_free(MPI_Request* request)
+{
+    flipit_dropMPIPending(*request);
+    return PMPI_Request_free(request);
+}
+#endif
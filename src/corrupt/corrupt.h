@@ -13,6 +13,11 @@
 /*                                                                                             */
 /***********************************************************************************************/
 
+/* libcorrupt_mpi.a is built with FLIPIT_MPI */
+#ifdef FLIPIT_MPI
+#include <mpi.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif 
@@ -35,6 +40,44 @@ extern "C" {
 #define FLIPIT_ON 1
 #define FLIPIT_OFF 0
 
+/* trial outcomes for FLIPIT_TrialEnd; applications may use their own values as well */
+#define FLIPIT_OUTCOME_BENIGN 0   /* output matches the fault free run */
+#define FLIPIT_OUTCOME_SDC 1      /* silent data corruption */
+#define FLIPIT_OUTCOME_DETECTED 2 /* detected by the application */
+#define FLIPIT_OUTCOME_FAILED 3   /* application error, e.g. no convergence */
+
+/* one row of the persistent mode results table */
+typedef struct {
+    uint64_t trial;
+    uint64_t dynInsts;      /* runtime calls of the thread calling FLIPIT_TrialEnd */
+    uint32_t injections;
+    uint32_t site;          /* of the first injection, UINT32_MAX if none */
+    uint32_t bit;
+    int32_t outcome;
+    uint64_t message;       /* first corrupted message the rank sent (--msgLog), else UINT64_MAX */
+    uint64_t messageInsts;  /* its latency since the injection, UINT64_MAX if unknown */
+    int32_t messageDest;    /* its destination rank, -1 for all ranks */
+} flipit_trial_result_t;
+
+/* element types of registered output regions */
+#define FLIPIT_OUTPUT_BYTES 0   /* compared bit for bit */
+#define FLIPIT_OUTPUT_INT32 1
+#define FLIPIT_OUTPUT_INT64 2
+#define FLIPIT_OUTPUT_FLOAT 3
+#define FLIPIT_OUTPUT_DOUBLE 4
+
+/* comparison of an output region with the golden run */
+typedef struct {
+    uint64_t differing;     /* elements off by more than the tolerance */
+    uint64_t first;         /* index of the first differing element */
+    uint64_t worst;         /* index of the largest difference */
+    double maxError;        /* largest absolute difference, inf for NaN */
+} flipit_output_result_t;
+
+/* how the runtime decides that a site is faulty */
+#define FLIPIT_SAMPLE_BERNOULLI 0 /* one random draw per site */
+#define FLIPIT_SAMPLE_GEOMETRIC 1 /* draw the distance to the next injection */
+
 
 /* setting up and house keeping */
 void FLIPIT_Init(uint32_t myRank, uint32_t argc, char** argv, uint64_t seed);
@@ -42,13 +85,43 @@ void FLIPIT_Finalize(char* filename);
 void FLIPIT_SetInjector(int state);
 void FLIPIT_SetRankInject(int state);
 void FLIPIT_SetFaultProbability(double(faultProb)());
+void FLIPIT_SetSampler(int sampler);
+void FLIPIT_SetThreadId(uint32_t id);
 void FLIPIT_SetCustomLogger(void (customLogger)(FILE*));
+void FLIPIT_SetEventLog(char* prefix);
+int FLIPIT_AddSiteLog(char* path);
+void FLIPIT_SetBanner(int state);
 void FLIPIT_CountdownTimer(unsigned long numInstructions);
+/* a lower bound once the runtime disarms, unless every module is compiled with -countInsts */
 unsigned long long FLIPIT_GetExecutedInstructionCount();
 int FLIPIT_GetInjectionCount();
 void FLIPIT_SetMaxInjections(int n);
 int FLIPIT_GetMaxInjections();
 
+/* persistent mode: many trials in one process */
+void FLIPIT_TrialBegin(uint64_t trial);
+int FLIPIT_TrialEnd(int outcome);
+int FLIPIT_GetTrialResults(const flipit_trial_result_t** results);
+void FLIPIT_WriteTrialResults(char* filename);
+
+/* detectors report errors they find, logged with the latency since the latest injection */
+long long FLIPIT_Detected(const char* detector);
+
+/* golden output comparison */
+int FLIPIT_RegisterOutput(char* name, void* data, uint64_t count, int type, double tolerance);
+void FLIPIT_SetGolden(char* filename, int write);
+int FLIPIT_CheckOutputs();
+int FLIPIT_GetOutputResult(int output, flipit_output_result_t* result);
+
+/* faults in memory at rest (--memRate, --memInsts) */
+int FLIPIT_RegisterRegion(void* data, uint64_t bytes, const char* label);
+void FLIPIT_UnregisterRegion(void* data);
+
+#ifdef FLIPIT_MPI
+/* job-wide injection budget and target (--global, --globalInsts, --globalCounts, --globalTarget) */
+void FLIPIT_SetGlobalComm(MPI_Comm comm);
+#endif
+
 /* FORTRAN VERSIONS (ex: CALL flipit_init_ftn(myrank, argc, argv, seed) */
 int flipit_init_ftn_(int* myRank, int* argc, char*** argv, unsigned long long* seed);
 int flipit_finalize_ftn_(char** filename);
@@ -57,12 +130,66 @@ int flipit_setrankinject_ftn_(int* state);
 /* void flipit_setfaultprobability_ftn_(double(faultProb)()); */
 /* void flipit_setcustomlogger_ftn_(void (customLogger)(FILE*)); */
 int flipit_countdowntimer_ftn_(unsigned long* numInstructions);
+int flipit_setsampler_ftn_(int* sampler);
+int flipit_setthreadid_ftn_(int* id);
+int flipit_seteventlog_ftn_(char** prefix);
+int flipit_addsitelog_ftn_(char** path);
+int flipit_setbanner_ftn_(int* state);
+int flipit_trialbegin_ftn_(unsigned long long* trial);
+int flipit_trialend_ftn_(int* outcome);
+int flipit_writetrialresults_ftn_(char** filename);
+long long flipit_detected_ftn_(char** detector);
+int flipit_registeroutput_ftn_(char** name, void* data, long long* count, int* type,
+                               double* tolerance);
+int flipit_setgolden_ftn_(char** filename, int* write);
+int flipit_checkoutputs_ftn_();
+int flipit_registerregion_ftn_(void* data, long long* bytes, char** label);
+int flipit_unregisterregion_ftn_(void* data);
+#ifdef FLIPIT_MPI
+int flipit_setglobalcomm_ftn_(MPI_Fint* comm);
+#endif
+
+/* runtime state tested inline by the compiler pass (faults.cpp) */
+extern uint32_t FLIPIT_Armed;
+extern __thread uint64_t FLIPIT_TotalInsts; /* per thread */
+
+/* corrupt the data at a site, any byte and bit */
+uint8_t  corruptIntData_8bit    (uint32_t site, double prob, uint8_t inst_data);
+uint16_t corruptIntData_16bit   (uint32_t site, double prob, uint16_t inst_data);
+uint32_t corruptIntData_32bit   (uint32_t site, double prob, uint32_t inst_data);
+float      corruptFloatData_32bit (uint32_t site, double prob, float inst_data);
+uint64_t corruptIntData_64bit   (uint32_t site, double prob, uint64_t inst_data);
+double     corruptFloatData_64bit (uint32_t site, double prob, double inst_data);
+uint64_t corruptPtr2Int_64bit   (uint32_t site, double prob, uint64_t inst_data);
+
+/* specialised by the pass: random byte and bit, or a fixed byte and bit */
+uint8_t  corruptIntData_8bit_rand     (uint32_t site, double prob, uint8_t inst_data);
+uint16_t corruptIntData_16bit_rand    (uint32_t site, double prob, uint16_t inst_data);
+uint32_t corruptIntData_32bit_rand    (uint32_t site, double prob, uint32_t inst_data);
+uint64_t corruptIntData_64bit_rand    (uint32_t site, double prob, uint64_t inst_data);
+float    corruptFloatData_32bit_rand  (uint32_t site, double prob, float inst_data);
+double   corruptFloatData_64bit_rand  (uint32_t site, double prob, double inst_data);
+uint64_t corruptPtr2Int_64bit_rand    (uint32_t site, double prob, uint64_t inst_data);
+uint8_t  corruptIntData_8bit_fixed    (uint32_t site, double prob, uint8_t inst_data, uint32_t byte,
+                                       uint32_t bit);
+uint16_t corruptIntData_16bit_fixed   (uint32_t site, double prob, uint16_t inst_data, uint32_t byte,
+                                       uint32_t bit);
+uint32_t corruptIntData_32bit_fixed   (uint32_t site, double prob, uint32_t inst_data, uint32_t byte,
+                                       uint32_t bit);
+uint64_t corruptIntData_64bit_fixed   (uint32_t site, double prob, uint64_t inst_data, uint32_t byte,
+                                       uint32_t bit);
+float    corruptFloatData_32bit_fixed (uint32_t site, double prob, float inst_data, uint32_t byte,
+                                       uint32_t bit);
+double   corruptFloatData_64bit_fixed (uint32_t site, double prob, double inst_data, uint32_t byte,
+                                       uint32_t bit);
+uint64_t corruptPtr2Int_64bit_fixed   (uint32_t site, double prob, uint64_t inst_data, uint32_t byte,
+                                       uint32_t bit);
 
-/* corrupt the data */
-float      corruptFloatData_32bit (uint32_t parameter, double prob, float inst_data);
-uint64_t corruptIntData_64bit   (uint32_t parameter, double prob, uint64_t inst_data);
-double     corruptFloatData_64bit (uint32_t parameter, double prob, double inst_data);
-uint64_t corruptPtr2Int_64bit   (uint32_t parameter, double prob, uint64_t inst_data);
+/* vectors are corrupted in place; type is 0 int, 1 float, 2 double, 3 pointer elements, and
+   byte (within a lane) and bit are fixed or 0xF for any */
+void     corruptVectorData      (uint32_t site, double prob, void* data, uint32_t lanes,
+                                 uint32_t laneBytes, uint32_t type, uint32_t byte,
+                                 uint32_t bit);
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,638 @@
+/***********************************************************************************************/
+/* This file is licensed under the University of Illinois/NCSA Open Source License.            */
+/* See LICENSE.TXT for details.                                                                */
+/***********************************************************************************************/
+
+/***********************************************************************************************/
+/*                                                                                             */
+/* Name: ingest.cpp                                                                            */
+/*                                                                                             */
+/* Description: flipit-ingest, the native loader of the analysis database. Reads the fault     */
+/*              site logs (*.LLVM.bin) and the trial outputs and event logs of a campaign on   */
+/*              several threads, and writes the sites, trials, injections, signals,            */
+/*              detections and propagations tables of scripts/analysis/database.py in one      */
+/*              transaction. The rows are the ones readLLVM() and readTrials() would insert.   */
+/*                                                                                             */
+/*              e.g. flipit-ingest -d campaign.db -l ../llvm -t ../trials/foo -n 100000        */
+/*                                                                                             */
+/***********************************************************************************************/
+
+#include "../sites/siteLog.h"
+
+#include <sqlite3.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/* defaults are those of analysis_config.py */
+struct Options
+{
+    std::string db = "campaign.db";
+    std::string llvm;
+    std::string trials;
+    std::string events;          /* event_log_prefix, empty to read the banners */
+    long numTrials = 100;
+    unsigned jobs = 0;
+    std::string detect = "Foo Check";
+    std::string assertion = "Assertion";
+    std::string bus = "exit signal Bus error";
+    std::string seg = "Sig 11";
+    std::string siteStart = "/*********************************Start**************************************/";
+    std::string siteEnd = "/*********************************End**************************************/";
+};
+
+struct SiteRow
+{
+    uint64_t site;
+    std::string type;
+    std::string comment;
+    std::string file;
+    std::string function;
+    uint32_t line;
+    std::string opcode;
+};
+
+struct Log
+{
+    std::string path;
+    uint64_t module;
+    bool global;                 /* version 1: indexes are already global */
+    uint32_t numSites;
+    uint64_t base;
+    std::vector<SiteRow> rows;
+};
+
+struct Injection
+{
+    uint64_t site;
+    uint32_t rank;
+    double prob;
+    uint32_t bit;
+    uint64_t cycle;
+    bool arithFP;
+};
+
+/* the first corrupted message a rank sent */
+struct Propagation
+{
+    uint64_t message;
+    uint32_t source;
+    int32_t dest;
+    int64_t latency;
+};
+
+struct Trial
+{
+    bool exists = false;
+    std::string path;
+    int numInj = 0;
+    bool crashed = false;
+    bool detected = false;
+    bool signal = false;
+    std::vector<Injection> injections;
+    std::vector<std::pair<int64_t, std::string> > detections;
+    std::vector<Propagation> propagations;
+    std::vector<int> signals;
+};
+
+/* the event log records written by corrupt.c (see eventParser.py) */
+const char EventMagic[] = "FIEV";
+const uint32_t EventVersion = 1;
+const uint8_t EventInjection = 0;
+const uint8_t EventDetection = 1;
+const uint8_t EventDetector = 2;
+const uint8_t EventMessage = 3;
+const unsigned DetectorName = 40;
+
+struct EventHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t rank;
+    uint32_t recordSize;
+};
+
+struct Event
+{
+    uint64_t site;
+    uint64_t dynInsts;
+    uint64_t time;
+    double prob;
+    double p;
+    uint32_t rank;
+    uint32_t thread;
+    uint32_t injection;
+    uint16_t bit;
+    uint8_t kind;
+    uint8_t type;
+    uint64_t aux;
+};
+
+void usage()
+{
+    fprintf(stderr, "Usage: flipit-ingest -d db -l llvmPath -t trialPrefix [-n numTrials] [-e eventPrefix]\n"
+                    "                     [-j jobs] [--detect msg] [--assert msg] [--bus msg] [--seg msg]\n");
+    exit(1);
+}
+
+bool readFile(const std::string& path, std::string& data)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+        return false;
+    char buf[1 << 16];
+    size_t n;
+    data.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+bool isFile(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+bool endsWith(const std::string& s, const std::string& end)
+{
+    return s.size() >= end.size() && s.compare(s.size() - end.size(), end.size(), end) == 0;
+}
+
+void findLogs(const std::string& dir, std::vector<Log>& logs)
+{
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL)
+        return;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        std::string name = e->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            findLogs(path, logs);
+        else if (endsWith(name, "LLVM.bin")) {
+            Log log;
+            log.path = path;
+            logs.push_back(log);
+        }
+    }
+    closedir(d);
+}
+
+/* binaryParser.type2Str and info2Str */
+const char* typeName(uint8_t type)
+{
+    static const char* names[] = { "Arith-FP", "Pointer", "Arith-Fix", "Control-Loop", "Control-Branch" };
+    return type < 5 ? names[type] : "Unknown";
+}
+
+std::string comment(const flipit_site_info_t& s)
+{
+    std::string c;
+    if (s.info == 0)
+        c = strcasecmp(s.opcode, "store") == 0 ? "Value" : "Result";
+    else if (s.info == 30)
+        c = "Unknown";
+    else
+        c = "Arg " + std::to_string(s.info - 1);
+    if (s.lanes != 0)
+        c += " (Vector " + std::to_string(s.lanes) + ")";
+    return c;
+}
+
+void readLog(Log& log)
+{
+    flipit_sitelog_t* l = flipit_sitelogOpen(log.path.c_str());
+    const flipit_sitelog_header_t* h = flipit_sitelogHeader(l);
+    log.rows.reserve(h->numSites);
+    for (uint32_t i = h->firstSite; i < h->firstSite + h->numSites; i++) {
+        flipit_site_info_t s;
+        if (!flipit_sitelogSite(l, i, &s))
+            continue;
+        SiteRow r;
+        r.site = log.base + i;
+        r.type = typeName(s.type);
+        r.comment = comment(s);
+        r.file = s.file[0] != '\0' ? s.file : "__NF";
+        r.function = s.function;
+        r.line = s.line;
+        r.opcode = s.opcode;
+        log.rows.push_back(r);
+    }
+    flipit_sitelogClose(l);
+}
+
+/* last space separated token of a banner line, as split(" ")[-1] */
+std::string lastToken(const std::string& line)
+{
+    size_t pos = line.rfind(' ');
+    return pos == std::string::npos ? line : line.substr(pos + 1);
+}
+
+void readEvents(const Options& opt, long trial, Trial& t)
+{
+    std::string prefix = opt.events + "_" + std::to_string(trial);
+    std::string dir = ".", base = prefix;
+    size_t slash = prefix.rfind('/');
+    if (slash != std::string::npos) {
+        dir = prefix.substr(0, slash);
+        base = prefix.substr(slash + 1);
+    }
+
+    std::vector<std::string> files;
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL)
+        return;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        std::string name = e->d_name;
+        if (name.size() > base.size() + 1 && name.compare(0, base.size() + 1, base + "_") == 0 &&
+            name.find_first_not_of("0123456789", base.size() + 1) == std::string::npos)
+            files.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+
+    std::vector<Event> events;
+    std::map<std::pair<uint32_t, uint32_t>, std::string> names;
+    for (size_t f = 0; f < files.size(); f++) {
+        std::string data;
+        EventHeader h;
+        if (!readFile(files[f], data) || data.size() < sizeof(h))
+            continue;
+        memcpy(&h, data.data(), sizeof(h));
+        if (memcmp(h.magic, EventMagic, 4) != 0 || h.version != EventVersion ||
+            h.recordSize < sizeof(Event)) {
+            fprintf(stderr, "Not a FlipIt event log: %s\n", files[f].c_str());
+            exit(1);
+        }
+        /* a crashed run may leave a partial record at the end */
+        for (size_t pos = sizeof(h); pos + h.recordSize <= data.size(); pos += h.recordSize) {
+            Event ev;
+            memcpy(&ev, data.data() + pos, sizeof(ev));
+            if (ev.kind == EventDetector) {
+                const char* name = data.data() + pos;
+                names[std::make_pair(ev.rank, (uint32_t) ev.bit)] = std::string(name, strnlen(name, DetectorName));
+            }
+            events.push_back(ev);
+        }
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event& a, const Event& b) { return a.time < b.time; });
+
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event& ev = events[i];
+        if (ev.kind == EventDetection) {
+            auto name = names.find(std::make_pair(ev.rank, (uint32_t) ev.bit));
+            t.detected = true;
+            t.detections.push_back(std::make_pair(ev.aux == UINT64_MAX ? -1 : (int64_t) ev.aux,
+                                                  name != names.end() ? name->second : "---"));
+        }
+        if (ev.kind == EventMessage) {
+            Propagation m = { ev.site, ev.rank, (int32_t) ev.prob,
+                              ev.aux == UINT64_MAX ? -1 : (int64_t) ev.aux };
+            t.propagations.push_back(m);
+        }
+        if (ev.kind != EventInjection)
+            continue;
+        Injection inj = { ev.site, ev.rank, ev.prob, ev.bit, ev.dynInsts, ev.type == 1 || ev.type == 2 };
+        t.injections.push_back(inj);
+        t.numInj++;
+    }
+}
+
+/* readTrials() for one trial */
+void readTrial(const Options& opt, long trial, Trial& t)
+{
+    std::string data;
+    t.path = opt.trials + "_" + std::to_string(trial);
+    if (!isFile(t.path)) {
+        t.path += ".txt";
+        if (!isFile(t.path))
+            return;
+    }
+    if (!readFile(t.path, data))
+        return;
+    t.exists = true;
+
+    bool events = false;
+    if (!opt.events.empty()) {
+        readEvents(opt, trial, t);
+        events = t.numInj > 0;
+    }
+
+    std::vector<std::string> lines;
+    for (size_t pos = 0; pos < data.size(); ) {
+        size_t end = data.find('\n', pos);
+        if (end == std::string::npos)
+            end = data.size();
+        lines.push_back(data.substr(pos, end - pos));
+        pos = end + 1;
+    }
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        const std::string& l = lines[i];
+        if (l.find(opt.siteStart) != std::string::npos) {
+            std::vector<std::string> inj;
+            for (i++; i < lines.size() && lines[i].find(opt.siteEnd) == std::string::npos; i++)
+                if (!lines[i].empty())
+                    inj.push_back(lines[i]);
+            if (!events) {
+                t.numInj++;
+                if (inj.size() >= 8) {
+                    Injection in;
+                    in.arithFP = inj[0].find("IEEE") != std::string::npos;
+                    in.rank = strtoul(lastToken(inj[1]).c_str(), NULL, 10);
+                    in.bit = strtoul(lastToken(inj[3]).c_str(), NULL, 10);
+                    in.site = strtoull(lastToken(inj[4]).c_str(), NULL, 10);
+                    in.prob = strtod(lastToken(inj[5]).c_str(), NULL);
+                    in.cycle = strtoull(lastToken(inj[7]).c_str(), NULL, 10);
+                    t.injections.push_back(in);
+                }
+            }
+            if (i == lines.size())
+                break;
+        }
+        const std::string& m = lines[i];
+        if (m.find(opt.detect) != std::string::npos) {
+            t.detected = true;
+            if (t.detections.empty())
+                t.detections.push_back(std::make_pair(-1, "---"));
+        }
+        if (m.find(opt.assertion) != std::string::npos) {
+            t.signal = t.crashed = true;
+            t.signals.push_back(6);
+        }
+        if (m.find(opt.bus) != std::string::npos) {
+            t.signal = t.crashed = true;
+            t.signals.push_back(10);
+        }
+        if (m.find(opt.seg) != std::string::npos) {
+            t.signal = t.crashed = true;
+            t.signals.push_back(11);
+        }
+    }
+}
+
+/* runs work(i) for i in [0, n) on jobs threads */
+template <typename F>
+void parallelFor(size_t n, unsigned jobs, F work)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (unsigned j = 0; j < jobs; j++)
+        threads.push_back(std::thread([&]() {
+            for (size_t i = next++; i < n; i = next++)
+                work(i);
+        }));
+    for (size_t j = 0; j < threads.size(); j++)
+        threads[j].join();
+}
+
+void check(sqlite3* db, int rc, const char* what)
+{
+    if (rc != SQLITE_OK && rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        fprintf(stderr, "flipit-ingest: %s: %s\n", what, sqlite3_errmsg(db));
+        exit(1);
+    }
+}
+
+void exec(sqlite3* db, const char* sql)
+{
+    check(db, sqlite3_exec(db, sql, NULL, NULL, NULL), sql);
+}
+
+sqlite3_stmt* prepare(sqlite3* db, const char* sql)
+{
+    sqlite3_stmt* s;
+    check(db, sqlite3_prepare_v2(db, sql, -1, &s, NULL), sql);
+    return s;
+}
+
+void step(sqlite3* db, sqlite3_stmt* s)
+{
+    check(db, sqlite3_step(s), sqlite3_sql(s));
+    sqlite3_reset(s);
+}
+
+void bindText(sqlite3_stmt* s, int i, const std::string& text)
+{
+    sqlite3_bind_text(s, i, text.c_str(), text.size(), SQLITE_TRANSIENT);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (i + 1 >= argc)
+            usage();
+        if (a == "-d" || a == "--db")
+            opt.db = argv[++i];
+        else if (a == "-l" || a == "--llvm")
+            opt.llvm = argv[++i];
+        else if (a == "-t" || a == "--trials")
+            opt.trials = argv[++i];
+        else if (a == "-n" || a == "--numTrials")
+            opt.numTrials = atol(argv[++i]);
+        else if (a == "-e" || a == "--events")
+            opt.events = argv[++i];
+        else if (a == "-j" || a == "--jobs")
+            opt.jobs = atoi(argv[++i]);
+        else if (a == "--detect")
+            opt.detect = argv[++i];
+        else if (a == "--assert")
+            opt.assertion = argv[++i];
+        else if (a == "--bus")
+            opt.bus = argv[++i];
+        else if (a == "--seg")
+            opt.seg = argv[++i];
+        else
+            usage();
+    }
+    if (opt.jobs == 0)
+        opt.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    /* the runtime numbers the sites of the linked modules in order of their module hash */
+    std::vector<Log> logs;
+    if (!opt.llvm.empty())
+        findLogs(opt.llvm, logs);
+    for (size_t i = 0; i < logs.size(); i++) {
+        flipit_sitelog_t* l = flipit_sitelogOpen(logs[i].path.c_str());
+        if (l == NULL) {
+            fprintf(stderr, "Not a FlipIt site log: %s\n", logs[i].path.c_str());
+            return 1;
+        }
+        const flipit_sitelog_header_t* h = flipit_sitelogHeader(l);
+        logs[i].global = h->flags & FLIPIT_SITELOG_GLOBAL;
+        logs[i].module = logs[i].global ? 0 : h->module;
+        logs[i].numSites = h->numSites;
+        flipit_sitelogClose(l);
+    }
+    std::sort(logs.begin(), logs.end(), [](const Log& a, const Log& b) {
+        if (a.global != b.global)
+            return a.global;
+        if (a.module != b.module)
+            return a.module < b.module;
+        return a.path < b.path;
+    });
+    uint64_t base = 0;
+    for (size_t i = 0; i < logs.size(); i++) {
+        logs[i].base = logs[i].global ? 0 : base;
+        if (!logs[i].global)
+            base += logs[i].numSites;
+    }
+    parallelFor(logs.size(), opt.jobs, [&](size_t i) { readLog(logs[i]); });
+
+    std::vector<Trial> trials(opt.numTrials > 0 ? opt.numTrials : 0);
+    if (!opt.trials.empty())
+        parallelFor(trials.size(), opt.jobs, [&](size_t i) { readTrial(opt, i, trials[i]); });
+
+    /* readInjection(): the type of an arithmetic site follows its last injection */
+    std::unordered_map<uint64_t, size_t> siteRow;
+    std::unordered_map<uint64_t, const char*> refined;
+    size_t numSites = 0;
+    for (size_t i = 0; i < logs.size(); i++)
+        numSites += logs[i].rows.size();
+    siteRow.reserve(numSites);
+    for (size_t i = 0; i < logs.size(); i++)
+        for (size_t j = 0; j < logs[i].rows.size(); j++)
+            siteRow.insert(std::make_pair(logs[i].rows[j].site, (i << 32) | j));
+    for (size_t t = 0; t < trials.size(); t++)
+        for (size_t k = 0; k < trials[t].injections.size(); k++) {
+            const Injection& inj = trials[t].injections[k];
+            auto r = siteRow.find(inj.site);
+            if (r == siteRow.end()) {
+                printf("Unable to locate site # %llu in database\n", (unsigned long long) inj.site);
+                return 1;
+            }
+            const SiteRow& row = logs[r->second >> 32].rows[r->second & 0xFFFFFFFF];
+            auto ty = refined.find(inj.site);
+            std::string curr = ty != refined.end() ? ty->second : row.type;
+            if (curr.find("Arith") != std::string::npos)
+                refined[inj.site] = inj.arithFP ? "Arith-FP" : "Arith-Fix";
+        }
+
+    sqlite3* db;
+    int rc = sqlite3_open(opt.db.c_str(), &db);
+    check(db, rc, opt.db.c_str());
+    exec(db, "PRAGMA synchronous = OFF");
+    exec(db, "PRAGMA journal_mode = MEMORY");
+    exec(db, "CREATE TABLE IF NOT EXISTS sites (site int, type text, comment text, file text, function text, line int, opcode text)");
+    exec(db, "CREATE TABLE IF NOT EXISTS trials (trial int, numInj int, crashed int, detection int, path text, signal int)");
+    exec(db, "CREATE TABLE IF NOT EXISTS injections (trial int, site int, rank int, prob double, bit int, cycle int, notes text)");
+    exec(db, "CREATE TABLE IF NOT EXISTS signals (trial int, num int)");
+    exec(db, "CREATE TABLE IF NOT EXISTS detections (trial int, latency int, detector text)");
+    exec(db, "CREATE TABLE IF NOT EXISTS propagations (trial int, message int, source int, dest int, latency int)");
+    exec(db, "BEGIN");
+
+    sqlite3_stmt* site = prepare(db, "INSERT INTO sites VALUES (?,?,?,?,?,?,?)");
+    for (size_t i = 0; i < logs.size(); i++)
+        for (size_t j = 0; j < logs[i].rows.size(); j++) {
+            const SiteRow& r = logs[i].rows[j];
+            auto ty = refined.find(r.site);
+            sqlite3_bind_int64(site, 1, r.site);
+            bindText(site, 2, ty != refined.end() ? std::string(ty->second) : r.type);
+            bindText(site, 3, r.comment);
+            bindText(site, 4, r.file);
+            bindText(site, 5, r.function);
+            sqlite3_bind_int64(site, 6, r.line);
+            bindText(site, 7, r.opcode);
+            step(db, site);
+        }
+    sqlite3_finalize(site);
+
+    sqlite3_stmt* trial = prepare(db, "INSERT INTO trials VALUES (?,?,?,?,?,?)");
+    sqlite3_stmt* injection = prepare(db, "INSERT INTO injections VALUES (?,?,?,?,?,?,'NULL')");
+    sqlite3_stmt* signal = prepare(db, "INSERT INTO signals VALUES (?,?)");
+    sqlite3_stmt* detection = prepare(db, "INSERT INTO detections VALUES (?,?,?)");
+    sqlite3_stmt* propagation = prepare(db, "INSERT INTO propagations VALUES (?,?,?,?,?)");
+    size_t numTrials = 0, numInj = 0;
+    for (size_t i = 0; i < trials.size(); i++) {
+        const Trial& t = trials[i];
+        if (!t.exists)
+            continue;
+        numTrials++;
+        /* detections and injections of the event logs come first, as in readTrials() */
+        for (size_t k = 0; k < t.detections.size(); k++) {
+            sqlite3_bind_int64(detection, 1, i);
+            sqlite3_bind_int64(detection, 2, t.detections[k].first);
+            bindText(detection, 3, t.detections[k].second);
+            step(db, detection);
+        }
+        for (size_t k = 0; k < t.propagations.size(); k++) {
+            const Propagation& m = t.propagations[k];
+            sqlite3_bind_int64(propagation, 1, i);
+            sqlite3_bind_int64(propagation, 2, m.message);
+            sqlite3_bind_int64(propagation, 3, m.source);
+            sqlite3_bind_int64(propagation, 4, m.dest);
+            sqlite3_bind_int64(propagation, 5, m.latency);
+            step(db, propagation);
+        }
+        for (size_t k = 0; k < t.injections.size(); k++, numInj++) {
+            const Injection& inj = t.injections[k];
+            sqlite3_bind_int64(injection, 1, i);
+            sqlite3_bind_int64(injection, 2, inj.site);
+            sqlite3_bind_int64(injection, 3, inj.rank);
+            sqlite3_bind_double(injection, 4, inj.prob);
+            sqlite3_bind_int64(injection, 5, inj.bit);
+            sqlite3_bind_int64(injection, 6, inj.cycle);
+            step(db, injection);
+        }
+        for (size_t k = 0; k < t.signals.size(); k++) {
+            sqlite3_bind_int64(signal, 1, i);
+            sqlite3_bind_int64(signal, 2, t.signals[k]);
+            step(db, signal);
+        }
+        sqlite3_bind_int64(trial, 1, i);
+        sqlite3_bind_int64(trial, 2, t.numInj);
+        sqlite3_bind_int64(trial, 3, t.crashed);
+        sqlite3_bind_int64(trial, 4, t.detected);
+        bindText(trial, 5, t.path);
+        sqlite3_bind_int64(trial, 6, t.signal);
+        step(db, trial);
+    }
+    sqlite3_finalize(trial);
+    sqlite3_finalize(injection);
+    sqlite3_finalize(signal);
+    sqlite3_finalize(detection);
+    sqlite3_finalize(propagation);
+
+    /* the joins of visualize.py are on site and trial */
+    exec(db, "CREATE INDEX IF NOT EXISTS sites_site ON sites (site)");
+    exec(db, "CREATE INDEX IF NOT EXISTS sites_function ON sites (function)");
+    exec(db, "CREATE INDEX IF NOT EXISTS trials_trial ON trials (trial)");
+    exec(db, "CREATE INDEX IF NOT EXISTS injections_site ON injections (site)");
+    exec(db, "CREATE INDEX IF NOT EXISTS injections_trial ON injections (trial)");
+    exec(db, "CREATE INDEX IF NOT EXISTS signals_trial ON signals (trial)");
+    exec(db, "CREATE INDEX IF NOT EXISTS detections_trial ON detections (trial)");
+    exec(db, "CREATE INDEX IF NOT EXISTS propagations_trial ON propagations (trial)");
+    exec(db, "COMMIT");
+    sqlite3_close(db);
+
+    printf("Ingested %llu sites from %llu logs and %llu trials with %llu injections\n",
+           (unsigned long long) numSites, (unsigned long long) logs.size(),
+           (unsigned long long) numTrials, (unsigned long long) numInj);
+    return 0;
+}
@@ -3,17 +3,17 @@
 
 #include <fstream>
 #include <string>
-#include <algorithm>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <string.h>
 
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/DebugInfo.h>
 #include "llvm/Support/raw_ostream.h"
+#include "FlipIt/sites/siteLog.h"
 using namespace llvm;
 
-#define INFO_SIZE 5
-#define TYPE_SIZE 3
-short NEW_FILE_MASK = 0x8000;
-
 typedef enum {
     ARITHMETIC_FP = 0,
     POINTER,
@@ -30,183 +30,167 @@ typedef enum {
     UNKNOWN_INJ_TYPE = 30
 } INJ_INFO_TYPES;
 
+/* Writes the fault site log <source>.LLVM.bin in the indexed layout of FlipIt/sites/siteLog.h.
+   The tables are kept in memory while the module is instrumented and written by close(). */
 class LogFile
 {
   public:
-    LogFile(std::string srcName, unsigned long currentSite, std::string suffix = ".LLVM.bin", int bufSize = 8192, char version = 1) {
-        init(srcName, currentSite, suffix, bufSize, version);
-    }
-    //LogFile(char* filename, string::string suffix = ".LLVM.txt", int bufSize = 8192, char version) {
-    //    init(filename, bufSize, versions);
-    //}
-
-    void init(std::string srcName, unsigned long currentSite, std::string suffix, int bufSize, char version) {
-        srcFile = srcName;
-        outfile.open(srcName+suffix, std::ios::out | std::ios::binary);
-        buffer = new char[bufSize];
-        this->bufSize = bufSize;
-        currSize = 0;
-        oldSite = currentSite -1;
-        logFileHeader(version);      
+    LogFile(std::string srcName, unsigned long currentSite, uint64_t moduleHash, std::string suffix = ".LLVM.bin") {
+        init(srcName, currentSite, moduleHash, suffix);
     }
 
-    ~LogFile() {
-        // close();
-        delete [] buffer;
+    void init(std::string srcName, unsigned long currentSite, uint64_t moduleHash, std::string suffix) {
+        fileName = srcName + suffix;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, FLIPIT_SITELOG_MAGIC, sizeof(header.magic));
+        header.version = FLIPIT_SITELOG_VERSION;
+        header.module = moduleHash;
+        header.firstSite = currentSite;
+        strings.push_back('\0');
+        header.source = logString(srcName);
+        oldSite = currentSite - 1;
+        lanes = 0;
+        closed = false;
     }
 
     void logFunctionHeader(unsigned long site, std::string name)
     {
-        //errs() << "\n\n" << name << "\n";
-        // make sure we have enough room
-        if (currSize + name.size() + 1 + sizeof(site) > bufSize)
-            write();
-
-        //function name
-        assert(name.size() <= 255 && "Logging function with name >255.\n");
-        
-        // DUMMY operand flag
-        buffer[currSize++] = 255;
-        buffer[currSize++] = (char) name.size();
-        memcpy(buffer+currSize, name.c_str(), std::min((int)name.size(), (1 << 8) -1));
-        currSize += std::min((int)name.size(), (1 << 8) -1);
-
-        // current fault site index
+        uint32_t str = logString(name);
         oldSite = site - 1;
-        char* ptr = (char*) &site;
-        for (unsigned i=0; i < sizeof(site); i++) {
-            buffer[currSize++] = *(ptr + i);
-        }
-
+        // the library build logs the function of every site
+        if (!functions.empty() && functions.back().name == str)
+            return;
+        flipit_sitelog_function_t f = { str, (uint32_t) (site - header.firstSite) };
+        functions.push_back(f);
+    }
+    /* marks the next site as a vector of 'lanes' elements */
+    void logVectorSite(unsigned short lanes)
+    {
+        this->lanes = lanes;
     }
+
     void logInst(unsigned long site, int injType, int comment, Instruction* I)
     {
-        // make sure we have enough room
-        if (currSize + 5 > bufSize) // 5 bytes compressed data
-            write();
-        
-        // operand
-        buffer[currSize++] = (char) I->getOpcode(); // Assumes < 255 insts
-       
-        //errs() << site << " " << (int)I->getOpcode() << " " << (int)getType(injType)
-        //        << " " << (int)getInfo(comment) << "(" << comment << ") ";  
         assert(oldSite + 1 == site && "Sites differ > 1.\n");
-        // Type and info
-        char type_info = (getType(injType) << INFO_SIZE) | getInfo(comment);
-        buffer[currSize++] = type_info;
+        assert(!functions.empty() && "Site logged outside of a function.\n");
+        flipit_sitelog_site_t s;
+        s.function = functions.size() - 1;
+        s.location = logLocation(I);
+        s.opcode = logString(I->getOpcodeName());
+        s.type = getType(injType);
+        s.info = getInfo(comment);
+        s.lanes = lanes;
+        sites.push_back(s);
         oldSite = site;
-
-        // location in file
-        logFileLocation(I);
-    } 
-    inline bool needsWriting() { return currSize > 0; }
-    void write() {
-        if (needsWriting()) {
-            outfile.write(buffer, currSize);
-            currSize = 0;
-        }
+        lanes = 0;
     }
+
     void close() {
-        if (outfile.is_open()) {
-            if (needsWriting()){
-                write();
-            }
-            outfile.close();
-        }
+        if (closed)
+            return;
+        closed = true;
+        header.numSites = sites.size();
+        header.numFunctions = functions.size();
+        header.numLocations = locations.size();
+        header.sites = sizeof(header);
+        header.functions = header.sites + sites.size() * sizeof(flipit_sitelog_site_t);
+        header.locations = header.functions + functions.size() * sizeof(flipit_sitelog_function_t);
+        header.strings = header.locations + locations.size() * sizeof(flipit_sitelog_location_t);
+        header.stringBytes = strings.size();
+
+        std::ofstream outfile(fileName.c_str(), std::ios::out | std::ios::binary);
+        outfile.write((const char*) &header, sizeof(header));
+        outfile.write((const char*) sites.data(), sites.size() * sizeof(flipit_sitelog_site_t));
+        outfile.write((const char*) functions.data(), functions.size() * sizeof(flipit_sitelog_function_t));
+        outfile.write((const char*) locations.data(), locations.size() * sizeof(flipit_sitelog_location_t));
+        outfile.write(strings.data(), strings.size());
+        outfile.close();
     }
 
   private:
-    void logFileHeader(char version)
-    {
-        // file version
-        buffer[currSize++] = version;
-        
-        //source file properties
-        oldFile = srcFile;
-        unsigned short size = srcFile.size();
-        char* ptr = (char*)&(size);
-        buffer[currSize++] = *ptr;
-        buffer[currSize++] = *(ptr+1);
-        memcpy(buffer+currSize, srcFile.c_str(), std::min((int)size, (1 << 16) -1));
-        currSize += std::min((int)size, (1 << 16) -1);
-    }
-
     unsigned char getType(int injType)
     {
-        if (injType < ARITHMETIC_FP && injType > CONTROL_BRANCH)
+        if (injType < ARITHMETIC_FP || injType > CONTROL_BRANCH)
             injType = UNKNOWN_INJ;
         return (unsigned char)injType;
     }
     
     unsigned char getInfo(int comment)
     {
-        if (comment < ARITHMETIC_FP && comment > UNKNOWN_INJ_TYPE)
+        if (comment < RESULT || comment > UNKNOWN_INJ_TYPE)
             comment = UNKNOWN_INJ_TYPE;
         return (unsigned char)comment;
     }
-    void logFileLocation(Instruction* I)
+
+    /* offset of name in the string table, added if new */
+    uint32_t logString(const std::string& name)
     {
-        unsigned short size = 0;
-        unsigned short lineNum = 0;
-        std::string location = "";
-        MDNode* N = I->getMetadata("dbg");
-        
-        if (N != NULL) {
+        auto it = stringIdx.find(name);
+        if (it != stringIdx.end())
+            return it->second;
+        uint32_t offset = strings.size();
+        strings.insert(strings.end(), name.begin(), name.end());
+        strings.push_back('\0');
+        stringIdx[name] = offset;
+        return offset;
+    }
+
+    uint32_t logLocation(std::string file, uint32_t line, uint32_t column, uint32_t inlinedAt)
+    {
+        flipit_sitelog_location_t l = { logString(file), line, column, inlinedAt };
+        auto key = std::make_tuple(l.file, line, column, inlinedAt);
+        auto it = locationIdx.find(key);
+        if (it != locationIdx.end())
+            return it->second;
+        locations.push_back(l);
+        return locationIdx[key] = locations.size() - 1;
+    }
+
+    /* location of I and the chain of call sites it was inlined into; a location is
+       always logged after the one it was inlined at */
 #if LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR <= 6
-            DILocation Loc(N);
-            location = Loc.getDirectory().str() + "/" + Loc.getFilename().str();
-            lineNum = Loc.getLineNumber();
-#elif LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR > 6
-            DILocation* Loc = I->getDebugLoc();
-            location = Loc->getDirectory().str()  + "/" + Loc->getFilename().str();
-            lineNum = Loc->getLine();
-#endif
-            if (oldFile != location) {
-                size = location.size();
-                size |= NEW_FILE_MASK;//0x80; // set MSB
-            }
-        }
-        else /* no debugging information */ {
-            location = "__NF";
-            if (oldFile != "__NF") {
-                size = 4 | NEW_FILE_MASK;//0x80;
-            }
-            else /* no prev dbg info */ {
-                // nothing...
-            }
-        }
-        // file size if new file
-        if (oldFile != location) {
-            char* ptr = (char*)&(size);
-            buffer[currSize++] = *ptr;
-            buffer[currSize++] = *(ptr+1);
-        }
-
-        // line number
-        char* ptr = (char*)&(lineNum);
-        buffer[currSize++] = *ptr;
-        buffer[currSize++] = *(ptr+1);
-        // file name if need be
-        if (size & NEW_FILE_MASK) {
-            if (currSize + location.size() > bufSize)
-                write();
-            
-            memcpy(buffer+currSize, location.c_str(), std::min((int)location.size(), (1 << 16) -1));
-            currSize += std::min((int)location.size(), (1 << 16) -1);
-        }
-        oldFile = location;
-        //errs() << size << " " << lineNum << " " << location << "\n";
+    uint32_t logLocation(DILocation Loc)
+    {
+        DILocation orig = Loc.getOrigLocation();
+        uint32_t inlinedAt = (MDNode*) orig != NULL ? logLocation(orig) : FLIPIT_SITELOG_NONE;
+        return logLocation(Loc.getDirectory().str() + "/" + Loc.getFilename().str(),
+                           Loc.getLineNumber(), Loc.getColumnNumber(), inlinedAt);
     }
 
+    uint32_t logLocation(Instruction* I)
+    {
+        MDNode* N = I->getMetadata("dbg");
+        return N != NULL ? logLocation(DILocation(N)) : FLIPIT_SITELOG_NONE;
+    }
+#else
+    uint32_t logLocation(const DILocation* Loc)
+    {
+        uint32_t inlinedAt = Loc->getInlinedAt() != NULL ? logLocation(Loc->getInlinedAt())
+                                                         : FLIPIT_SITELOG_NONE;
+        return logLocation(Loc->getDirectory().str() + "/" + Loc->getFilename().str(),
+                           Loc->getLine(), Loc->getColumn(), inlinedAt);
+    }
+
+    uint32_t logLocation(Instruction* I)
+    {
+        const DILocation* Loc = I->getDebugLoc();
+        return Loc != NULL ? logLocation(Loc) : FLIPIT_SITELOG_NONE;
+    }
+#endif
+
 
     // data
-    ofstream outfile;
-    std::string srcFile;
-    std::string oldFile;
+    std::string fileName;
+    flipit_sitelog_header_t header;
+    std::vector<flipit_sitelog_site_t> sites;
+    std::vector<flipit_sitelog_function_t> functions;
+    std::vector<flipit_sitelog_location_t> locations;
+    std::vector<char> strings;
+    std::map<std::string, uint32_t> stringIdx;
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>, uint32_t> locationIdx;
     unsigned long oldSite;
-    char* buffer;
-    unsigned  bufSize;
-    unsigned currSize;
+    unsigned short lanes;
+    bool closed;
 };
 #endif
 
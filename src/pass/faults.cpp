@@ -26,6 +26,7 @@
 FlipIt::DynamicFaults::DynamicFaults() : ModulePass(FlipIt::DynamicFaults::ID) {
 #else
 FlipIt::DynamicFaults::DynamicFaults(Module* M) {
+    this->M = M;
     funcList = "";
     configPath = "FlipIt.config";
     siteProb = 1e-8;
@@ -36,6 +37,9 @@ FlipIt::DynamicFaults::DynamicFaults(Module* M) {
     ptr_err = true;
     srcFile = "UNKNOWN"; 
     stateFile = "FlipItState"; 
+    /* guards split blocks, which would invalidate the iterators of a calling pass */
+    guard_inj = false;
+    count_insts = false;
     
     //Module::FunctionListType &functionList = M->getFunctionList();
     init();
@@ -54,6 +58,9 @@ FlipIt::DynamicFaults::DynamicFaults(Module* M) {
     func_corruptIntAdr_64bit = NULL;
     func_corruptFloatAdr_32bit = NULL;
     func_corruptFloatAdr_64bit = NULL;
+    func_corruptVectorData = NULL;
+    armedFlag = NULL;
+    totalInsts = NULL;
     
 
 }
@@ -81,6 +88,10 @@ FlipIt::DynamicFaults::DynamicFaults(string _funcList, string _configPath, doubl
     ptr_err = _ptr_err;
     srcFile = _srcFile;
     stateFile = _stateFile;
+#ifndef COMPILE_PASS
+    guard_inj = false;
+    count_insts = false;
+#endif
 
     func_corruptIntData_8bit = NULL;
     func_corruptIntData_16bit = NULL;
@@ -95,6 +106,9 @@ FlipIt::DynamicFaults::DynamicFaults(string _funcList, string _configPath, doubl
     func_corruptIntAdr_64bit = NULL;
     func_corruptFloatAdr_32bit = NULL;
     func_corruptFloatAdr_64bit = NULL;
+    func_corruptVectorData = NULL;
+    armedFlag = NULL;
+    totalInsts = NULL;
     
 #ifndef COMPILE_PASS
    // Module::FunctionListType &functionList = M->getFunctionList();
@@ -107,12 +121,8 @@ FlipIt::DynamicFaults::DynamicFaults(string _funcList, string _configPath, doubl
 bool FlipIt::DynamicFaults::runOnModule(Module &Mod) {
 
     M = &Mod;
-    if (byte_val < -1 || byte_val > 7) {
-        byte_val = rand() % 8;
-    }
 
     /* Check for assertion violation(s) */
-    assert(byte_val <= 7 && byte_val >= -1);
     assert(siteProb >= 0. && siteProb < 1.);
     assert(singleInj == 1 || singleInj == 0);
     assert(ptr_err == 1 || ptr_err == 0);
@@ -134,42 +144,26 @@ bool FlipIt::DynamicFaults::runOnModule(Module &Mod) {
             continue;
 
         logfile->logFunctionHeader(faultIdx, cstr);
-        inst_iterator I, E, Inext;
-        I = inst_begin(F);
-        E = inst_end(F);
-        for ( ; I != E;) {
-            Inext = I;
-            Inext++;
+
+        /* collect the original instructions first since guarded injections split blocks */
+        std::vector<Instruction*> candidates;
+        for (inst_iterator I = inst_begin(&*F), E = inst_end(&*F); I != E; ++I) {
             Value *in = &(*I);
-            if (in == NULL)
-                continue;
             if ( (isa<StoreInst>(in) || isa<LoadInst>(in)
                 || isa<BinaryOperator>(in) || isa<CmpInst>(in)
                 || isa<CallInst>(in) || isa<AllocaInst>(in) 
                 || isa<GetElementPtrInst>(in)
                 || isa<PHINode>(in)) ) 
             {   
-                injectFault(&(*I));
-            }
-            
-            // gather all phis to place at top of BB (TODO: can we do this inplace?)
-            if (isa<PHINode>(&(*I))){
-                auto BB = I->getParent();
-                I->removeFromParent();
-                I->insertBefore(BB->getFirstInsertionPt());
-            }
-
-            // ensure any landing pad inst directly follows all PHINodes
-            if (isa<LandingPadInst>(&(*I))){
-                auto BB = I->getParent();
-                I->removeFromParent();
-                I->insertBefore(BB->getFirstInsertionPt());
+                candidates.push_back(&(*I));
             }
-            /* find next inst that is original to the function */
-            while (I != Inext && I != E) { I++; }
         }
+        for (auto I : candidates)
+            injectFault(I);
+        applyGuards();
     }/*end for*/
 
+    emitSiteTable();
     return finalize();
 }
 
@@ -189,9 +183,13 @@ std::string FlipIt::DynamicFaults::demangle(std::string name)
 
 bool FlipIt::DynamicFaults::viableFunction(std::string func, std::vector<std::string>& flist) {
    
+    if (!func.compare("main"))
+        return false;
+
     /* verify func isn't a flipit runtime or a user specified
     non-inject function */
-    if (func.find("corruptIntData_8bit") != std::string::npos  ||
+    if (func.find("corrupt") != std::string::npos && (
+        func.find("corruptIntData_8bit") != std::string::npos  ||
         func.find("corruptIntData_16bit") != std::string::npos   ||
         func.find("corruptIntData_32bit") != std::string::npos   ||
         func.find("corruptIntData_64bit") != std::string::npos   ||
@@ -203,13 +201,13 @@ bool FlipIt::DynamicFaults::viableFunction(std::string func, std::vector<std::st
         func.find("corruptIntAdr_32bit") != std::string::npos    ||
         func.find("corruptIntAdr_64bit") != std::string::npos    ||
         func.find("corruptFloatAdr_32bit") != std::string::npos  ||
-        func.find("corruptFloatAdr_64bit") != std::string::npos  ||
-        !func.compare("main"))
+        func.find("corruptFloatAdr_64bit") != std::string::npos))
         return false; 
 
-     if (funcProbs.find(func) != funcProbs.end())
-        if (funcProbs[func] == 0)
-            return false;
+    /* ConstantFPs are unique, so a probability of 0 is funcProbs["zero"] */
+    auto prob = funcProbs.find(func);
+    if (prob != funcProbs.end() && prob->second == funcProbs["zero"])
+        return false;
     
     if (funcList.length() == 0
         || std::find(flist.begin(), flist.end(), func) != flist.end()) {
@@ -219,45 +217,49 @@ bool FlipIt::DynamicFaults::viableFunction(std::string func, std::vector<std::st
 }
 void  FlipIt::DynamicFaults::init() {
     faultIdx = 0;
-    srand(time(NULL));
     Layout = new DataLayout(M);
 	
-    /* fix the bit and byte if they are out of bounds */ 
-    if (byte_val < -1 || byte_val > 7) {
-        byte_val = rand() % 8;
-    }
-
-	if (bit_val < -1 || bit_val > 7) {
-		bit_val = rand() % 8;
-    }
-	
     /* Check for assertion violation(s) */
-    assert(byte_val <= 7 && byte_val >= -1);
-    assert(bit_val <= 7 && bit_val >= -1);
     assert(siteProb >= 0. && siteProb < 1.);
     assert(singleInj == 1 || singleInj == 0);
     assert(ptr_err == 1 || ptr_err == 0);
     assert(arith_err == 1 || arith_err == 0);
     assert(ptr_err == 1 || ptr_err == 0);
 	
-    unsigned int t_byte_val = (byte_val << 28) & 0xF0000000;
-    unsigned int t_bit_val = (bit_val << 24) & 0x0F000000;
-    unsigned int t_faultIdx = faultIdx & 0x00FFFFFF;
-    parameter = t_byte_val | t_bit_val | t_faultIdx;
+    /* placeholder for the first argument; createCorruptCall passes the site index */
+    parameter = faultIdx;
     
 
     readConfig(configPath);
     splitAtSpace();
     /*Cache function references of the function defined in Corrupt.c to all inserting of
      *call instructions to them */
-    unsigned long sum = cacheFunctions();
+    cacheFunctions();
 
-    // TODO: get stateFile from config
-#ifndef COMPILE_PASS
-    sum = 0;
-#endif
-    faultIdx = updateStateFile(stateFile.c_str(), sum);
-    logfile = new LogFile(srcFile, faultIdx); 
+    /* sites are numbered from 0 in each module, which needs no state shared between
+       compiles; the runtime adds the module's base (see emitSiteTable) */
+    faultIdx = 0;
+    oldFaultIdx = faultIdx;
+    sourceName = srcFile != "UNKNOWN" ? std::string(srcFile) : M->getModuleIdentifier();
+    moduleHash = hashModule();
+
+    /* fix the bit and byte if they are out of bounds */ 
+    if (byte_val < -1 || byte_val > 7) {
+        byte_val = siteRand(0) % 8;
+    }
+
+	if (bit_val < -1 || bit_val > 7) {
+		bit_val = siteRand(1) % 8;
+    }
+    assert(byte_val <= 7 && byte_val >= -1);
+    assert(bit_val <= 7 && bit_val >= -1);
+
+    siteBase = new GlobalVariable(*M, IntegerType::getInt32Ty(M->getContext()), false,
+                                  GlobalValue::InternalLinkage,
+                                  ConstantInt::get(IntegerType::getInt32Ty(M->getContext()), 0),
+                                  "flipit.base");
+    siteFirst = NULL;
+    logfile = new LogFile(sourceName, faultIdx, moduleHash); 
     
     //set up args to be used in corrupt calls
     args.reserve(3);
@@ -267,9 +269,9 @@ void  FlipIt::DynamicFaults::init() {
     // create constant ints for each byte position
     for (int i=-1; i<8; i++) {
         byteVal[i] = ConstantInt::get(IntegerType::getInt32Ty(
-            getGlobalContext()), i);
+            M->getContext()), i);
     }
-    i64Ty = Type::getInt64Ty(getGlobalContext());
+    i64Ty = Type::getInt64Ty(M->getContext());
 }
 
 void FlipIt::DynamicFaults::readConfig(string path) {
@@ -285,7 +287,7 @@ void FlipIt::DynamicFaults::readConfig(string path) {
 
         if (found != string::npos) {
             auto constFP = ConstantFP::get(Type::getDoubleTy(
-                getGlobalContext()), atof(line.substr(found+1).c_str()));
+                M->getContext()), atof(line.substr(found+1).c_str()));
             instProbs.insert(std::pair<std::string, Value*>(
                 line.substr(0, found), constFP));
             //instProbs[line.substr(0, found)] = atof(line.substr(found+1).c_str());
@@ -294,7 +296,7 @@ void FlipIt::DynamicFaults::readConfig(string path) {
     }
     // default injection probability
     instProbs["default"] = ConstantFP::get(Type::getDoubleTy(
-            getGlobalContext()), siteProb); 
+            M->getContext()), siteProb); 
     
 
     // read func probs
@@ -303,7 +305,7 @@ void FlipIt::DynamicFaults::readConfig(string path) {
 
         if (found != string::npos && line[0] != '#') {
             auto constFP = ConstantFP::get(Type::getDoubleTy(
-                getGlobalContext()), atof(line.substr(found+1).c_str()));
+                M->getContext()), atof(line.substr(found+1).c_str()));
             funcProbs.insert(std::pair<std::string, Value*>(
                 line.substr(0, found), constFP));
             //funcProbs[line.substr(0, found)] = atof(line.substr(found+1).c_str());
@@ -311,8 +313,17 @@ void FlipIt::DynamicFaults::readConfig(string path) {
         getline(infile, line);
     }
     funcProbs["zero"] = ConstantFP::get(Type::getDoubleTy(
-            getGlobalContext()), 0); 
+            M->getContext()), 0); 
     infile.close();
+
+    /* probability of each opcode, so getInstProb needs no name lookups */
+    opcodeProbs.assign(Instruction::OtherOpsEnd, instProbs["default"]);
+    for (unsigned int op = 0; op < Instruction::OtherOpsEnd; op++) {
+        auto prob = instProbs.find(Instruction::getOpcodeName(op));
+        if (prob != instProbs.end())
+            opcodeProbs[op] = prob->second;
+    }
+    calleeProbs.clear();
 }
 
 
@@ -323,15 +334,64 @@ bool  FlipIt::DynamicFaults::finalize() {
     //for (auto phi : phis) {
     //    phi->dump();
     //}
-    for (auto phi : phis) {
-        auto BB = phi->getParent();
-        phi->removeFromParent();
-        phi->insertBefore(BB->getFirstInsertionPt());
-    }
     //delete logfile;
     return oldFaultIdx != faultIdx;
 }
 
+/* Record the module {hash, number of sites, &flipit.base} in section flipit_sites. The linker
+   gathers the records of all instrumented objects; before main the runtime orders them by hash
+   and gives each module a dense range of site indexes by setting its flipit.base. The indexes
+   depend only on the modules linked, not on the order they were compiled or linked in. */
+void FlipIt::DynamicFaults::emitSiteTable() {
+    if (faultIdx == oldFaultIdx) {
+        siteBase->eraseFromParent();
+        return;
+    }
+
+    LLVMContext& ctx = M->getContext();
+    auto i64 = Type::getInt64Ty(ctx);
+    Type* fields[] = {i64, i64, siteBase->getType()};
+    auto tableTy = StructType::get(ctx, ArrayRef<Type*>(fields));
+    Constant* values[] = {ConstantInt::get(i64, moduleHash), ConstantInt::get(i64, faultIdx),
+                          siteBase};
+    auto table = ConstantStruct::get(tableTy, ArrayRef<Constant*>(values));
+    auto GV = new GlobalVariable(*M, tableTy, true, GlobalValue::InternalLinkage, table,
+                                 "flipit.sites");
+    GV->setSection("flipit_sites");
+#ifdef FLIPIT_PASS_PLUGIN
+    GV->setAlignment(Align(8));
+#else
+    GV->setAlignment(8);
+#endif
+
+    /* add it to llvm.used so it is not removed as unreferenced */
+    auto i8PtrTy = Type::getInt8PtrTy(ctx);
+    std::vector<Constant*> used;
+    if (auto usedGV = M->getGlobalVariable("llvm.used")) {
+        if (auto init = dyn_cast<ConstantArray>(usedGV->getInitializer()))
+            for (unsigned i = 0; i < init->getNumOperands(); i++)
+                used.push_back(init->getOperand(i));
+        usedGV->eraseFromParent();
+    }
+    used.push_back(ConstantExpr::getBitCast(GV, i8PtrTy));
+
+    /* Guarded sites that skip the count stop counting once the runtime disarms, so the
+       instruction count is a lower bound. The module says so with a weak FLIPIT_InexactInsts
+       the runtime tests for, and reports latencies it can not count as unknown. */
+    if (guard_inj && !count_insts) {
+        auto i32 = Type::getInt32Ty(ctx);
+        auto inexact = M->getGlobalVariable("FLIPIT_InexactInsts");
+        if (inexact == NULL)
+            inexact = new GlobalVariable(*M, i32, true, GlobalValue::WeakAnyLinkage,
+                                         ConstantInt::get(i32, 1), "FLIPIT_InexactInsts");
+        used.push_back(ConstantExpr::getBitCast(inexact, i8PtrTy));
+    }
+    auto usedTy = ArrayType::get(i8PtrTy, used.size());
+    auto usedGV = new GlobalVariable(*M, usedTy, false, GlobalValue::AppendingLinkage,
+                                     ConstantArray::get(usedTy, used), "llvm.used");
+    usedGV->setSection("llvm.metadata");
+}
+
 void FlipIt::DynamicFaults::splitAtSpace() {
     //std::vector<std::string> strLst;
     std::istringstream isstr(funcList);
@@ -349,82 +409,150 @@ vector<string> FlipIt::DynamicFaults::splitAtSpace(string spltStr) {
 Value* FlipIt::DynamicFaults::getInstProb(Instruction* I) {
     /*First check if it is a call to a function listed in the config file*/
     if (CallInst *callInst = dyn_cast<CallInst>(I)) {
-        if (callInst->getCalledFunction() == NULL) /* function pointers will be null */
+        Function* callee = callInst->getCalledFunction();
+        if (callee == NULL) /* function pointers will be null */
             return funcProbs["zero"];
 
-        string funcName = callInst->getCalledFunction()->getName().str();
-        if (funcProbs.find(funcName) != funcProbs.end())
-            return funcProbs[funcName];
+        /* looked up by name once per callee */
+        auto cached = calleeProbs.find(callee);
+        if (cached == calleeProbs.end()) {
+            auto prob = funcProbs.find(callee->getName().str());
+            cached = calleeProbs.insert(std::make_pair(callee,
+                        prob != funcProbs.end() ? prob->second : (Value*) NULL)).first;
+        }
+        if (cached->second != NULL)
+            return cached->second;
     }
 
     /* Get the probability from the instruction's type from the config
     file or the default probabilty given as a command line argument */
-    string type = I->getOpcodeName();
-    return instProbs.find(type) != instProbs.end() ? instProbs[type] : instProbs["default"];
+    return opcodeProbs[I->getOpcode()];
 }
 
-unsigned long FlipIt::DynamicFaults::updateStateFile(const char* stateFile, unsigned long sum)
+/* 64 bit FNV-1a hash of the absolute path of the source file (sourceName), so a
+   module keeps its identity when it is rebuilt and same named files in different directories
+   differ */
+uint64_t FlipIt::DynamicFaults::hashModule()
 {
-    unsigned long startNum = 0;
-
-    // grab lock
-    string homePath(getenv("FLIPIT_PATH"));
-    string lockPath = homePath + "/.lock";
-    int fd = open(lockPath.c_str(), O_RDWR | O_CREAT, 0666);
-    while (flock(fd, LOCK_EX | LOCK_NB)) {}
-
-    // read and update the state file    
-    string stateFilePath = homePath + "/." + stateFile;
-    std::fstream file(stateFilePath);
-
-    // read file only if it was corectly open
-    if (!file.is_open()) {
-        errs() << "Error opening state file: " << stateFilePath 
-                << "\nAssuming fault index of 0 and creating the file\n";
-        file.close();
-        file.open(stateFilePath, std::fstream::out);
-        if (!file.is_open()) {
-            file.close();
-            return 0;
-        }
-    }
-    else {
-        file >> startNum;
+    SmallString<256> path(sourceName);
+    sys::fs::make_absolute(path);
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : path.str()) {
+        hash ^= (unsigned char) c;
+        hash *= 1099511628211ULL;
     }
-    
-    // clear the file cause the eof bit is reached
-    file.clear();
-    file.seekg(0, ios::beg);
-    file << (startNum + sum);
-    file.close();
+    return hash;
+}
 
-    // release file lock
-    flock(fd, LOCK_UN);
-    close(fd);
-    return startNum;
+/* Stands in for rand() so the same module is always instrumented the same way: a splitmix64
+   hash of moduleHash, the current site and salt, which tells apart the draws of one site */
+uint64_t FlipIt::DynamicFaults::siteRand(uint32_t salt)
+{
+    uint64_t z = moduleHash + ((((uint64_t) faultIdx << 8) | salt) + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
 }
 
+/* The index of the current site, flipit.base + faultIdx, computed before insertPt. The load is
+   remembered in siteFirst since it becomes the first instruction of the corruption code. */
+Value* FlipIt::DynamicFaults::siteValue(Instruction* insertPt)
+{
+    auto base = createLoad(siteBase, "flipit.base.val", insertPt);
+    siteFirst = base;
+    return BinaryOperator::CreateAdd(base, ConstantInt::get(base->getType(), faultIdx),
+                                     "flipit.site", insertPt);
+}
+
+/* Corrupt a whole vector value. The vector is spilled to a stack slot and the runtime picks
+   the lane and bit, so vector code keeps its width and every lane can be faulty:
+
+       store %v, %flipit.vec
+       call corruptVectorData(site, prob, %flipit.vec, lanes, laneBytes, type, byte, bit)
+       %flipit.vec.val = load %flipit.vec
+
+   Vectors are not passed by value since the C calling convention of wide vectors depends on
+   the target features the runtime was compiled with. */
 bool FlipIt::DynamicFaults::injectVector(Instruction* I) {
+    auto vecTy = cast<VectorType>(I->getType());
+    auto elemTy = vecTy->getElementType();
+    unsigned int lanes = vectorLanes(vecTy);
+    unsigned int laneBytes = Layout->getTypeStoreSize(elemTy);
+    int type;
+
+    /* element type as encoded by the runtime (corrupt.c) */
+    if (elemTy->isFloatTy()) {
+        type = 1;
+        injectionType = ARITHMETIC_FP;
+    } else if (elemTy->isDoubleTy()) {
+        type = 2;
+        injectionType = ARITHMETIC_FP;
+    } else if (elemTy->isPointerTy()) {
+        type = 3;
+        injectionType = POINTER;
+    } else if (elemTy->isIntegerTy() && elemTy->getIntegerBitWidth() % 8 == 0) {
+        type = 0;
+        injectionType = ARITHMETIC_FIX;
+    } else {
+        /* vectors of i1 and other odd widths are bit packed in memory */
+        return false;
+    }
+    if (lanes == 0 || Layout->getTypeStoreSize(vecTy) != lanes * laneBytes)
+        return false;
+    if ((injectionType == ARITHMETIC_FP || injectionType == ARITHMETIC_FIX) && !arith_err)
+        return false;
+    if (injectionType == POINTER && !ptr_err)
+        return false;
 
-    //TODO: call rand at runtime to get value
-    int e = 0;
-    auto idx = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), e);
-    BasicBlock::iterator Inext = I; Inext++;
-
-    auto elm = ExtractElementInst::Create(I, idx, "elm", Inext);
-    bool injected = injectFault(elm);
-    BasicBlock::iterator faulty = Inext; faulty--;// Is this true?
-    copyMetadata(faulty, I);
-    auto ins = InsertElementInst::Create(I, faulty, idx, "ins", Inext);
-    I->replaceAllUsesWith(ins);
-    ins->setOperand(0, I); // Fix it up after previous line
-    elm->setOperand(0, I);
-    return injected;
+    BasicBlock::iterator INext(I);
+    INext++;
+    if (isa<PHINode>(I))
+        INext = I->getParent()->getFirstInsertionPt();
+    Instruction* insertPt = &*INext;
+
+    /* one stack slot per site, allocated in the entry block */
+    Function* F = I->getParent()->getParent();
+    auto slot = createAlloca(vecTy, Layout->getPrefTypeAlignment(vecTy), "flipit.vec",
+                             &*F->getEntryBlock().getFirstInsertionPt());
+
+    LLVMContext& ctx = M->getContext();
+    auto i32Ty = IntegerType::getInt32Ty(ctx);
+    auto store = new StoreInst(I, slot, insertPt);
+    auto ptr = new BitCastInst(slot, Type::getInt8PtrTy(ctx), "flipit.vec.ptr", insertPt);
+    std::vector<Value*> vecArgs;
+    vecArgs.push_back(siteValue(insertPt));
+    vecArgs.push_back(getInstProb(I));
+    vecArgs.push_back(ptr);
+    vecArgs.push_back(ConstantInt::get(i32Ty, lanes));
+    vecArgs.push_back(ConstantInt::get(i32Ty, laneBytes));
+    vecArgs.push_back(ConstantInt::get(i32Ty, type));
+    vecArgs.push_back(ConstantInt::get(i32Ty, byte_val == -1 ? 0xF : byte_val % laneBytes));
+    vecArgs.push_back(ConstantInt::get(i32Ty, bit_val == -1 ? 0xF : bit_val % 8));
+    auto call = createCall(func_corruptVectorData, vecArgs, "", insertPt);
+    call->setCallingConv(CallingConv::C);
+    auto corruptVal = createLoad(slot, "flipit.vec.val", insertPt);
+    copyMetadata(call, I);
+
+    I->replaceAllUsesWith(corruptVal);
+    store->setOperand(0, I); // Fix it up after previous line
+
+    if (guard_inj)
+        pendingGuards.push_back(PendingGuard(store, corruptVal, I));
+
+    comment = RESULT;
+    return true;
+}
+
+/* loop induction variables, e.g. i++, are named indvars* or inc* by clang */
+static bool isLoopVariable(Value* v) {
+    return v->getName().startswith("indvars") || v->getName().startswith("inc");
 }
+
 bool FlipIt::DynamicFaults::injectControl_NEW(Instruction* I) {
 
     /* Build argument list before calling Corrupt function */
-    args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
+    args[0] = ConstantInt::get(IntegerType::getInt32Ty(M->getContext()), parameter);
     args[1] = getInstProb(I);
 
 
@@ -433,7 +561,7 @@ bool FlipIt::DynamicFaults::injectControl_NEW(Instruction* I) {
     {
         /* select a random arg to corrupt because corrupting the result will yeild a
         50% chance of branching incorrectly */
-        unsigned int opPos = rand() % 2;
+        unsigned int opPos = siteRand(2) % 2;
         
         /* LLVM doesn't like attempting to corrupt NULL */
         if (I->getOperand(opPos) == NULL)
@@ -445,15 +573,13 @@ bool FlipIt::DynamicFaults::injectControl_NEW(Instruction* I) {
     /* check to see if instruction modifies a looping variable such as i++
         if so we need to inject into it and mark the injection type 'control' */
     if (isa<StoreInst>(I)) {
-        if (I->getName().str().find("indvars") == 0
-            || I->getName().str().substr(0, 3) == "inc")
+        if (isLoopVariable(I))
         {
             injectionType = CONTROL_LOOP;
             return injectInOperand(I, 0); // value to be store
         }
     }
-    if (I->getName().str().find("indvars") == 0
-        || I->getName().str().substr(0, 3) == "inc")
+    if (isLoopVariable(I))
     {
         injectionType = CONTROL_LOOP;
         return injectResult(I);
@@ -466,7 +592,7 @@ bool FlipIt::DynamicFaults::injectControl_NEW(Instruction* I) {
 bool FlipIt::DynamicFaults::injectArithmetic_NEW(Instruction* I)
 {
     /* Build argument list before calling Corrupt function */
-    args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
+    args[0] = ConstantInt::get(IntegerType::getInt32Ty(M->getContext()), parameter);
     args[1] = getInstProb(I);
 
     /* We handle these in a special way */
@@ -501,7 +627,7 @@ bool FlipIt::DynamicFaults::injectArithmetic_NEW(Instruction* I)
 bool FlipIt::DynamicFaults::injectPointer_NEW(Instruction* I)
 {
     /*Build argument list before calling Corrupt function*/
-    args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
+    args[0] = ConstantInt::get(IntegerType::getInt32Ty(M->getContext()), parameter);
     args[1] = getInstProb(I);
 
     if (isa<StoreInst>(I) && I->getOperand(0)->getType()->isPointerTy()) {
@@ -522,12 +648,12 @@ bool FlipIt::DynamicFaults::injectPointer_NEW(Instruction* I)
 bool FlipIt::DynamicFaults::injectCall_NEW(Instruction* I)
 {
     /*Build argument list before calling Corrupt function*/
-    args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
+    args[0] = ConstantInt::get(IntegerType::getInt32Ty(M->getContext()), parameter);
     args[1] = getInstProb(I);
     
     if (!isa<CallInst>(I))
         return false; 
-    if (dyn_cast<CallInst>(I)->getNumArgOperands() == 0)
+    if (numArgs(dyn_cast<CallInst>(I)) == 0)
     {
         bool ret = injectResult(I);
         comment = RESULT;
@@ -543,61 +669,42 @@ bool FlipIt::DynamicFaults::injectCall_NEW(Instruction* I)
 bool FlipIt::DynamicFaults::injectResult(Instruction* I)
 {
     args[2] = I;
-    BasicBlock::iterator INext(I);
-//    if (isa<PHINode>(I))
-//        phis.push_back(I);
-    INext++; //while(isa<PHINode>(INext)) { INext++;}
+    BasicBlock::iterator INextIt(I);
+    INextIt++;
+    /* corrupt the result of PHI nodes after all PHI nodes and landing pads of the block */
+    if (isa<PHINode>(I))
+        INextIt = I->getParent()->getFirstInsertionPt();
+    Instruction* INext = &*INextIt;
     Value* corruptVal = NULL;
     CallInst* call = NULL;
+    Instruction* first = NULL;
     auto type = I->getType();
     
 
     /*Integer Data*/
     if (type->isIntegerTy()) {
-        /* encode integer size in the byte val */
-        int size = Layout->getTypeStoreSize(I->getType());
-        if (byte_val == -1) {
-            unsigned int t_byte_val = ((-size) << 28) & 0xF0000000;
-            unsigned int t_bit_val = (bit_val << 24) & 0x0F000000;
-            unsigned int t_faultIdx = faultIdx & 0x00FFFFFF;
-            parameter = t_byte_val | t_bit_val | t_faultIdx;
-            args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
-        }
-        else if (size < byte_val) {
-            unsigned int t_byte_val = ((byte_val % size) << 28) & 0xF0000000;
-            unsigned int t_bit_val = (bit_val << 24) & 0x0F000000;
-            unsigned int t_faultIdx = faultIdx & 0x00FFFFFF;
-            parameter = t_byte_val | t_bit_val | t_faultIdx;
-            args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
-        }
-        
-        if (! (type->isIntegerTy(64))) {
-            args[2] = new ZExtInst(I, i64Ty, "zxt", INext);
+        /* odd widths (e.g. i1) are widened to the next runtime width */
+        auto callTy = corruptIntType(type);
+        if (callTy == NULL)
+            return false;
+        if (callTy != type) {
+            args[2] = first = new ZExtInst(I, callTy, "zxt", INext);
         }
-        call = CallInst::Create(func_corruptIntData_64bit, args,
-                                "call_corruptIntData_64bit", INext);
-        //call->setCallingConv(CallingConv::C);
-        if (!(type->isIntegerTy(64))) {
+        call = createCorruptCall(callTy, INext);
+        if (callTy != type) {
             corruptVal = new TruncInst(call, type, "trunc", INext);
         }
-    } else if (type->isFloatTy()) {
+    } else if (type->isFloatTy() || type->isDoubleTy()) {
     /*Float Data*/
-        call = CallInst::Create(func_corruptFloatData_32bit, args,
-                                 "call_corruptFloatData_32bit", INext);
-        //call->setCallingConv(CallingConv::C);
-    } else if (type->isDoubleTy()) {
-        call = CallInst::Create(func_corruptFloatData_64bit, args,
-                                 "call_corruptFloatData_64bit", INext);
-        //call->setCallingConv(CallingConv::C);
+        call = createCorruptCall(type, INext);
     } else if (type->isPointerTy()) { 
         /* Convert ptr to int64 */
         auto p2iI = new PtrToIntInst(I, i64Ty, "convert_ptr2i64", INext);
+        first = p2iI;
 
         /* Corrupt */
         args[2] = p2iI;
-        call = CallInst::Create(func_corruptPtr2Int_64bit, args,
-                                "call_corruptPtr2Int_64bit", INext);
-        //call->setCallingConv(CallingConv::C);
+        call = createCorruptCall(type, INext);
 
         /* convert int64 to ptr */
         corruptVal = new IntToPtrInst(call, I->getType(), "convert_i642ptr", INext);
@@ -606,22 +713,21 @@ bool FlipIt::DynamicFaults::injectResult(Instruction* I)
     if (corruptVal == NULL) {
         corruptVal = call;
     }
+    if (first == NULL) {
+        first = siteFirst;
+    }
     if (corruptVal) {
         I->replaceAllUsesWith(corruptVal);
 
-        /*if (isa<PHINode>(I))
-        {
-            call->setOperand(2, args[2]);
-        }*/
-
         /* Because of the preceeding method invocation, we messed up last argument in the call instruction.
             We need to manually set this value to the result of Insturction I */
-        INext = I;
-        INext++;
-        if (isa<CallInst>(INext))
-            INext->setOperand(2, I); // hard coded. If like others, it says we have an extra argument
+        if (first == siteFirst)
+            call->setOperand(2, I); // hard coded. If like others, it says we have an extra argument
         else
-            INext->setOperand(0, I);
+            first->setOperand(0, I);
+
+        if (guard_inj)
+            pendingGuards.push_back(PendingGuard(first, cast<Instruction>(corruptVal), I));
         
         comment = RESULT;
         return true;
@@ -633,61 +739,35 @@ bool FlipIt::DynamicFaults::injectInOperand(Instruction* I, int operand)
 {
     /* We assume that operand is vaild */
     args[2] = I->getOperand(operand); // value stored
+    Value* orig = args[2];
     Value* corruptVal = NULL;
     CallInst* call = NULL;
+    Instruction* first = NULL;
     auto type = I->getOperand(operand)->getType();
     /*Integer Data*/
     if (type->isIntegerTy()) {
-        /* Incode integer size in the byte val */
-        int size = Layout->getTypeStoreSize(I->getOperand(operand)->getType());
-        if (byte_val == -1) {
-            unsigned int t_byte_val = ((-size) << 28) & 0xF0000000;
-            unsigned int t_bit_val = (bit_val << 24) & 0x0F000000;
-            unsigned int t_faultIdx = faultIdx & 0x00FFFFFF;
-            parameter = t_byte_val | t_bit_val | t_faultIdx;
-            args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
-        }
-        else if (size < byte_val) {
-            //parameter &= 0x0FFFFFFFF; // zero out old byte field
-            //parameter |= ((byte_val % size) << 28); // insert new
-            
-            unsigned int t_byte_val = ((byte_val % size) << 28) & 0xF0000000;
-            unsigned int t_bit_val = (bit_val << 24) & 0x0F000000;
-            unsigned int t_faultIdx = faultIdx & 0x00FFFFFF;
-            //errs() << "BYTE= " << size << " BIT= " << bit_val << " IDX= " << faultIdx << "\n";
-            //errs() << "BYTE= " << (t_byte_val >> 28) << " BIT= " << ((t_bit_val >> 24) & 0xF) << " IDX= " << (faultIdx & 0x00FFFFFF) << "\n";
-            parameter = t_byte_val | t_bit_val | t_faultIdx;
-            errs() << "FIDX = " << faultIdx << "parameter Idx = " << (parameter & 0x00FFFFFF) << " \n";
-            args[0] = ConstantInt::get(IntegerType::getInt32Ty(getGlobalContext()), parameter);
-        }
-        
-        if (! (type->isIntegerTy(64))) {
-            args[2] = new ZExtInst(I->getOperand(operand), i64Ty, "zxt", I);
+        /* odd widths (e.g. i1) are widened to the next runtime width */
+        auto callTy = corruptIntType(type);
+        if (callTy == NULL)
+            return false;
+        if (callTy != type) {
+            args[2] = first = new ZExtInst(I->getOperand(operand), callTy, "zxt", I);
         }
-        call = CallInst::Create(func_corruptIntData_64bit, args,
-                                "call_corruptIntData_64bit", I);
-        call->setCallingConv(CallingConv::C);
-        if (!(type->isIntegerTy(64))) {
+        call = createCorruptCall(callTy, I);
+        if (callTy != type) {
             corruptVal = new TruncInst(call, type, "trunc", I);
         }
-    } else if (type->isFloatTy()) {
+    } else if (type->isFloatTy() || type->isDoubleTy()) {
     /*Float Data*/
-        call = CallInst::Create(func_corruptFloatData_32bit, args,
-                                 "call_corruptFloatData_32bit", I);
-        call->setCallingConv(CallingConv::C);
-    } else if (type->isDoubleTy()) {
-        call = CallInst::Create(func_corruptFloatData_64bit, args,
-                               "call_corruptFloatData_64bit", I);
-        call->setCallingConv(CallingConv::C);
+        call = createCorruptCall(type, I);
     } 
     else if (type->isPointerTy()) { 
         auto p2iI = new PtrToIntInst(args[2], i64Ty, "convert_ptr2i64", I);
+        first = p2iI;
 
         /* Corrupt */
         args[2] = p2iI;
-        call = CallInst::Create(func_corruptPtr2Int_64bit, args,
-                                "call_corruptPtr2Int_64bit", I);
-        call->setCallingConv(CallingConv::C);
+        call = createCorruptCall(type, I);
 
         /* convert int64 to ptr */
         corruptVal = new IntToPtrInst(call, type, "convert_i642ptr", I);
@@ -695,8 +775,13 @@ bool FlipIt::DynamicFaults::injectInOperand(Instruction* I, int operand)
     if (corruptVal == NULL) {
         corruptVal = call;
     }
+    if (first == NULL) {
+        first = siteFirst;
+    }
     if (corruptVal) {
         I->setOperand(operand, corruptVal);
+        if (guard_inj)
+            pendingGuards.push_back(PendingGuard(first, cast<Instruction>(corruptVal), orig));
         comment = operand + 1;
         return true;
     }
@@ -705,72 +790,165 @@ bool FlipIt::DynamicFaults::injectInOperand(Instruction* I, int operand)
 }
 
 
+/* Integer type of the runtime entry point for an integer site, or NULL if it is wider than
+   64 bits */
+Type* FlipIt::DynamicFaults::corruptIntType(Type* type)
+{
+    unsigned int width = type->getIntegerBitWidth();
+    if (width > 64)
+        return NULL;
+    if (width > 32)
+        return Type::getInt64Ty(M->getContext());
+    if (width > 16)
+        return Type::getInt32Ty(M->getContext());
+    if (width > 8)
+        return Type::getInt16Ty(M->getContext());
+    return Type::getInt8Ty(M->getContext());
+}
+
+/* Insert the call corrupting args[2], a value of type (an integer of 8-64 bits, float, double,
+   or a pointer already converted to i64), before insertPt. The cheapest entry point is chosen
+   from the byte and bit options: any byte and bit (_rand), or else _fixed, where FLIPIT_ANY
+   (0xF) stands for a random byte or bit. Both take the full 32 bit site index. */
+CallInst* FlipIt::DynamicFaults::createCorruptCall(Type* type, Instruction* insertPt)
+{
+    auto i32Ty = IntegerType::getInt32Ty(M->getContext());
+    unsigned int size = 8;
+    unsigned int func = CORRUPT_PTR2INT_64;
+    if (type->isFloatTy()) {
+        size = 4;
+        func = CORRUPT_FLOAT_32;
+    } else if (type->isDoubleTy()) {
+        func = CORRUPT_FLOAT_64;
+    } else if (type->isIntegerTy()) {
+        size = type->getIntegerBitWidth() / 8;
+        func = size == 1 ? CORRUPT_INT_8 : size == 2 ? CORRUPT_INT_16
+                : size == 4 ? CORRUPT_INT_32 : CORRUPT_INT_64;
+    }
+
+    std::vector<Value*> callArgs(args.begin(), args.end());
+    Value* callee = func_corrupt[func][CORRUPT_RAND];
+    callArgs[0] = siteValue(insertPt);
+    if (byte_val != -1 || bit_val != -1) {
+        callee = func_corrupt[func][CORRUPT_FIXED];
+        callArgs.push_back(ConstantInt::get(i32Ty, byte_val == -1 ? 0xF : byte_val % size));
+        callArgs.push_back(ConstantInt::get(i32Ty, bit_val == -1 ? 0xF : bit_val % 8));
+    }
+
+    auto call = createCall(callee, callArgs, "call_corrupt", insertPt);
+    call->setCallingConv(CallingConv::C);
+    return call;
+}
+
+/* Wrap the corruption code [first, last] in a test of the runtime's armed flag so that
+   unarmed sites cost a load and a (well predicted) branch instead of a call:
+
+       head:   %armed = load FLIPIT_Armed; br %armed != 0, inject, skip   (weights 1:N)
+       inject: first ... last; br cont
+       skip:   FLIPIT_TotalInsts++; br cont                              (-countInsts only)
+       cont:   %val = phi [last, inject], [orig, skip]
+
+   Uses of last are replaced by the PHI node, which is returned. */
+Value* FlipIt::DynamicFaults::guardCorruption(Instruction* first, Instruction* last, Value* orig)
+{
+    BasicBlock* head = first->getParent();
+    BasicBlock* injBB = head->splitBasicBlock(BasicBlock::iterator(first), "flipit.inject");
+    BasicBlock::iterator afterLast(last); afterLast++;
+    BasicBlock* contBB = injBB->splitBasicBlock(afterLast, "flipit.cont");
+
+    /* inline count of the sites that do not reach the runtime */
+    BasicBlock* skipBB = contBB;
+    if (count_insts) {
+        skipBB = BasicBlock::Create(M->getContext(), "flipit.skip", head->getParent(), contBB);
+        auto count = createLoad(totalInsts, "flipit.insts", skipBB);
+        auto inc = BinaryOperator::CreateAdd(count, ConstantInt::get(i64Ty, 1),
+                                             "flipit.insts.inc", skipBB);
+        new StoreInst(inc, totalInsts, skipBB);
+        BranchInst::Create(contBB, skipBB);
+    }
+
+    /* replace the unconditional branch left by splitBasicBlock with the armed test */
+    Instruction* oldBr = head->getTerminator();
+    auto armed = createLoad(armedFlag, "flipit.armed", oldBr);
+    auto isArmed = new ICmpInst(oldBr, ICmpInst::ICMP_NE, armed,
+                                ConstantInt::get(IntegerType::getInt32Ty(M->getContext()), 0),
+                                "flipit.isarmed");
+    auto br = BranchInst::Create(injBB, skipBB, isArmed, oldBr);
+    br->setMetadata(LLVMContext::MD_prof,
+                    MDBuilder(M->getContext()).createBranchWeights(1, GUARD_BRANCH_WEIGHT));
+    oldBr->eraseFromParent();
+
+    PHINode* phi = PHINode::Create(orig->getType(), 2, "flipit.val", &contBB->front());
+    last->replaceAllUsesWith(phi);
+    phi->addIncoming(last, injBB);
+    phi->addIncoming(orig, skipBB == contBB ? head : skipBB);
+    return phi;
+}
+
+/* Guard the sites injected since the last call, last site first. Splitting a block moves the
+   instructions after the split point, so going backwards each split only moves the code up to
+   the next site, which was split off already, and a block with many sites is not moved over
+   and over. */
+void FlipIt::DynamicFaults::applyGuards()
+{
+    for (auto g = pendingGuards.rbegin(); g != pendingGuards.rend(); ++g)
+        guardCorruption(g->first, g->last, g->orig);
+    pendingGuards.clear();
+}
+
+
+/* Choose the argument of callInst to corrupt, uniformly among the arguments the enabled fault
+   types (ctrl, arith, ptr) allow, and set injectionType; -1 if there is none */
 int FlipIt::DynamicFaults::selectArgument(CallInst* callInst) {
-    int arg = -1;
-    int possArgLen = callInst->getNumArgOperands();
-    std::vector<int> argPos;
+    int possArgLen = numArgs(callInst);
     if ( callInst->getCalledFunction() == NULL)
-        return arg;
+        return -1;
 
-    bool argFound = false;
-    string funcName = callInst->getCalledFunction()->getName().str();
-    if (funcProbs.find(funcName) != funcProbs.end())
-        if (funcProbs[funcName] == 0)
-            return arg;
+    StringRef funcName = callInst->getCalledFunction()->getName();
+    if (getInstProb(callInst) == funcProbs["zero"])
+        return -1;
 
     // populate with possible args.
-    if (funcName.find("llvm.lifetime") != string::npos) {
-        argPos.push_back(1);
-    } else if (funcName.find("llvm.dbg") != string::npos) {
-        return arg;
-    } else if (funcName.find("FLIPIT_") != string::npos) {
-        return arg;
-    } else {
-        /* populate with valid arguemnts detection of constant integers should
-        fix the LLVM intrinsic problem */
-        for (int i = 0; i < possArgLen; i++) {
-            ConstantInt* CI = dyn_cast<llvm::ConstantInt>(callInst->getArgOperand(i));
-            if (!( CI != NULL && funcName.find("llvm.") != string::npos) )
-                argPos.push_back(i);
-        }
+    int first = 0, last = possArgLen;
+    bool intrinsic = funcName.find("llvm.") != StringRef::npos;
+    if (funcName.find("llvm.lifetime") != StringRef::npos) {
+        first = 1;
+        last = std::min(2, possArgLen);
+    } else if (funcName.find("llvm.dbg") != StringRef::npos
+               || funcName.find("FLIPIT_") != StringRef::npos) {
+        return -1;
     }
 
-
     /* select possible arg based on "arith", "ctrl", and "ptr" */
-    while (argFound == false && argPos.size() > 0)  {
-        int a = rand() % argPos.size();
-        if (ctrl_err && callInst->getArgOperand(a)->getType()->isIntegerTy()) {
-            Value* v = (Value*) callInst->getArgOperand(a);
-            if ( v->getName().str().find("indvars") == 0
-                || v->getName().str().substr(0, 3) == "inc") {
-                arg = a;
-                injectionType = CONTROL_LOOP;
-                //injectionType = "Control-Loop";
-                argFound = true;
-            }
-        } else if (arith_err && (callInst->getArgOperand(a)->getType()->isIntegerTy()
-                || callInst->getArgOperand(a)->getType()->isFloatTy()
-                || callInst->getArgOperand(a)->getType()->isDoubleTy() )
-                && !callInst->getArgOperand(a)->getType()->isIntegerTy(1)) {
-            arg = a;
-            if (callInst->getArgOperand(a)->getType()->isIntegerTy()) {
-                injectionType = ARITHMETIC_FIX;
-            }   else if (callInst->getArgOperand(a)->getType()->isFloatTy()
-                || callInst->getArgOperand(a)->getType()->isDoubleTy()) {
-                injectionType = ARITHMETIC_FP;
+    argPos.clear();
+    argTypes.clear();
+    for (int a = first; a < last; a++) {
+        Value* v = callInst->getArgOperand(a);
+        Type* type = v->getType();
+        /* detection of constant integers should fix the LLVM intrinsic problem */
+        if (intrinsic && first == 0 && isa<ConstantInt>(v))
+            continue;
+
+        if (ctrl_err && type->isIntegerTy()) {
+            if (isLoopVariable(v)) {
+                argPos.push_back(a);
+                argTypes.push_back(CONTROL_LOOP);
             }
-            //injectionType = "Arithmetic";
-            argFound = true;
+        } else if (arith_err && (type->isIntegerTy() || type->isFloatTy() || type->isDoubleTy())
+                   && !type->isIntegerTy(1)) {
+            argPos.push_back(a);
+            argTypes.push_back(type->isIntegerTy() ? ARITHMETIC_FIX : ARITHMETIC_FP);
         } else if (ptr_err) {
-            arg = a;
-            injectionType = POINTER;
-            //injectionType = "Pointer";
-            argFound = true;
+            argPos.push_back(a);
+            argTypes.push_back(POINTER);
         }
-        argPos.erase(argPos.begin() + a);
     }
+    if (argPos.empty())
+        return -1;
 
-    return arg;
+    int choice = siteRand(3) % argPos.size();
+    injectionType = argTypes[choice];
+    return argPos[choice];
 }
 
 bool FlipIt::DynamicFaults::copyMetadata(Instruction* to, Instruction* from)
@@ -783,29 +961,64 @@ bool FlipIt::DynamicFaults::copyMetadata(Instruction* to, Instruction* from)
 }
 
 
-unsigned long FlipIt::DynamicFaults::cacheFunctions() { //Module::FunctionListType &functionList) {
-    unsigned long sum = 0; // # insts in module
-    for (auto F = M->getFunctionList().begin(), E = M->getFunctionList().end(); F != E; F++) {
-        string cstr = F->getName().str();
-        if (cstr.find("corruptIntData_64bit") != std::string::npos) {
-            func_corruptIntData_64bit =&*F;
-        } else if (cstr.find("corruptPtr2Int_64bit") != std::string::npos) {
-            func_corruptPtr2Int_64bit =&*F;
-        } else if (cstr.find("corruptFloatData_32bit") != std::string::npos) {
-            func_corruptFloatData_32bit =&*F;
-        } else if (cstr.find("corruptFloatData_64bit") != std::string::npos) {
-            func_corruptFloatData_64bit =&*F;
+void FlipIt::DynamicFaults::cacheFunctions() {
+    static const char* names[NUM_CORRUPT_FUNCS] = {"corruptIntData_8bit",
+        "corruptIntData_16bit", "corruptIntData_32bit", "corruptIntData_64bit",
+        "corruptFloatData_32bit", "corruptFloatData_64bit", "corruptPtr2Int_64bit"};
+    static const char* variants[NUM_CORRUPT_VARIANTS] = {"", "_rand", "_fixed"};
+
+    /* entry points declared by corrupt.bc, or declared here when the pass runs inside clang
+       (-fpass-plugin) and corrupt.bc is not linked in */
+    LLVMContext& ctx = M->getContext();
+    auto i32Ty = Type::getInt32Ty(ctx);
+    auto doubleTy = Type::getDoubleTy(ctx);
+    Type* valueTys[NUM_CORRUPT_FUNCS] = {Type::getInt8Ty(ctx), Type::getInt16Ty(ctx), i32Ty,
+        Type::getInt64Ty(ctx), Type::getFloatTy(ctx), doubleTy, Type::getInt64Ty(ctx)};
+    for (int f = 0; f < NUM_CORRUPT_FUNCS; f++) {
+        for (int v = 0; v < NUM_CORRUPT_VARIANTS; v++) {
+            std::vector<Type*> params = {i32Ty, doubleTy, valueTys[f]};
+            if (v == CORRUPT_FIXED)
+                params.insert(params.end(), 2, i32Ty); // byte, bit
+            Function* F = runtimeFunction(M, string(names[f]) + variants[v],
+                                          FunctionType::get(valueTys[f], params, false));
+#ifdef FLIPIT_PASS_PLUGIN
+            /* 8 and 16 bit values are widened as in the C declaration */
+            if (F->isDeclaration() && (f == CORRUPT_INT_8 || f == CORRUPT_INT_16)) {
+                F->addParamAttr(2, Attribute::ZExt);
+#if LLVM_VERSION_MAJOR >= 14
+                F->addRetAttr(Attribute::ZExt);
+#else
+                F->addAttribute(AttributeList::ReturnIndex, Attribute::ZExt);
+#endif
+            }
+#endif
+            func_corrupt[f][v] = F;
         }
-        /* TODO: check for function viability */
-        if (F->begin() != F->end() && viableFunction(cstr, flist))
-            for (auto BB = F->begin(), BBe = F->end(); BB != BBe; BB++) 
-                sum += BB->size();
-    }/*end for*/
-
-    assert(func_corruptIntData_64bit != NULL && func_corruptPtr2Int_64bit != NULL
-        && func_corruptFloatData_32bit != NULL && func_corruptFloatData_64bit != NULL);
+    }
+    func_corruptIntData_8bit = func_corrupt[CORRUPT_INT_8][CORRUPT_GENERIC];
+    func_corruptIntData_16bit = func_corrupt[CORRUPT_INT_16][CORRUPT_GENERIC];
+    func_corruptIntData_32bit = func_corrupt[CORRUPT_INT_32][CORRUPT_GENERIC];
+    func_corruptIntData_64bit = func_corrupt[CORRUPT_INT_64][CORRUPT_GENERIC];
+    func_corruptFloatData_32bit = func_corrupt[CORRUPT_FLOAT_32][CORRUPT_GENERIC];
+    func_corruptFloatData_64bit = func_corrupt[CORRUPT_FLOAT_64][CORRUPT_GENERIC];
+    func_corruptPtr2Int_64bit = func_corrupt[CORRUPT_PTR2INT_64][CORRUPT_GENERIC];
+    std::vector<Type*> vecParams = {i32Ty, doubleTy, Type::getInt8PtrTy(ctx), i32Ty, i32Ty,
+                                    i32Ty, i32Ty, i32Ty};
+    func_corruptVectorData = runtimeFunction(M, "corruptVectorData",
+                                             FunctionType::get(Type::getVoidTy(ctx), vecParams,
+                                                               false));
+
+    /* runtime state tested by the injection guards (defined in corrupt.c) */
+    if (guard_inj) {
+        armedFlag = M->getOrInsertGlobal("FLIPIT_Armed",
+                                         IntegerType::getInt32Ty(M->getContext()));
+        totalInsts = M->getOrInsertGlobal("FLIPIT_TotalInsts",
+                                          Type::getInt64Ty(M->getContext()));
+        /* the runtime keeps one count per thread */
+        if (auto GV = dyn_cast<GlobalVariable>(totalInsts))
+            GV->setThreadLocal(true);
+    }
     
-    return sum;
 }
 
 bool FlipIt::DynamicFaults::corruptInstruction(Instruction* I) {
@@ -816,17 +1029,17 @@ bool FlipIt::DynamicFaults::corruptInstruction(Instruction* I) {
             return false;
         }    
 #endif
-        return injectFault(I);
+        bool inj = injectFault(I);
+        applyGuards();
+        return inj;
 }
 
 bool FlipIt::DynamicFaults::injectFault(Instruction* I) {
     bool inj = false;
     comment = 0; injectionType = 0;
     
-    unsigned int t_byte_val = (byte_val << 28) & 0xF0000000;
-    unsigned int t_bit_val = (bit_val << 24) & 0x0F000000;
-    unsigned int t_faultIdx = faultIdx & 0x00FFFFFF;
-    parameter = t_byte_val | t_bit_val | t_faultIdx;
+    /* placeholder for the first argument; createCorruptCall passes the site index */
+    parameter = faultIdx;
     
     if (ctrl_err && injectControl_NEW(I)) {
         inj = true;
@@ -856,15 +1069,14 @@ bool FlipIt::DynamicFaults::injectFault(Instruction* I) {
         errs() << "Warning: Didn't injection into \"" << *inst << "\"\n";
     }
     */
-    if (inj && !simdInst) {
+    if (inj) {
         // Site #,   injection type, comment, inst
 
-        //errs() << "FIDX = " << faultIdx << "parameter Idx = " << (parameter & 0x00FFFFFF) << " \n";
 #ifndef COMPILE_PASS
         logfile->logFunctionHeader(faultIdx, I->getParent()->getParent()->getName().str());
-        faultIdx = updateStateFile(stateFile.c_str(), 1);
-
 #endif
+        if (simdInst)
+            logfile->logVectorSite(vectorLanes(I->getType()));
         logfile->logInst(faultIdx++, injectionType, comment, I);
     }
     if (simdInst == true)
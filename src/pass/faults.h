@@ -32,7 +32,6 @@
     using std::ofstream;
     using std::ios;
 #include <cxxabi.h>
-#include <sys/file.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -50,16 +49,39 @@
  
 #include <llvm/Support/CommandLine.h>
 #include <llvm/IR/InstIterator.h>
-#include <llvm/PassManager.h>
 #include <llvm/IR/CallingConv.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/DebugInfo.h>
 #include <llvm/IR/Instruction.h>
-#include <llvm/IR/TypeBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Config/llvm-config.h>
+
+/* LLVM 9 and later: the pass is also a new pass manager plugin, run by clang with
+   -fpass-plugin=libFlipItPass.so or by opt with -load-pass-plugin and -passes=FlipIt */
+#if LLVM_VERSION_MAJOR >= 9
+#define FLIPIT_PASS_PLUGIN
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/PassPlugin.h>
+#else
+#include <llvm/PassManager.h>
+#endif
 
 
 //#include <DataLayout.h>
 
+/* runtime entry points (corrupt.c): one per value type, each in a generic version decoding
+   parameter and versions specialised for any byte and bit (_rand) or a fixed byte and bit
+   (_fixed) */
+enum { CORRUPT_INT_8 = 0, CORRUPT_INT_16, CORRUPT_INT_32, CORRUPT_INT_64, CORRUPT_FLOAT_32,
+       CORRUPT_FLOAT_64, CORRUPT_PTR2INT_64, NUM_CORRUPT_FUNCS };
+enum { CORRUPT_GENERIC = 0, CORRUPT_RAND, CORRUPT_FIXED, NUM_CORRUPT_VARIANTS };
+
+/* branch weight of the not-armed path of an injection guard; the armed path has weight 1 */
+#define GUARD_BRANCH_WEIGHT 2000
+
 #ifdef COMPILE_PASS
 static cl::opt<string> funcList("funcList", cl::desc("Name(s) of the function(s) to be targeted"), cl::value_desc("func1 func2 func3"), cl::init(""), cl::ValueRequired);
 static cl::opt<string> configPath("config", cl::desc("Path to the FlipIt Config file"), cl::value_desc("/path/to/FlipIt.config"), cl::init("FlipIt.config"));
@@ -71,11 +93,82 @@ static cl::opt<bool> arith_err("arith", cl::desc("Inject Faults Into Arithmetic
 static cl::opt<bool> ctrl_err("ctrl", cl::desc("Inject Faults Into Control Instructions"), cl::value_desc("0/1"), cl::init(1), cl::ValueRequired);
 static cl::opt<bool> ptr_err("ptr", cl::desc("Inject Faults Into Pointer Instructions"), cl::value_desc("0/1"), cl::init(1), cl::ValueRequired);
 static cl::opt<string> srcFile("srcFile", cl::desc("Name of the source file being compiled"), cl::value_desc("e.g. foo.c, foo.cpp, or foo.f90"), cl::init("UNKNOWN"), cl::ValueRequired);
-static cl::opt<string> stateFile("stateFile", cl::desc("Name of the state file being updated when compiled. Used to provide unique fault site indexes."), cl::value_desc("FlipItState"), cl::init("FlipItState"), cl::ValueRequired);
+static cl::opt<string> stateFile("stateFile", cl::desc("Ignored; fault sites are numbered per module and made unique when the program is loaded"), cl::value_desc("FlipItState"), cl::init("FlipItState"), cl::ValueRequired);
+static cl::opt<bool> guard_inj("guard", cl::desc("Only call the corruption functions when the runtime is armed"), cl::value_desc("0/1"), cl::init(1), cl::ValueRequired);
+static cl::opt<bool> count_insts("countInsts", cl::desc("Count unarmed fault sites inline to keep the executed instruction count exact"), cl::value_desc("0/1"), cl::init(0), cl::ValueRequired);
+#endif
+
+
+
+
+/***********************************************************************************************/
+/* IR construction that differs between LLVM 3.5 and the releases with the pass plugin         */
+/***********************************************************************************************/
+namespace FlipIt {
+    static inline LoadInst* createLoad(Value* ptr, const char* name, Instruction* insertPt) {
+#ifdef FLIPIT_PASS_PLUGIN
+        return new LoadInst(ptr->getType()->getPointerElementType(), ptr, name, insertPt);
+#else
+        return new LoadInst(ptr, name, insertPt);
+#endif
+    }
+
+    static inline LoadInst* createLoad(Value* ptr, const char* name, BasicBlock* BB) {
+#ifdef FLIPIT_PASS_PLUGIN
+        return new LoadInst(ptr->getType()->getPointerElementType(), ptr, name, BB);
+#else
+        return new LoadInst(ptr, name, BB);
 #endif
+    }
 
+    static inline AllocaInst* createAlloca(Type* type, unsigned int align, const char* name,
+                                           Instruction* insertPt) {
+#ifdef FLIPIT_PASS_PLUGIN
+        auto slot = new AllocaInst(type, 0, name, insertPt);
+        slot->setAlignment(Align(align));
+#else
+        auto slot = new AllocaInst(type, name, insertPt);
+        slot->setAlignment(align);
+#endif
+        return slot;
+    }
 
+    static inline CallInst* createCall(Value* callee, ArrayRef<Value*> args, const char* name,
+                                       Instruction* insertPt) {
+#ifdef FLIPIT_PASS_PLUGIN
+        return CallInst::Create(cast<Function>(callee)->getFunctionType(), callee, args, name,
+                                insertPt);
+#else
+        return CallInst::Create(callee, args, name, insertPt);
+#endif
+    }
 
+    static inline unsigned int numArgs(CallInst* callInst) {
+#ifdef FLIPIT_PASS_PLUGIN
+        return callInst->arg_size();
+#else
+        return callInst->getNumArgOperands();
+#endif
+    }
+
+    /* number of lanes of a vector type, or 0 for scalable vectors */
+    static inline unsigned int vectorLanes(Type* type) {
+#if LLVM_VERSION_MAJOR >= 11
+        return isa<FixedVectorType>(type) ? cast<FixedVectorType>(type)->getNumElements() : 0;
+#else
+        return cast<VectorType>(type)->getNumElements();
+#endif
+    }
+
+    /* the runtime function name of type, declared if corrupt.bc was not linked in */
+    static inline Function* runtimeFunction(Module* M, const std::string& name,
+                                            FunctionType* type) {
+        Function* F = M->getFunction(name);
+        if (F == NULL)
+            F = Function::Create(type, GlobalValue::ExternalLinkage, name, M);
+        return F;
+    }
+}
 
 /*Dynamic Fault Injection LLVM Pass*/
 namespace FlipIt {
@@ -94,6 +187,8 @@ namespace FlipIt {
             bool ptr_err;
             std::string srcFile;
             std::string stateFile;
+            bool guard_inj;
+            bool count_insts;
 #endif
         public:
             static char ID; 
@@ -119,6 +214,10 @@ namespace FlipIt {
 
             void init();
             bool finalize();
+            void emitSiteTable();
+            uint64_t hashModule();
+            uint64_t siteRand(uint32_t salt);
+            Value* siteValue(Instruction* insertPt);
 			//std::vector<std::string> splitAtSpace(std::string spltStr);
 			void splitAtSpace();
             int selectArgument(CallInst* callInst);
@@ -126,7 +225,6 @@ namespace FlipIt {
             Value* getInstProb(Instruction* I);
             std::string demangle(std::string name);
             bool viableFunction(std::string name, std::vector<std::string>& flist);
-            unsigned long updateStateFile(const char* stateFile, unsigned long sum);
 
             bool injectControl(Instruction* I);
             bool injectArithmetic(Instruction* I);
@@ -140,6 +238,10 @@ namespace FlipIt {
             bool injectCall_NEW(Instruction* I);
             bool injectResult(Instruction* I);
 			bool injectInOperand(Instruction* I, int operand);
+            Value* guardCorruption(Instruction* first, Instruction* last, Value* orig);
+            void applyGuards();
+            Type* corruptIntType(Type* type);
+            CallInst* createCorruptCall(Type* type, Instruction* insertPt);
             
             bool inject_Store_Data(Instruction* I,  CallInst* CallI);
             bool inject_Compare(Instruction* I, CallInst* CallI);
@@ -152,7 +254,7 @@ namespace FlipIt {
             bool inject_GetElementPtr_Ptr(Instruction* I, CallInst* CallI, BasicBlock* BB);
             
             bool copyMetadata(Instruction* New, Instruction* Old);
-            unsigned long cacheFunctions();
+            void cacheFunctions();
             bool injectFault(Instruction* I);
 
             Module* M;
@@ -172,6 +274,10 @@ namespace FlipIt {
             Value* func_corruptIntAdr_64bit;
             Value* func_corruptFloatAdr_32bit;
             Value* func_corruptFloatAdr_64bit;
+            Value* func_corruptVectorData;
+            Value* func_corrupt[NUM_CORRUPT_FUNCS][NUM_CORRUPT_VARIANTS];
+            Constant* armedFlag;
+            Constant* totalInsts;
 
             // used for display and analysis
             Type* i64Ty;
@@ -179,15 +285,31 @@ namespace FlipIt {
             std::map<int, Value*> byteVal;
             std::map<std::string, Value*> funcProbs;
             std::map<std::string, Value*> instProbs;
+            std::vector<Value*> opcodeProbs;                /* instProbs by opcode */
+            std::map<Function*, Value*> calleeProbs;        /* funcProbs by callee, or NULL */
+            std::vector<int> argPos;                        /* selectArgument candidates */
+            std::vector<int> argTypes;
+
+            /* corruption code [first, last] of a site to guard (guardCorruption) */
+            struct PendingGuard {
+                Instruction* first;
+                Instruction* last;
+                Value* orig;
+                PendingGuard(Instruction* f, Instruction* l, Value* o) : first(f), last(l), orig(o) {}
+            };
+            std::vector<PendingGuard> pendingGuards;
             int comment;
             int injectionType;
             std::stringstream strStream;
             unsigned int oldFaultIdx;
-            unsigned int faultIdx;
+            unsigned int faultIdx;      /* of the next site, counted from 0 in each module */
+            std::string sourceName;     /* -srcFile, or the module identifier (clang plugin) */
+            uint64_t moduleHash;        /* identity of the module, from its source path */
+            GlobalVariable* siteBase;   /* index of the module's first site, set at load time */
+            Instruction* siteFirst;     /* first instruction of the latest site index */
             unsigned int displayIdx;
             unsigned int parameter;
             std::vector<std::string> flist;
-            std::vector <Instruction*> phis;
             bool simdInst;
     };/*end class definition*/
 }/*end namespace*/
@@ -195,6 +317,38 @@ namespace FlipIt {
 #ifdef COMPILE_PASS
 char FlipIt::DynamicFaults::ID = 0;
 static RegisterPass<FlipIt::DynamicFaults> F0("FlipIt", "Dynamic Fault Injection emulating transient hardware error behavior");
+
+#ifdef FLIPIT_PASS_PLUGIN
+/* New pass manager version of the pass, configured by the same options (passed to clang as
+   -mllvm -prob=... after -Xclang -load -Xclang libFlipItPass.so). It runs at the end of clang's
+   optimization pipeline, the place of opt in the flipit-cc steps, so a fault injecting compile
+   is a single compiler invocation without intermediate bitcode files. */
+namespace FlipIt {
+    struct DynamicFaultsPass : PassInfoMixin<DynamicFaultsPass> {
+        PreservedAnalyses run(Module& M, ModuleAnalysisManager&) {
+            DynamicFaults pass;
+            return pass.runOnModule(M) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+        }
+    };
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return {LLVM_PLUGIN_API_VERSION, "FlipIt", LLVM_VERSION_STRING, [](PassBuilder& PB) {
+        /* opt -load-pass-plugin libFlipItPass.so -passes=FlipIt */
+        PB.registerPipelineParsingCallback(
+            [](StringRef name, ModulePassManager& MPM, ArrayRef<PassBuilder::PipelineElement>) {
+                if (name != "FlipIt")
+                    return false;
+                MPM.addPass(FlipIt::DynamicFaultsPass());
+                return true;
+            });
+        /* clang -fpass-plugin=libFlipItPass.so */
+        PB.registerOptimizerLastEPCallback([](ModulePassManager& MPM, auto level) {
+            MPM.addPass(FlipIt::DynamicFaultsPass());
+        });
+    }};
+}
+#endif
 #endif
 
 #endif
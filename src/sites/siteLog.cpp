@@ -0,0 +1,364 @@
+/***********************************************************************************************/
+/* This file is licensed under the University of Illinois/NCSA Open Source License.            */
+/* See LICENSE.TXT for details.                                                                */
+/***********************************************************************************************/
+
+/***********************************************************************************************/
+/*                                                                                             */
+/* Name: siteLog.cpp                                                                           */
+/*                                                                                             */
+/* Description: Reader of the fault site logs. Indexed logs are mapped and used in place;      */
+/*              the stream logs of versions 1 and 2 are decoded once into the same tables.     */
+/*              Only malloc and the C library are used (no exceptions, no libstdc++), so the   */
+/*              object can go into libcorrupt.a and be linked into C programs.                 */
+/*                                                                                             */
+/***********************************************************************************************/
+
+#include "siteLog.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+/* growable array of a trivially copyable type */
+template <typename T>
+class Buffer
+{
+  public:
+    Buffer() : data(NULL), size(0), capacity(0) {}
+    ~Buffer() { free(data); }
+    bool push(const T* items, uint64_t n) {
+        if (size + n > capacity) {
+            uint64_t c = capacity == 0 ? 1024 : 2 * capacity;
+            while (c < size + n)
+                c *= 2;
+            T* d = (T*) realloc(data, c * sizeof(T));
+            if (d == NULL)
+                return false;
+            data = d;
+            capacity = c;
+        }
+        memcpy(data + size, items, n * sizeof(T));
+        size += n;
+        return true;
+    }
+    bool push(const T& item) { return push(&item, 1); }
+    /* hands the array to the caller */
+    T* release() { T* d = data; data = NULL; size = capacity = 0; return d; }
+
+    T* data;
+    uint64_t size;
+    uint64_t capacity;
+};
+
+/* bounds checked little endian decoding of a stream log */
+class Stream
+{
+  public:
+    Stream(const uint8_t* p, uint64_t n) : p(p), end(p + n), ok(true) {}
+    bool more() const { return ok && p < end; }
+    const uint8_t* bytes(uint64_t n) {
+        if ((uint64_t) (end - p) < n) {
+            ok = false;
+            return NULL;
+        }
+        const uint8_t* b = p;
+        p += n;
+        return b;
+    }
+    uint64_t value(unsigned n) {
+        const uint8_t* b = bytes(n);
+        uint64_t v = 0;
+        for (unsigned i = 0; ok && i < n; i++)
+            v |= (uint64_t) b[i] << (8 * i);
+        return v;
+    }
+
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok;
+};
+
+/* opcode numbering of LLVM 3.5, which the stream logs store */
+const char* const StreamOpcodes[] = { "unknown", "ret", "br", "switch", "indirectbr", "invoke",
+    "resume", "unreachable", "add", "fadd", "sub", "fsub", "mul", "fmul", "udiv", "sdiv", "fdiv",
+    "urem", "srem", "frem", "shl", "lshr", "ashr", "and", "or", "xor", "alloca", "load", "store",
+    "getelementptr", "fence", "cmpxchg", "atomicrmw", "trunc", "zext", "sext", "fptoui", "fptosi",
+    "uitofp", "sitofp", "fptrunc", "fpext", "ptrtoint", "inttoptr", "bitcast", "addrspacecast",
+    "icmp", "fcmp", "phi", "call", "select", "userop1", "userop2", "va_arg", "extractelement",
+    "insertelement", "shufflevector", "extractvalue", "insertvalue", "landingpad" };
+const unsigned NumStreamOpcodes = sizeof(StreamOpcodes) / sizeof(StreamOpcodes[0]);
+
+const uint8_t StreamFunction = 255;    /* function header: name length, name, first site */
+const uint8_t StreamVector = 254;      /* the next site is a vector: lanes */
+const uint16_t StreamNewFile = 0x8000; /* line is the length of a new file name */
+
+} // namespace
+
+struct flipit_sitelog
+{
+    flipit_sitelog_header_t header;
+    const flipit_sitelog_site_t* sites;
+    const flipit_sitelog_function_t* functions;
+    const flipit_sitelog_location_t* locations;
+    const char* strings;
+
+    void* map;          /* mapping of an indexed log */
+    uint64_t mapBytes;
+    void* owned[4];     /* tables decoded from a stream log */
+
+    const char* string(uint32_t offset) const {
+        return offset < header.stringBytes ? strings + offset : "";
+    }
+    bool indexed(const uint8_t* file, uint64_t bytes);
+    bool stream(const uint8_t* file, uint64_t bytes);
+};
+
+/* Checks that the tables of a mapped log lie in the file and uses them in place */
+bool flipit_sitelog::indexed(const uint8_t* file, uint64_t bytes) {
+    if (bytes < sizeof(header))
+        return false;
+    memcpy(&header, file, sizeof(header));
+    if (header.version != FLIPIT_SITELOG_VERSION)
+        return false;
+
+    const uint64_t tables[4][2] = {
+        { header.sites, (uint64_t) header.numSites * sizeof(flipit_sitelog_site_t) },
+        { header.functions, (uint64_t) header.numFunctions * sizeof(flipit_sitelog_function_t) },
+        { header.locations, (uint64_t) header.numLocations * sizeof(flipit_sitelog_location_t) },
+        { header.strings, header.stringBytes } };
+    for (unsigned i = 0; i < 4; i++)
+        if (tables[i][0] > bytes || tables[i][1] > bytes - tables[i][0] || tables[i][0] % 4 != 0)
+            return false;
+    if (header.stringBytes == 0 || file[header.strings + header.stringBytes - 1] != '\0')
+        return false;
+
+    sites = (const flipit_sitelog_site_t*) (file + header.sites);
+    functions = (const flipit_sitelog_function_t*) (file + header.functions);
+    locations = (const flipit_sitelog_location_t*) (file + header.locations);
+    strings = (const char*) (file + header.strings);
+    return true;
+}
+
+/* Decodes a version 1 or 2 stream log into tables of the indexed layout */
+bool flipit_sitelog::stream(const uint8_t* file, uint64_t bytes) {
+    Buffer<flipit_sitelog_site_t> siteTable;
+    Buffer<flipit_sitelog_function_t> functionTable;
+    Buffer<flipit_sitelog_location_t> locationTable;
+    Buffer<char> stringTable;
+    uint32_t opcodes[NumStreamOpcodes];
+    Stream in(file, bytes);
+    uint64_t site = 0;
+    uint16_t lanes = 0;
+    bool started = false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FLIPIT_SITELOG_MAGIC, sizeof(header.magic));
+    header.version = (uint32_t) in.value(1);
+    memset(opcodes, 0xFF, sizeof(opcodes));
+
+    stringTable.push('\0');
+    uint16_t nameSize = (uint16_t) in.value(2);
+    const uint8_t* name = in.bytes(nameSize);
+    if (!in.ok)
+        return false;
+    header.source = (uint32_t) stringTable.size;
+    stringTable.push((const char*) name, nameSize);
+    stringTable.push('\0');
+    if (header.version >= 2)
+        header.module = in.value(8);
+    else
+        header.flags = FLIPIT_SITELOG_GLOBAL;
+    /* sites take the file of the previous site; the first one the source file */
+    uint32_t currFile = header.source;
+    bool debugInfo = true;
+
+    while (in.more()) {
+        uint8_t opcode = (uint8_t) in.value(1);
+        if (opcode == StreamVector) {
+            lanes = (uint16_t) in.value(2);
+        }
+        else if (opcode == StreamFunction) {
+            uint8_t size = (uint8_t) in.value(1);
+            name = in.bytes(size);
+            site = in.value(8);
+            if (!in.ok)
+                break;
+            if (!started && (header.flags & FLIPIT_SITELOG_GLOBAL))
+                header.firstSite = (uint32_t) site;
+            started = true;
+
+            flipit_sitelog_function_t f;
+            f.name = (uint32_t) stringTable.size;
+            f.firstSite = (uint32_t) (site - header.firstSite);
+            stringTable.push((const char*) name, size);
+            stringTable.push('\0');
+            functionTable.push(f);
+        }
+        else {
+            uint8_t typeInfo = (uint8_t) in.value(1);
+            uint16_t line = (uint16_t) in.value(2);
+            if (line & StreamNewFile) {
+                uint16_t size = line & ~StreamNewFile;
+                line = (uint16_t) in.value(2);
+                name = in.bytes(size);
+                if (!in.ok)
+                    break;
+                debugInfo = !(size == 4 && memcmp(name, "__NF", 4) == 0);
+                currFile = (uint32_t) stringTable.size;
+                stringTable.push((const char*) name, size);
+                stringTable.push('\0');
+            }
+            /* the sites of a log are consecutive */
+            if (!in.ok || !started || site - header.firstSite != siteTable.size)
+                return false;
+
+            flipit_sitelog_site_t s;
+            s.function = (uint32_t) functionTable.size - 1;
+            s.location = FLIPIT_SITELOG_NONE;
+            if (debugInfo) {
+                const flipit_sitelog_location_t* last = locationTable.size == 0 ? NULL :
+                                                        locationTable.data + locationTable.size - 1;
+                if (last == NULL || last->file != currFile || last->line != line) {
+                    flipit_sitelog_location_t l = { currFile, line, 0, FLIPIT_SITELOG_NONE };
+                    locationTable.push(l);
+                }
+                s.location = (uint32_t) locationTable.size - 1;
+            }
+            if (opcode >= NumStreamOpcodes)
+                opcode = 0;
+            if (opcodes[opcode] == FLIPIT_SITELOG_NONE) {
+                opcodes[opcode] = (uint32_t) stringTable.size;
+                stringTable.push(StreamOpcodes[opcode], strlen(StreamOpcodes[opcode]) + 1);
+            }
+            s.opcode = opcodes[opcode];
+            s.type = typeInfo >> 5;
+            s.info = typeInfo & 0x1F;
+            s.lanes = lanes;
+            siteTable.push(s);
+            lanes = 0;
+            site++;
+        }
+    }
+    if (!in.ok || siteTable.size > UINT32_MAX || stringTable.size > UINT32_MAX)
+        return false;
+
+    header.numSites = (uint32_t) siteTable.size;
+    header.numFunctions = (uint32_t) functionTable.size;
+    header.numLocations = (uint32_t) locationTable.size;
+    header.stringBytes = stringTable.size;
+    owned[0] = siteTable.release();
+    owned[1] = functionTable.release();
+    owned[2] = locationTable.release();
+    owned[3] = stringTable.release();
+    sites = (const flipit_sitelog_site_t*) owned[0];
+    functions = (const flipit_sitelog_function_t*) owned[1];
+    locations = (const flipit_sitelog_location_t*) owned[2];
+    strings = (const char*) owned[3];
+    return true;
+}
+
+flipit_sitelog_t* flipit_sitelogOpen(const char* path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < 4) {
+        close(fd);
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    flipit_sitelog_t* log = (flipit_sitelog_t*) calloc(1, sizeof(flipit_sitelog_t));
+    const uint8_t* file = (const uint8_t*) map;
+    bool ok = false;
+    if (log != NULL) {
+        log->map = map;
+        log->mapBytes = st.st_size;
+        if (memcmp(file, FLIPIT_SITELOG_MAGIC, 4) == 0)
+            ok = log->indexed(file, st.st_size);
+        else if (file[0] == 1 || file[0] == 2) {
+            ok = log->stream(file, st.st_size);
+            /* the decoded tables do not point into the file */
+            munmap(map, st.st_size);
+            log->map = NULL;
+        }
+    }
+    if (!ok) {
+        flipit_sitelogClose(log);
+        if (log == NULL)
+            munmap(map, st.st_size);
+        return NULL;
+    }
+    return log;
+}
+
+void flipit_sitelogClose(flipit_sitelog_t* log) {
+    if (log == NULL)
+        return;
+    if (log->map != NULL)
+        munmap(log->map, log->mapBytes);
+    for (unsigned i = 0; i < 4; i++)
+        free(log->owned[i]);
+    free(log);
+}
+
+const flipit_sitelog_header_t* flipit_sitelogHeader(const flipit_sitelog_t* log) {
+    return &log->header;
+}
+
+const char* flipit_sitelogSource(const flipit_sitelog_t* log) {
+    return log->string(log->header.source);
+}
+
+int flipit_sitelogSite(const flipit_sitelog_t* log, uint32_t site, flipit_site_info_t* info) {
+    uint32_t i = site - log->header.firstSite;
+    if (site < log->header.firstSite || i >= log->header.numSites)
+        return 0;
+
+    const flipit_sitelog_site_t& s = log->sites[i];
+    info->site = site;
+    info->function = s.function < log->header.numFunctions ?
+                     log->string(log->functions[s.function].name) : "";
+    info->opcode = log->string(s.opcode);
+    info->type = s.type;
+    info->info = s.info;
+    info->lanes = s.lanes;
+    info->file = "";
+    info->line = info->column = 0;
+    info->inlinedAt = FLIPIT_SITELOG_NONE;
+    if (s.location != FLIPIT_SITELOG_NONE)
+        info->inlinedAt = flipit_sitelogLocation(log, s.location, &info->file, &info->line,
+                                                 &info->column);
+    return 1;
+}
+
+uint32_t flipit_sitelogLocation(const flipit_sitelog_t* log, uint32_t location,
+                                const char** file, uint32_t* line, uint32_t* column) {
+    if (location >= log->header.numLocations) {
+        *file = "";
+        *line = *column = 0;
+        return FLIPIT_SITELOG_NONE;
+    }
+    const flipit_sitelog_location_t& l = log->locations[location];
+    *file = log->string(l.file);
+    *line = l.line;
+    *column = l.column;
+    /* the writer only points at earlier locations, which keeps a chain finite */
+    return l.inlinedAt < location ? l.inlinedAt : FLIPIT_SITELOG_NONE;
+}
+
+const char* flipit_sitelogFunction(const flipit_sitelog_t* log, uint32_t i, uint32_t* firstSite) {
+    if (i >= log->header.numFunctions)
+        return NULL;
+    *firstSite = log->functions[i].firstSite + log->header.firstSite;
+    return log->string(log->functions[i].name);
+}
@@ -0,0 +1,152 @@
+/***********************************************************************************************/
+/* This file is licensed under the University of Illinois/NCSA Open Source License.            */
+/* See LICENSE.TXT for details.                                                                */
+/***********************************************************************************************/
+
+/***********************************************************************************************/
+/*                                                                                             */
+/* Name: siteLog.h                                                                             */
+/*                                                                                             */
+/* Description: Layout of the fault site log (*.LLVM.bin) written by the compiler pass         */
+/*              (Logger.h) and the reader shared by the runtime, the analysis scripts and      */
+/*              binary2ascii.py. The log is a header followed by fixed size tables, so a file  */
+/*              can be mapped and site N found without decoding the sites before it. The       */
+/*              reader also accepts the stream logs of versions 1 and 2.                       */
+/*                                                                                             */
+/***********************************************************************************************/
+
+#ifndef FLIPIT_SITELOG_H
+#define FLIPIT_SITELOG_H
+
+#include <stdint.h>
+
+#define FLIPIT_SITELOG_MAGIC "FISL"
+#define FLIPIT_SITELOG_VERSION 3    /* 1 and 2 are the stream formats */
+#define FLIPIT_SITELOG_NONE 0xFFFFFFFF
+
+/* header flags */
+#define FLIPIT_SITELOG_GLOBAL 0x1   /* version 1: site indexes are global, module is 0 */
+
+/* File layout, all little endian: header, sites, functions, locations, then the string table.
+   Strings are offsets into the NUL terminated string table; offset 0 is "". */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t module;            /* module hash; the runtime orders the modules by it */
+    uint32_t numSites;
+    uint32_t numFunctions;
+    uint32_t numLocations;
+    uint32_t source;            /* string: source file of the module */
+    uint32_t flags;
+    uint32_t firstSite;         /* index of the first site, 0 unless FLIPIT_SITELOG_GLOBAL */
+    uint64_t sites;             /* file offsets of the tables */
+    uint64_t functions;
+    uint64_t locations;
+    uint64_t strings;
+    uint64_t stringBytes;
+} flipit_sitelog_header_t;
+
+typedef struct {
+    uint32_t function;          /* index of the function record */
+    uint32_t location;          /* index of the location record, NONE without debug info */
+    uint32_t opcode;            /* string: LLVM opcode name */
+    uint8_t type;               /* INJ_TYPES */
+    uint8_t info;               /* INJ_INFO_TYPES */
+    uint16_t lanes;             /* vector lanes, 0 for scalar sites */
+} flipit_sitelog_site_t;
+
+typedef struct {
+    uint32_t name;              /* string: demangled name */
+    uint32_t firstSite;         /* index of its first site in this log */
+} flipit_sitelog_function_t;
+
+typedef struct {
+    uint32_t file;              /* string: directory/file */
+    uint32_t line;
+    uint32_t column;
+    uint32_t inlinedAt;         /* location the code was inlined at, or NONE */
+} flipit_sitelog_location_t;
+
+/* A site as returned by the reader, strings resolved */
+typedef struct {
+    uint32_t site;
+    const char* function;
+    const char* opcode;
+    const char* file;           /* "" without debug info */
+    uint32_t line;
+    uint32_t column;
+    uint32_t inlinedAt;         /* pass to flipit_sitelogLocation, or NONE */
+    uint8_t type;
+    uint8_t info;
+    uint16_t lanes;
+} flipit_site_info_t;
+
+typedef struct flipit_sitelog flipit_sitelog_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* NULL if path can not be read or is not a site log */
+flipit_sitelog_t* flipit_sitelogOpen(const char* path);
+void flipit_sitelogClose(flipit_sitelog_t* log);
+const flipit_sitelog_header_t* flipit_sitelogHeader(const flipit_sitelog_t* log);
+const char* flipit_sitelogSource(const flipit_sitelog_t* log);
+/* site is an index of this log (firstSite to firstSite + numSites - 1); 0 if out of range */
+int flipit_sitelogSite(const flipit_sitelog_t* log, uint32_t site, flipit_site_info_t* info);
+/* walks an inlined-at chain; returns the next location or NONE */
+uint32_t flipit_sitelogLocation(const flipit_sitelog_t* log, uint32_t location,
+                                const char** file, uint32_t* line, uint32_t* column);
+/* function i of numFunctions; returns its name */
+const char* flipit_sitelogFunction(const flipit_sitelog_t* log, uint32_t i, uint32_t* firstSite);
+
+#ifdef __cplusplus
+}
+
+namespace FlipIt {
+
+/* C++ view of a site log, e.g.
+       FlipIt::SiteLog log("foo.c.LLVM.bin");
+       for (FlipIt::SiteLog::iterator s = log.begin(); s != log.end(); ++s)
+           printf("%u %s:%u\n", s->site, s->file, s->line); */
+class SiteLog
+{
+  public:
+    class iterator
+    {
+      public:
+        iterator(const SiteLog* log, uint32_t site) : log(log), site(site) { load(); }
+        const flipit_site_info_t& operator*() const { return info; }
+        const flipit_site_info_t* operator->() const { return &info; }
+        iterator& operator++() { site++; load(); return *this; }
+        bool operator!=(const iterator& o) const { return site != o.site; }
+        bool operator==(const iterator& o) const { return site == o.site; }
+      private:
+        void load() { if (!log->site(site, info)) info.site = site; }
+        const SiteLog* log;
+        uint32_t site;
+        flipit_site_info_t info;
+    };
+
+    explicit SiteLog(const char* path) : log(flipit_sitelogOpen(path)) {}
+    ~SiteLog() { flipit_sitelogClose(log); }
+
+    bool good() const { return log != 0; }
+    const flipit_sitelog_header_t& header() const { return *flipit_sitelogHeader(log); }
+    uint32_t size() const { return header().numSites; }
+    bool site(uint32_t site, flipit_site_info_t& info) const {
+        return flipit_sitelogSite(log, site, &info) != 0;
+    }
+    iterator begin() const { return iterator(this, header().firstSite); }
+    iterator end() const { return iterator(this, header().firstSite + header().numSites); }
+
+  private:
+    SiteLog(const SiteLog&);
+    SiteLog& operator=(const SiteLog&);
+    flipit_sitelog_t* log;
+};
+
+} // namespace FlipIt
+#endif
+
+#endif